@@ -12,6 +12,16 @@
 
 using namespace ospray::sg;
 
+// A float array aliasing a buffer released from a particle lasso array,
+// the buffer is kept alive until the scenegraph drops the array
+struct LassoDataArray1f : public DataArray1f {
+	std::shared_ptr<void> owner;
+
+	LassoDataArray1f(pl::ReleasedBuffer<float> buffer)
+		: DataArray1f(buffer.data, buffer.size, false), owner(std::move(buffer.owner))
+	{}
+};
+
 void import_particle_lasso(std::shared_ptr<Node> world, const ospcommon::FileName file_name) {
 	std::cout << "Loading particles with Particle Lasso from "
 		<< file_name << std::endl;
@@ -33,10 +43,18 @@ void import_particle_lasso(std::shared_ptr<Node> world, const ospcommon::FileNam
 	// then we can just store the color as an RGBA8 attribute. This is
 	// probably easier/faster than fixing up my colormapped spheres module for Embree3
 
-	auto spheres = std::make_shared<DataVector1f>();
-	const pl::DataT<float> *positions = dynamic_cast<pl::DataT<float>*>(model["positions"].get());
-	std::copy(positions->data.begin(), positions->data.end(),
-			std::back_inserter(spheres->v));
+	// Positions owned by a DataT or aliased in a mapped file are handed over to the
+	// scenegraph without copying, other arrays are decoded to floats
+	std::shared_ptr<DataBuffer> spheres;
+	const auto &positions = model["positions"];
+	if (pl::can_release_buffer<float>(*positions)) {
+		spheres = std::make_shared<LassoDataArray1f>(pl::release_buffer<float>(*positions));
+	} else {
+		auto decoded = std::make_shared<DataVector1f>();
+		decoded->v.resize(positions->size());
+		positions->get_floats(0, positions->size(), decoded->v.data());
+		spheres = decoded;
+	}
 	spheres->setName("spheres");
 	geom->add(spheres);
 
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include "json.hpp"
+#include "layout.h"
+#include "parallel.h"
+#include "view.h"
+#include "memory_report.h"
+#include "bricking.h"
+
+using namespace pl;
+using json = nlohmann::json;
+
+// The fewest particles binned by each thread
+const size_t BRICK_GRAIN = 4096;
+// Number of elements written at a time by export_bricks
+const size_t WRITE_BLOCK = 64 * 1024;
+
+// The grid of bricks over the region being split
+struct BrickGrid {
+	size_t dims[3];
+	vec3f lower;
+	vec3f inv_size;
+
+	// Get the brick along the axis holding x. Positions outside the grid are clamped
+	// to it and NaNs go to the first brick
+	size_t cell(const size_t axis, const float x) const {
+		const float f = (x - lower[axis]) * inv_size[axis];
+		if (f >= 0.f) {
+			return f < static_cast<float>(dims[axis]) ? static_cast<size_t>(f) : dims[axis] - 1;
+		}
+		return 0;
+	}
+	size_t index(const size_t x, const size_t y, const size_t z) const {
+		return x + dims[0] * (y + dims[1] * z);
+	}
+};
+
+// Call f with the index of each brick the particle at p is a ghost in, i.e. those
+// within width of it other than the brick owning it
+template<typename F>
+static void for_each_ghost_brick(const BrickGrid &grid, const float *p, const float width,
+		const size_t owner, const F &f)
+{
+	size_t lo[3], hi[3];
+	for (size_t c = 0; c < 3; ++c) {
+		lo[c] = grid.cell(c, p[c] - width);
+		hi[c] = grid.cell(c, p[c] + width);
+	}
+	for (size_t z = lo[2]; z <= hi[2]; ++z) {
+		for (size_t y = lo[1]; y <= hi[1]; ++y) {
+			for (size_t x = lo[0]; x <= hi[0]; ++x) {
+				const size_t b = grid.index(x, y, z);
+				if (b != owner) {
+					f(b);
+				}
+			}
+		}
+	}
+}
+
+std::vector<Brick> pl::brick_particles(const ParticleModel &model, const BrickOptions &options) {
+	auto fnd = model.find("positions");
+	if (fnd == model.end()) {
+		throw std::runtime_error("brick_particles: the model has no positions");
+	}
+	const Data &positions = *fnd->second;
+	if (positions.components != 3) {
+		throw std::runtime_error("brick_particles: the positions must have 3 components");
+	}
+	if (options.dims[0] == 0 || options.dims[1] == 0 || options.dims[2] == 0) {
+		throw std::runtime_error("brick_particles: there must be at least one brick along each axis");
+	}
+	if (!(options.ghost_width >= 0.f)) {
+		throw std::runtime_error("brick_particles: the ghost width can't be negative");
+	}
+	const size_t num_bricks = options.dims[0] * options.dims[1] * options.dims[2];
+	if (num_bricks > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("brick_particles: too many bricks");
+	}
+
+	box3f bounds = options.bounds.empty() ? pl::bounds(positions) : options.bounds;
+	if (bounds.empty()) {
+		bounds = box3f(vec3f(0.f), vec3f(0.f));
+	}
+	BrickGrid grid;
+	grid.lower = bounds.lower;
+	const vec3f size = bounds.size();
+	for (size_t c = 0; c < 3; ++c) {
+		grid.dims[c] = options.dims[c];
+		grid.inv_size[c] = size[c] > 0.f ? options.dims[c] / size[c] : 0.f;
+	}
+	const float width = options.ghost_width;
+
+	// Each range of particles is counted into its own row of counts, the rows are then
+	// turned into the offsets each range scatters its particles to. Each brick's
+	// owned particles are followed by its ghosts, both in the order of the model
+	const size_t n = positions.count();
+	const size_t ranges = clamp(n / BRICK_GRAIN, size_t(1), num_threads());
+	const size_t range_size = (n + ranges - 1) / ranges;
+	std::vector<uint32_t> owner(n);
+	std::vector<size_t> owned_offsets(ranges * num_bricks, 0);
+	std::vector<size_t> ghost_offsets(ranges * num_bricks, 0);
+	std::vector<std::shared_ptr<std::vector<size_t>>> indices(num_bricks);
+	{
+		AllocationPhase phase("bricks: bin");
+		const ComponentStrides strides(positions);
+		// Run f(range, i, p) on each particle i in parallel, with its position p
+		auto for_each_particle = [&](const auto &f) {
+			visit(positions, [&](const auto &view) {
+				parallel_for(0, ranges, 1, [&](const size_t range_begin, const size_t range_end) {
+					for (size_t r = range_begin; r < range_end; ++r) {
+						const size_t end = std::min(n, (r + 1) * range_size);
+						for (size_t i = r * range_size; i < end; ++i) {
+							float p[3];
+							for (size_t c = 0; c < 3; ++c) {
+								p[c] = static_cast<float>(view.data()[i * strides.particle_stride
+										+ c * strides.component_stride]);
+							}
+							f(r, i, p);
+						}
+					}
+				});
+			});
+		};
+
+		for_each_particle([&](const size_t r, const size_t i, const float *p) {
+			const size_t b = grid.index(grid.cell(0, p[0]), grid.cell(1, p[1]), grid.cell(2, p[2]));
+			owner[i] = static_cast<uint32_t>(b);
+			++owned_offsets[r * num_bricks + b];
+			if (width > 0.f) {
+				for_each_ghost_brick(grid, p, width, b, [&](const size_t g) {
+					++ghost_offsets[r * num_bricks + g];
+				});
+			}
+		});
+		for (size_t b = 0; b < num_bricks; ++b) {
+			size_t offset = 0;
+			for (size_t r = 0; r < ranges; ++r) {
+				const size_t count = owned_offsets[r * num_bricks + b];
+				owned_offsets[r * num_bricks + b] = offset;
+				offset += count;
+			}
+			for (size_t r = 0; r < ranges; ++r) {
+				const size_t count = ghost_offsets[r * num_bricks + b];
+				ghost_offsets[r * num_bricks + b] = offset;
+				offset += count;
+			}
+			indices[b] = std::make_shared<std::vector<size_t>>(offset);
+		}
+		for_each_particle([&](const size_t r, const size_t i, const float *p) {
+			const size_t b = owner[i];
+			(*indices[b])[owned_offsets[r * num_bricks + b]++] = i;
+			if (width > 0.f) {
+				for_each_ghost_brick(grid, p, width, b, [&](const size_t g) {
+					(*indices[g])[ghost_offsets[r * num_bricks + g]++] = i;
+				});
+			}
+		});
+	}
+
+	std::vector<Brick> bricks(num_bricks);
+	for (size_t z = 0; z < grid.dims[2]; ++z) {
+		for (size_t y = 0; y < grid.dims[1]; ++y) {
+			for (size_t x = 0; x < grid.dims[0]; ++x) {
+				const size_t b = grid.index(x, y, z);
+				Brick &brick = bricks[b];
+				const size_t coords[3] = {x, y, z};
+				for (size_t c = 0; c < 3; ++c) {
+					brick.coords[c] = coords[c];
+					brick.bounds.lower[c] = bounds.lower[c]
+						+ size[c] * (static_cast<float>(coords[c]) / grid.dims[c]);
+					brick.bounds.upper[c] = coords[c] + 1 == grid.dims[c] ? bounds.upper[c]
+						: bounds.lower[c] + size[c] * (static_cast<float>(coords[c] + 1) / grid.dims[c]);
+				}
+				brick.ghost_bounds = box3f(brick.bounds.lower - vec3f(width),
+						brick.bounds.upper + vec3f(width));
+				// After the scatter the owned offsets of the last range end at the owned count
+				brick.owned = owned_offsets[(ranges - 1) * num_bricks + b];
+				brick.ghosts = indices[b]->size() - brick.owned;
+				brick.model = view_rows(model, indices[b]);
+			}
+		}
+	}
+	return bricks;
+}
+
+// Write the elements of the data as its type, or as floats if it can't be decoded as its
+// type, and return the type written
+static const std::type_info& write_values(std::ofstream &out, const Data &data) {
+	const bool typed = data.can_get_values() && type_size(data.type()) != 0;
+	const size_t element_size = typed ? type_size(data.type()) : sizeof(float);
+	// The block is held as uint64 so it's aligned for any of the types
+	std::vector<uint64_t> block((std::min(data.size(), WRITE_BLOCK) * element_size + 7) / 8);
+	for (size_t i = 0; i < data.size(); i += WRITE_BLOCK) {
+		const size_t end = std::min(i + WRITE_BLOCK, data.size());
+		if (typed) {
+			data.get_values(i, end, block.data());
+		} else {
+			data.get_floats(i, end, reinterpret_cast<float*>(block.data()));
+		}
+		out.write(reinterpret_cast<const char*>(block.data()), (end - i) * element_size);
+	}
+	return typed ? data.type() : typeid(float);
+}
+
+void pl::export_bricks(const FileName &file_name, const std::vector<Brick> &bricks) {
+	size_t dims[3] = {0, 0, 0};
+	for (const auto &b : bricks) {
+		for (size_t c = 0; c < 3; ++c) {
+			dims[c] = std::max(dims[c], b.coords[c] + 1);
+		}
+	}
+	auto vec = [](const vec3f &v) {
+		return json::array({v.x, v.y, v.z});
+	};
+	json index;
+	index["dims"] = {dims[0], dims[1], dims[2]};
+	index["bricks"] = json::array();
+	for (size_t i = 0; i < bricks.size(); ++i) {
+		const Brick &b = bricks[i];
+		// Write the attributes in a fixed order, the model is unordered
+		std::vector<std::string> names;
+		for (const auto &a : b.model) {
+			names.push_back(a.first);
+		}
+		std::sort(names.begin(), names.end());
+		json attributes = json::array();
+		for (const auto &name : names) {
+			const std::shared_ptr<Data> &data = b.model.at(name);
+			const std::string file = file_name.name() + "_brick" + std::to_string(i) + "_"
+				+ name + ".raw";
+			const FileName path = file_name.path().join(FileName(file));
+			std::ofstream out(path.c_str(), std::ios::binary);
+			if (!out) {
+				throw std::runtime_error("export_bricks: could not open " + path.file_name);
+			}
+			const std::type_info &type = write_values(out, *data);
+			if (!out) {
+				throw std::runtime_error("export_bricks: failed to write " + path.file_name);
+			}
+			attributes.push_back({
+				{"name", name},
+				{"file", file},
+				{"type", type_name(type)},
+				{"components", data->components},
+				{"layout", data->layout == Layout::SOA ? "soa" : "aos"},
+				{"count", data->count()}
+			});
+		}
+		index["bricks"].push_back({
+			{"coords", {b.coords[0], b.coords[1], b.coords[2]}},
+			{"lower", vec(b.bounds.lower)},
+			{"upper", vec(b.bounds.upper)},
+			{"ghost_lower", vec(b.ghost_bounds.lower)},
+			{"ghost_upper", vec(b.ghost_bounds.upper)},
+			{"particles", b.owned},
+			{"ghosts", b.ghosts},
+			{"attributes", attributes}
+		});
+	}
+	std::ofstream out(file_name.c_str());
+	out << index.dump(4) << "\n";
+	if (!out) {
+		throw std::runtime_error("export_bricks: failed to write " + file_name.file_name);
+	}
+}
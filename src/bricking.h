@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+#include "transform.h"
+
+namespace pl {
+
+struct BrickOptions {
+	// The number of bricks along x, y and z
+	size_t dims[3] = {1, 1, 1};
+	// Particles within this distance outside a brick are also copied into it as ghosts,
+	// e.g. the largest radius so spheres crossing the brick boundaries aren't clipped
+	float ghost_width = 0.f;
+	// The region to split, if empty the bounds of the positions are used. Particles
+	// outside the region are put in the nearest brick
+	box3f bounds;
+};
+
+struct Brick {
+	// The index of the brick along x, y and z
+	size_t coords[3] = {0, 0, 0};
+	// The region owned by the brick, and that region grown by the ghost width
+	box3f bounds;
+	box3f ghost_bounds;
+	// The particles owned by the brick come first in the model, followed by its ghosts
+	size_t owned = 0;
+	size_t ghosts = 0;
+	// Views of the particles of the model being split, in the order they're in the
+	// model. Attributes without a value per particle are shared
+	ParticleModel model;
+};
+
+// Split the model into a uniform grid of bricks, each particle is owned by the brick
+// containing it and is a ghost in the other bricks within the ghost width of it. The
+// particles are binned in a parallel counting sort over the positions. The bricks
+// are returned with x varying fastest, then y and z
+std::vector<Brick> brick_particles(const ParticleModel &model, const BrickOptions &options);
+
+// Write each brick's attributes to <name>_brick<i>_<attribute>.raw next to the file,
+// and the grid, the brick bounds and the files of each brick to the file as JSON.
+// Attributes are written as their type, or as floats if they can only be decoded to
+// floats, and the JSON records the type each file was written as
+void export_bricks(const FileName &file_name, const std::vector<Brick> &bricks);
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "types.h"
+
+namespace pl {
+
+// An array of T in a buffer which isn't allocated by the array, e.g. a mapped file
+// or a buffer handed over by a renderer. The owner keeps the buffer alive for
+// as long as some array or released buffer refers to it
+template<typename T>
+struct ExternalDataT : Data {
+	std::shared_ptr<void> owner;
+	T *array;
+	size_t elements;
+
+	ExternalDataT(T *array, const size_t elements, const std::shared_ptr<void> &owner)
+		: owner(owner), array(array), elements(elements)
+	{}
+	const std::type_info& type() const override {
+		return typeid(T);
+	}
+	void write(std::ofstream &os) const override {
+		std::cout << "Writing " << elements << " " << typeid(T).name()
+			<< ", file is " << sizeof(T) * elements << " bytes\n";
+		os.write(reinterpret_cast<const char*>(array), sizeof(T) * elements);
+	}
+	float get_float(const size_t i) const override {
+		return static_cast<float>(array[i]);
+	}
+	size_t size() const override {
+		return elements;
+	}
+	void get_floats(const size_t begin, const size_t end, float *out) const override {
+		convert_array(static_cast<const T*>(array) + begin, end - begin, out);
+	}
+	void get_doubles(const size_t begin, const size_t end, double *out) const override {
+		convert_array(static_cast<const T*>(array) + begin, end - begin, out);
+	}
+	void* raw_data() override {
+		return array;
+	}
+	const void* raw_data() const override {
+		return array;
+	}
+	size_t bytes() const override {
+		return elements * sizeof(T);
+	}
+};
+
+// A buffer taken from an array. The elements stay valid as long as the owner is
+// held, and the buffer is freed when the last reference to the owner is dropped
+template<typename T>
+struct ReleasedBuffer {
+	T *data = nullptr;
+	size_t size = 0;
+	std::shared_ptr<void> owner;
+};
+
+// Check if release_buffer<T> can take the buffer of the data
+template<typename T>
+bool can_release_buffer(const Data &data) {
+	return dynamic_cast<const DataT<T>*>(&data) || dynamic_cast<const ExternalDataT<T>*>(&data);
+}
+
+// Take the buffer out of a DataT<T> or ExternalDataT<T> without copying it, the data
+// is left empty. Throws if the data is some other kind of array, see can_release_buffer
+template<typename T>
+ReleasedBuffer<T> release_buffer(Data &data) {
+	ReleasedBuffer<T> buffer;
+	if (auto *d = dynamic_cast<DataT<T>*>(&data)) {
+		// Swap the elements into a vector on the heap which the owner deletes,
+		// so the vector frees them through its allocator as usual
+		using Vector = std::vector<T, ResourceAllocator<T>>;
+		auto vec = std::make_shared<Vector>(d->data.get_allocator());
+		vec->swap(d->data);
+		buffer.data = vec->data();
+		buffer.size = vec->size();
+		buffer.owner = vec;
+	} else if (auto *e = dynamic_cast<ExternalDataT<T>*>(&data)) {
+		buffer.data = e->array;
+		buffer.size = e->elements;
+		buffer.owner = std::move(e->owner);
+		e->array = nullptr;
+		e->elements = 0;
+	} else {
+		throw std::runtime_error(std::string("release_buffer: data does not own a buffer of ")
+				+ typeid(T).name());
+	}
+	data.invalidate_stats();
+	return buffer;
+}
+
+namespace detail {
+
+// Keeps a parameter out of template argument deduction, so e.g. lambdas
+// can be passed for a std::function<void(T*)>
+template<typename T>
+struct NonDeduced {
+	using type = T;
+};
+
+}
+
+// Make an array of the n elements in the buffer without copying them, keeping the owner alive
+template<typename T>
+std::shared_ptr<ExternalDataT<T>> adopt_buffer(T *buffer, const size_t n,
+		const std::shared_ptr<void> &owner)
+{
+	return std::make_shared<ExternalDataT<T>>(buffer, n, owner);
+}
+// Make an array of the n elements in the buffer without copying them, deleter is
+// called with the buffer once the array and any buffers released from it are dropped
+template<typename T>
+std::shared_ptr<ExternalDataT<T>> adopt_buffer(T *buffer, const size_t n,
+		const typename detail::NonDeduced<std::function<void(T*)>>::type &deleter)
+{
+	return adopt_buffer(buffer, n, std::shared_ptr<void>(buffer, [deleter](void *p) {
+		deleter(static_cast<T*>(p));
+	}));
+}
+template<typename T>
+std::shared_ptr<ExternalDataT<T>> adopt_buffer(ReleasedBuffer<T> buffer) {
+	return adopt_buffer(buffer.data, buffer.size, buffer.owner);
+}
+
+}
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include "parallel.h"
+#include "view.h"
+#include "compress.h"
+
+using namespace pl;
+
+// Codes are limited in length so they can be decoded with a single table lookup
+const int MAX_CODE_LENGTH = 12;
+const size_t DECODE_TABLE_SIZE = size_t(1) << MAX_CODE_LENGTH;
+
+enum PlaneMode : uint8_t {
+	PLANE_CONSTANT,
+	PLANE_HUFFMAN,
+	PLANE_RAW
+};
+
+struct BitWriter {
+	std::vector<uint8_t> &out;
+	uint64_t bits = 0;
+	int count = 0;
+
+	BitWriter(std::vector<uint8_t> &out) : out(out) {}
+	void write(const uint32_t code, const int length) {
+		bits |= uint64_t(code) << count;
+		count += length;
+		while (count >= 8) {
+			out.push_back(static_cast<uint8_t>(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+	void flush() {
+		if (count > 0) {
+			out.push_back(static_cast<uint8_t>(bits));
+		}
+		bits = 0;
+		count = 0;
+	}
+};
+
+struct BitReader {
+	const uint8_t *next;
+	const uint8_t *end;
+	uint64_t bits = 0;
+	int count = 0;
+
+	BitReader(const uint8_t *begin, const uint8_t *end) : next(begin), end(end) {}
+	// Make sure at least 56 bits are buffered, reading past the end gives zeros
+	void refill() {
+		while (count <= 56) {
+			const uint64_t b = next < end ? *next++ : 0;
+			bits |= b << count;
+			count += 8;
+		}
+	}
+	uint32_t peek(const int length) const {
+		return static_cast<uint32_t>(bits & ((uint64_t(1) << length) - 1));
+	}
+	void consume(const int length) {
+		bits >>= length;
+		count -= length;
+	}
+};
+
+// Compute Huffman code lengths for the byte counts. If the longest code is longer
+// than MAX_CODE_LENGTH the counts are flattened and the code rebuilt
+static void huffman_code_lengths(const uint32_t *counts, uint8_t *lengths) {
+	std::vector<uint64_t> weights(counts, counts + 256);
+	while (true) {
+		std::fill(lengths, lengths + 256, 0);
+		// Nodes 0-255 are the leaves, internal nodes are appended after them
+		std::vector<int> parent(256, -1);
+		using Entry = std::pair<uint64_t, int>;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+		for (int i = 0; i < 256; ++i) {
+			if (weights[i] > 0) {
+				queue.push(Entry(weights[i], i));
+			}
+		}
+		if (queue.size() == 1) {
+			lengths[queue.top().second] = 1;
+			return;
+		}
+		while (queue.size() > 1) {
+			const Entry a = queue.top();
+			queue.pop();
+			const Entry b = queue.top();
+			queue.pop();
+			const int node = static_cast<int>(parent.size());
+			parent.push_back(-1);
+			parent[a.second] = node;
+			parent[b.second] = node;
+			queue.push(Entry(a.first + b.first, node));
+		}
+		int max_length = 0;
+		for (int i = 0; i < 256; ++i) {
+			if (weights[i] == 0) {
+				continue;
+			}
+			int length = 0;
+			for (int n = i; parent[n] != -1; n = parent[n]) {
+				++length;
+			}
+			lengths[i] = static_cast<uint8_t>(length);
+			max_length = std::max(max_length, length);
+		}
+		if (max_length <= MAX_CODE_LENGTH) {
+			return;
+		}
+		for (auto &w : weights) {
+			if (w > 0) {
+				w = (w + 1) / 2;
+			}
+		}
+	}
+}
+
+// Assign canonical codes for the lengths, stored bit reversed for LSB first output
+static void canonical_codes(const uint8_t *lengths, uint16_t *codes) {
+	int length_count[MAX_CODE_LENGTH + 1] = {0};
+	for (int i = 0; i < 256; ++i) {
+		++length_count[lengths[i]];
+	}
+	length_count[0] = 0;
+	int next_code[MAX_CODE_LENGTH + 1] = {0};
+	int code = 0;
+	for (int l = 1; l <= MAX_CODE_LENGTH; ++l) {
+		code = (code + length_count[l - 1]) << 1;
+		next_code[l] = code;
+	}
+	for (int i = 0; i < 256; ++i) {
+		const int l = lengths[i];
+		if (l == 0) {
+			continue;
+		}
+		const int c = next_code[l]++;
+		int reversed = 0;
+		for (int b = 0; b < l; ++b) {
+			reversed |= ((c >> b) & 1) << (l - 1 - b);
+		}
+		codes[i] = static_cast<uint16_t>(reversed);
+	}
+}
+
+static void append_u32(std::vector<uint8_t> &out, const uint32_t x) {
+	const uint8_t *b = reinterpret_cast<const uint8_t*>(&x);
+	out.insert(out.end(), b, b + sizeof(uint32_t));
+}
+static uint32_t read_u32(const uint8_t *in) {
+	uint32_t x;
+	std::memcpy(&x, in, sizeof(uint32_t));
+	return x;
+}
+
+// Encode a delta coded byte plane, picking the smallest of the plane modes
+static void encode_plane(const uint8_t *plane, const size_t n, std::vector<uint8_t> &out) {
+	uint32_t counts[256] = {0};
+	for (size_t i = 0; i < n; ++i) {
+		++counts[plane[i]];
+	}
+	if (counts[plane[0]] == n) {
+		out.push_back(PLANE_CONSTANT);
+		out.push_back(plane[0]);
+		return;
+	}
+
+	uint8_t lengths[256];
+	uint16_t codes[256] = {0};
+	huffman_code_lengths(counts, lengths);
+	canonical_codes(lengths, codes);
+	size_t encoded_bits = 0;
+	for (int i = 0; i < 256; ++i) {
+		encoded_bits += size_t(counts[i]) * lengths[i];
+	}
+	const size_t header_bytes = 128 + sizeof(uint32_t);
+	if (header_bytes + (encoded_bits + 7) / 8 >= n) {
+		out.push_back(PLANE_RAW);
+		out.insert(out.end(), plane, plane + n);
+		return;
+	}
+
+	out.push_back(PLANE_HUFFMAN);
+	for (int i = 0; i < 256; i += 2) {
+		out.push_back(static_cast<uint8_t>(lengths[i] | (lengths[i + 1] << 4)));
+	}
+	append_u32(out, static_cast<uint32_t>((encoded_bits + 7) / 8));
+	BitWriter writer(out);
+	for (size_t i = 0; i < n; ++i) {
+		writer.write(codes[plane[i]], lengths[plane[i]]);
+	}
+	writer.flush();
+}
+
+// Decode a byte plane of n bytes to plane, returns the pointer past the end of the plane
+static const uint8_t* decode_plane(const uint8_t *in, const size_t n, uint8_t *plane) {
+	const uint8_t mode = *in++;
+	if (mode == PLANE_CONSTANT) {
+		std::memset(plane, *in, n);
+		return in + 1;
+	}
+	if (mode == PLANE_RAW) {
+		std::memcpy(plane, in, n);
+		return in + n;
+	}
+
+	uint8_t lengths[256];
+	for (int i = 0; i < 256; i += 2) {
+		lengths[i] = in[i / 2] & 0xf;
+		lengths[i + 1] = in[i / 2] >> 4;
+	}
+	in += 128;
+	uint16_t codes[256] = {0};
+	canonical_codes(lengths, codes);
+	// Each entry holds the symbol in the low byte and code length in the high byte
+	uint16_t table[DECODE_TABLE_SIZE];
+	for (int i = 0; i < 256; ++i) {
+		const int l = lengths[i];
+		if (l == 0) {
+			continue;
+		}
+		for (size_t k = codes[i]; k < DECODE_TABLE_SIZE; k += size_t(1) << l) {
+			table[k] = static_cast<uint16_t>(i | (l << 8));
+		}
+	}
+	const uint32_t stream_bytes = read_u32(in);
+	in += sizeof(uint32_t);
+	BitReader reader(in, in + stream_bytes);
+	for (size_t i = 0; i < n; ++i) {
+		if (reader.count < MAX_CODE_LENGTH) {
+			reader.refill();
+		}
+		const uint16_t entry = table[reader.peek(MAX_CODE_LENGTH)];
+		plane[i] = static_cast<uint8_t>(entry);
+		reader.consume(entry >> 8);
+	}
+	return in + stream_bytes;
+}
+
+// Compress n elements of element_size bytes to out
+static void compress_chunk(const uint8_t *elements, const size_t n, const size_t element_size,
+		std::vector<uint8_t> &out)
+{
+	std::vector<uint8_t> plane(n);
+	for (size_t b = 0; b < element_size; ++b) {
+		uint8_t prev = 0;
+		for (size_t i = 0; i < n; ++i) {
+			const uint8_t x = elements[i * element_size + b];
+			plane[i] = static_cast<uint8_t>(x - prev);
+			prev = x;
+		}
+		encode_plane(plane.data(), n, out);
+	}
+}
+
+static void decompress_chunk_bytes(const uint8_t *in, const size_t n, const size_t element_size,
+		uint8_t *elements)
+{
+	std::vector<uint8_t> plane(n);
+	for (size_t b = 0; b < element_size; ++b) {
+		in = decode_plane(in, n, plane.data());
+		uint8_t prev = 0;
+		for (size_t i = 0; i < n; ++i) {
+			prev = static_cast<uint8_t>(prev + plane[i]);
+			elements[i * element_size + b] = prev;
+		}
+	}
+}
+
+static std::atomic<uint64_t> next_compressed_id(0);
+
+const size_t CompressedData::CHUNK_SIZE;
+
+CompressedData::CompressedData() : element_type(nullptr), element_size(0), elements(0),
+	convert_floats(nullptr), convert_doubles(nullptr), make_array(nullptr),
+	id(next_compressed_id++)
+{}
+const uint8_t* CompressedData::cached_chunk(const size_t chunk) const {
+	struct ChunkCache {
+		uint64_t id = std::numeric_limits<uint64_t>::max();
+		size_t chunk = 0;
+		std::vector<uint64_t> elements;
+	};
+	thread_local ChunkCache cache;
+	if (cache.id != id || cache.chunk != chunk) {
+		cache.elements.resize(CHUNK_SIZE * element_size / sizeof(uint64_t) + 1);
+		decompress_chunk(chunk, reinterpret_cast<uint8_t*>(cache.elements.data()));
+		cache.id = id;
+		cache.chunk = chunk;
+	}
+	return reinterpret_cast<const uint8_t*>(cache.elements.data());
+}
+const std::type_info& CompressedData::type() const {
+	return *element_type;
+}
+void CompressedData::write(std::ofstream &os) const {
+	std::cout << "Writing " << elements << " " << element_type->name()
+		<< ", file is " << element_size * elements << " bytes\n";
+	std::vector<uint64_t> chunk(CHUNK_SIZE * element_size / sizeof(uint64_t) + 1);
+	for (size_t i = 0; i < num_chunks(); ++i) {
+		const size_t n = std::min(CHUNK_SIZE, elements - i * CHUNK_SIZE);
+		decompress_chunk(i, reinterpret_cast<uint8_t*>(chunk.data()));
+		os.write(reinterpret_cast<const char*>(chunk.data()), n * element_size);
+	}
+}
+float CompressedData::get_float(const size_t i) const {
+	float x;
+	convert_floats(cached_chunk(i / CHUNK_SIZE) + (i % CHUNK_SIZE) * element_size, 1, &x);
+	return x;
+}
+size_t CompressedData::size() const {
+	return elements;
+}
+void CompressedData::get_floats(const size_t begin, const size_t end, float *out) const {
+	for (size_t i = begin; i < end;) {
+		const size_t chunk = i / CHUNK_SIZE;
+		const size_t chunk_end = std::min(end, (chunk + 1) * CHUNK_SIZE);
+		const uint8_t *elements = cached_chunk(chunk);
+		convert_floats(elements + (i % CHUNK_SIZE) * element_size, chunk_end - i, out + (i - begin));
+		i = chunk_end;
+	}
+}
+void CompressedData::get_doubles(const size_t begin, const size_t end, double *out) const {
+	for (size_t i = begin; i < end;) {
+		const size_t chunk = i / CHUNK_SIZE;
+		const size_t chunk_end = std::min(end, (chunk + 1) * CHUNK_SIZE);
+		const uint8_t *elements = cached_chunk(chunk);
+		convert_doubles(elements + (i % CHUNK_SIZE) * element_size, chunk_end - i, out + (i - begin));
+		i = chunk_end;
+	}
+}
+void CompressedData::get_values(const size_t begin, const size_t end, void *out) const {
+	uint8_t *o = static_cast<uint8_t*>(out);
+	for (size_t i = begin; i < end;) {
+		const size_t chunk = i / CHUNK_SIZE;
+		const size_t chunk_end = std::min(end, (chunk + 1) * CHUNK_SIZE);
+		const uint8_t *elements = cached_chunk(chunk) + (i % CHUNK_SIZE) * element_size;
+		std::copy(elements, elements + (chunk_end - i) * element_size, o + (i - begin) * element_size);
+		i = chunk_end;
+	}
+}
+bool CompressedData::can_get_values() const {
+	return true;
+}
+size_t CompressedData::bytes() const {
+	return buffer.capacity() + chunk_offsets.capacity() * sizeof(size_t);
+}
+size_t CompressedData::num_chunks() const {
+	return chunk_offsets.size() - 1;
+}
+void CompressedData::decompress_chunk(const size_t i, uint8_t *out) const {
+	const size_t n = std::min(CHUNK_SIZE, elements - i * CHUNK_SIZE);
+	decompress_chunk_bytes(buffer.data() + chunk_offsets[i], n, element_size, out);
+}
+size_t CompressedData::compressed_bytes() const {
+	return buffer.size();
+}
+
+template<typename T>
+std::shared_ptr<CompressedData> pl::compress_array(const ArrayView<const T> &array,
+		const Data &source)
+{
+	std::shared_ptr<CompressedData> compressed(new CompressedData());
+	compressed->components = source.components;
+	compressed->layout = source.layout;
+	compressed->element_type = &typeid(T);
+	compressed->element_size = sizeof(T);
+	compressed->elements = array.size();
+	compressed->convert_floats = [](const uint8_t *in, const size_t n, float *out) {
+		convert_array(reinterpret_cast<const T*>(in), n, out);
+	};
+	compressed->convert_doubles = [](const uint8_t *in, const size_t n, double *out) {
+		convert_array(reinterpret_cast<const T*>(in), n, out);
+	};
+	compressed->make_array = [](const size_t n) -> std::shared_ptr<Data> {
+		auto data = std::make_shared<DataT<T>>();
+		data->data.resize(n);
+		return data;
+	};
+
+	const size_t n_chunks = (array.size() + CompressedData::CHUNK_SIZE - 1) / CompressedData::CHUNK_SIZE;
+	std::vector<std::vector<uint8_t>> chunks(n_chunks);
+	parallel_for(0, n_chunks, 1, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const size_t first = i * CompressedData::CHUNK_SIZE;
+			const size_t n = std::min(CompressedData::CHUNK_SIZE, array.size() - first);
+			compress_chunk(reinterpret_cast<const uint8_t*>(array.data() + first), n,
+					sizeof(T), chunks[i]);
+		}
+	});
+
+	compressed->chunk_offsets.resize(n_chunks + 1);
+	compressed->chunk_offsets[0] = 0;
+	for (size_t i = 0; i < n_chunks; ++i) {
+		compressed->chunk_offsets[i + 1] = compressed->chunk_offsets[i] + chunks[i].size();
+	}
+	compressed->buffer.resize(compressed->chunk_offsets.back());
+	parallel_for(0, n_chunks, 1, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			std::copy(chunks[i].begin(), chunks[i].end(),
+					compressed->buffer.begin() + compressed->chunk_offsets[i]);
+		}
+	});
+	return compressed;
+}
+
+std::shared_ptr<CompressedData> pl::compress(const Data &data) {
+	if (data.stride() != 1) {
+		return compress(*materialize(data));
+	}
+	std::shared_ptr<CompressedData> compressed;
+	visit(data, [&](const auto &view) {
+		using T = typename std::decay<decltype(view)>::type::value_type;
+		compressed = compress_array<typename std::remove_const<T>::type>(
+				ArrayView<const T>(view.data(), view.size()), data);
+	});
+	return compressed;
+}
+
+std::shared_ptr<Data> pl::decompress(const CompressedData &data) {
+	auto array = data.make_array(data.size());
+	array->components = data.components;
+	array->layout = data.layout;
+	uint8_t *out = static_cast<uint8_t*>(array->raw_data());
+	const size_t chunk_bytes = CompressedData::CHUNK_SIZE * data.element_size;
+	parallel_for(0, data.num_chunks(), 1, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			data.decompress_chunk(i, out + i * chunk_bytes);
+		}
+	});
+	return array;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include "types.h"
+
+namespace pl {
+
+// A lossless compressed array. The array is split into fixed size chunks which
+// are compressed independently by shuffling the bytes of the elements into
+// planes, delta coding each plane and Huffman coding it. Accessing the data only
+// decompresses the chunks touched, and the last chunk accessed by each thread is
+// cached for get_float. Smooth and spatially sorted data compresses best.
+class CompressedData : public Data {
+	const std::type_info *element_type;
+	size_t element_size;
+	size_t elements;
+	// The chunks are stored back to back in buffer, chunk i is stored in
+	// [chunk_offsets[i], chunk_offsets[i + 1])
+	std::vector<uint8_t, ResourceAllocator<uint8_t>> buffer;
+	std::vector<size_t> chunk_offsets;
+	void (*convert_floats)(const uint8_t *in, const size_t n, float *out);
+	void (*convert_doubles)(const uint8_t *in, const size_t n, double *out);
+	std::shared_ptr<Data> (*make_array)(const size_t n);
+	// Unique id used to key the per-thread decompressed chunk cache
+	uint64_t id;
+
+	template<typename T>
+	friend std::shared_ptr<CompressedData> compress_array(const ArrayView<const T> &array,
+			const Data &source);
+	friend std::shared_ptr<Data> decompress(const CompressedData &data);
+
+	CompressedData();
+	// Get the decompressed chunk from the calling thread's cache
+	const uint8_t* cached_chunk(const size_t chunk) const;
+
+public:
+	// Number of elements in each compressed chunk
+	static const size_t CHUNK_SIZE = 16 * 1024;
+
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	void get_values(const size_t begin, const size_t end, void *out) const override;
+	bool can_get_values() const override;
+	size_t bytes() const override;
+
+	size_t num_chunks() const;
+	// Decompress chunk i into out, which must have room for CHUNK_SIZE elements
+	void decompress_chunk(const size_t i, uint8_t *out) const;
+	// Get the size of the compressed data in bytes
+	size_t compressed_bytes() const;
+};
+
+// Compress the data. Data which isn't a contiguous array of a scalar type is
+// compressed as its decoded values, see visit
+std::shared_ptr<CompressedData> compress(const Data &data);
+
+// Decompress the array in parallel to a DataT of its element type
+std::shared_ptr<Data> decompress(const CompressedData &data);
+
+}
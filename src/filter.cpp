@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include "layout.h"
+#include "parallel.h"
+#include "view.h"
+#include "filter.h"
+
+using namespace pl;
+
+// Conditions are evaluated on blocks of values gathered as doubles, so the
+// comparison loops can be vectorized whatever the type of the attribute
+const size_t FILTER_BLOCK = 4096;
+const size_t FILTER_GRAIN = 16 * FILTER_BLOCK;
+// Sets up to this size are tested by comparing against each value, larger
+// ones are searched
+const size_t SMALL_SET_SIZE = 16;
+// Particles are compacted in chunks, the output offset of each chunk is found
+// by counting the particles it keeps
+const size_t COMPACT_CHUNK = 1 << 16;
+
+Predicate Predicate::range(const std::string &attribute, const double min, const double max,
+		const size_t component)
+{
+	Condition c;
+	c.attribute = attribute;
+	c.component = component;
+	c.min = min;
+	c.max = max;
+	Predicate p;
+	p.conditions.push_back(c);
+	return p;
+}
+Predicate Predicate::greater(const std::string &attribute, const double t, const size_t component) {
+	return range(attribute, std::nextafter(t, std::numeric_limits<double>::infinity()),
+			std::numeric_limits<double>::infinity(), component);
+}
+Predicate Predicate::less(const std::string &attribute, const double t, const size_t component) {
+	return range(attribute, -std::numeric_limits<double>::infinity(),
+			std::nextafter(t, -std::numeric_limits<double>::infinity()), component);
+}
+Predicate Predicate::in(const std::string &attribute, const std::vector<double> &values,
+		const size_t component)
+{
+	Predicate p = range(attribute, 0.0, 0.0, component);
+	auto &set = p.conditions.back().values;
+	set = values;
+	std::sort(set.begin(), set.end());
+	set.erase(std::unique(set.begin(), set.end()), set.end());
+	return p;
+}
+Predicate Predicate::operator&&(const Predicate &b) const {
+	Predicate p = *this;
+	p.conditions.insert(p.conditions.end(), b.conditions.begin(), b.conditions.end());
+	return p;
+}
+const std::vector<Condition>& Predicate::get_conditions() const {
+	return conditions;
+}
+
+// Clear the mask of particles which don't pass the condition
+static void apply_condition(const Data &data, const Condition &cond, uint8_t *mask) {
+	const size_t n = data.count();
+	const ComponentStrides strides(data);
+	const std::vector<double> &set = cond.values;
+	visit(data, [&](const auto &view) {
+		parallel_for(0, n, FILTER_GRAIN, [&](const size_t begin, const size_t end) {
+			const auto *in = view.data() + cond.component * strides.component_stride;
+			std::vector<double> x(FILTER_BLOCK);
+			std::vector<uint8_t> pass(FILTER_BLOCK);
+			for (size_t b = begin; b < end; b += FILTER_BLOCK) {
+				const size_t count = std::min(b + FILTER_BLOCK, end) - b;
+				for (size_t i = 0; i < count; ++i) {
+					x[i] = static_cast<double>(in[(b + i) * strides.particle_stride]);
+				}
+				if (set.empty()) {
+					for (size_t i = 0; i < count; ++i) {
+						pass[i] = (x[i] >= cond.min) & (x[i] <= cond.max);
+					}
+				} else if (set.size() <= SMALL_SET_SIZE) {
+					std::fill(pass.begin(), pass.begin() + count, 0);
+					for (const auto &v : set) {
+						for (size_t i = 0; i < count; ++i) {
+							pass[i] |= x[i] == v;
+						}
+					}
+				} else {
+					for (size_t i = 0; i < count; ++i) {
+						pass[i] = std::binary_search(set.begin(), set.end(), x[i]);
+					}
+				}
+				for (size_t i = 0; i < count; ++i) {
+					mask[b + i] &= pass[i];
+				}
+			}
+		});
+	});
+}
+
+std::vector<uint8_t> pl::filter_mask(const ParticleModel &model, const Predicate &predicate) {
+	const size_t n = particle_count(model);
+	std::vector<uint8_t> mask(n, 1);
+	for (const auto &cond : predicate.get_conditions()) {
+		auto fnd = model.find(cond.attribute);
+		if (fnd == model.end()) {
+			throw std::runtime_error("filter: no attribute " + cond.attribute + " in the model");
+		}
+		const Data &data = *fnd->second;
+		if (data.count() != n) {
+			throw std::runtime_error("filter: attribute " + cond.attribute
+					+ " doesn't have a value per particle");
+		}
+		if (cond.component >= data.components) {
+			throw std::runtime_error("filter: component is out of range for attribute "
+					+ cond.attribute);
+		}
+		apply_condition(data, cond, mask.data());
+	}
+	return mask;
+}
+
+// Get the offset in the output of the kept particles of each chunk of the mask,
+// followed by the total number kept
+static std::vector<size_t> chunk_offsets(const std::vector<uint8_t> &mask) {
+	const size_t n = mask.size();
+	const size_t chunks = (n + COMPACT_CHUNK - 1) / COMPACT_CHUNK;
+	std::vector<size_t> offsets(chunks + 1, 0);
+	parallel_for(0, chunks, 1, [&](const size_t begin, const size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const size_t e = std::min((c + 1) * COMPACT_CHUNK, n);
+			for (size_t i = c * COMPACT_CHUNK; i < e; ++i) {
+				offsets[c + 1] += mask[i];
+			}
+		}
+	});
+	for (size_t c = 0; c < chunks; ++c) {
+		offsets[c + 1] += offsets[c];
+	}
+	return offsets;
+}
+
+size_t pl::mask_count(const std::vector<uint8_t> &mask) {
+	return chunk_offsets(mask).back();
+}
+
+// The output array of an attribute being compacted, and a function to copy the
+// kept particles in [begin, end) to the output starting at particle out_begin
+struct Column {
+	std::shared_ptr<Data> out;
+	// Keeps the decoded copy of data which isn't stored as a scalar type alive
+	std::shared_ptr<Data> decoded;
+	std::function<void(const size_t, const size_t, const size_t)> compact;
+};
+
+template<typename T>
+static bool make_column(const Data &in, const uint8_t *mask, const size_t kept, Column &col) {
+	if (!in.holds<T>()) {
+		return false;
+	}
+	auto out = std::make_shared<DataT<T>>();
+	out->components = in.components;
+	out->layout = in.layout;
+	out->data.resize(kept * in.components);
+
+	const T *src = static_cast<const T*>(in.raw_data());
+	T *dst = out->data.data();
+	const ComponentStrides src_strides(in);
+	const ComponentStrides dst_strides(*out);
+	const size_t components = in.components;
+	col.out = out;
+	col.compact = [=](const size_t begin, const size_t end, const size_t out_begin) {
+		for (size_t c = 0; c < components; ++c) {
+			const T *s = src + c * src_strides.component_stride;
+			T *d = dst + c * dst_strides.component_stride;
+			size_t o = out_begin;
+			for (size_t i = begin; i < end; ++i) {
+				if (mask[i]) {
+					d[o * dst_strides.particle_stride] = s[i * src_strides.particle_stride];
+					++o;
+				}
+			}
+		}
+	};
+	return true;
+}
+
+static Column make_column(const Data &in, const uint8_t *mask, const size_t kept) {
+	Column col;
+	if (make_column<float>(in, mask, kept, col) || make_column<double>(in, mask, kept, col)
+			|| make_column<int8_t>(in, mask, kept, col) || make_column<uint8_t>(in, mask, kept, col)
+			|| make_column<int16_t>(in, mask, kept, col) || make_column<uint16_t>(in, mask, kept, col)
+			|| make_column<int32_t>(in, mask, kept, col) || make_column<uint32_t>(in, mask, kept, col)
+			|| make_column<int64_t>(in, mask, kept, col) || make_column<uint64_t>(in, mask, kept, col))
+	{
+		return col;
+	}
+	// Data which isn't stored as a scalar type is decoded to a contiguous array of its type
+	std::shared_ptr<Data> decoded = materialize(in);
+	col = make_column(*decoded, mask, kept);
+	col.decoded = decoded;
+	return col;
+}
+
+ParticleModel pl::compact(const ParticleModel &model, const std::vector<uint8_t> &mask) {
+	const size_t n = particle_count(model);
+	if (mask.size() != n) {
+		throw std::runtime_error("compact: the mask must have one element per particle");
+	}
+	const std::vector<size_t> offsets = chunk_offsets(mask);
+	const size_t chunks = offsets.size() - 1;
+	const size_t kept = offsets.back();
+
+	ParticleModel result;
+	std::vector<Column> columns;
+	for (const auto &a : model) {
+		if (a.second->count() != n) {
+			result[a.first] = a.second;
+			continue;
+		}
+		columns.push_back(make_column(*a.second, mask.data(), kept));
+		result[a.first] = columns.back().out;
+	}
+	// Each chunk is compacted for all the attributes at once, in one pass over the particles
+	parallel_for(0, chunks, 1, [&](const size_t begin, const size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const size_t e = std::min((c + 1) * COMPACT_CHUNK, n);
+			for (const auto &col : columns) {
+				col.compact(c * COMPACT_CHUNK, e, offsets[c]);
+			}
+		}
+	});
+	return result;
+}
+
+ParticleModel pl::filter(const ParticleModel &model, const Predicate &predicate) {
+	return compact(model, filter_mask(model, predicate));
+}
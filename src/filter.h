@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+// A condition on one component of an attribute. A particle passes if the component
+// is in [min, max], or if values isn't empty, if it's equal to one of the values.
+// The components are compared as doubles, so NaNs never pass
+struct Condition {
+	std::string attribute;
+	size_t component = 0;
+	double min = 0.0;
+	double max = 0.0;
+	std::vector<double> values;
+};
+
+// A conjunction of conditions on the attributes of a model, e.g.
+// Predicate::greater("concentration", t) && Predicate::in("atom_type", {1, 6})
+class Predicate {
+	std::vector<Condition> conditions;
+
+public:
+	// A predicate with no conditions, which every particle passes
+	Predicate() = default;
+	// The component is in [min, max]
+	static Predicate range(const std::string &attribute, const double min, const double max,
+			const size_t component = 0);
+	// The component is > t, or < t
+	static Predicate greater(const std::string &attribute, const double t,
+			const size_t component = 0);
+	static Predicate less(const std::string &attribute, const double t,
+			const size_t component = 0);
+	// The component is equal to one of the values
+	static Predicate in(const std::string &attribute, const std::vector<double> &values,
+			const size_t component = 0);
+
+	// Get the predicate passed by particles which pass both predicates
+	Predicate operator&&(const Predicate &b) const;
+	const std::vector<Condition>& get_conditions() const;
+};
+
+// Evaluate the predicate on each particle of the model, returning a mask which is 1 for
+// particles which pass and 0 otherwise. Each condition is evaluated in parallel, in
+// blocks of values compared in loops which can be vectorized
+std::vector<uint8_t> filter_mask(const ParticleModel &model, const Predicate &predicate);
+
+// Get the number of particles kept by the mask
+size_t mask_count(const std::vector<uint8_t> &mask);
+
+// Copy the particles kept by the mask into a new model. The attributes are compacted
+// in a single parallel pass over the particles, keeping their type, components and layout.
+// As with materialize, data which isn't stored as a scalar type is copied as its decoded
+// values. Attributes which don't have a value per particle are shared as-is
+ParticleModel compact(const ParticleModel &model, const std::vector<uint8_t> &mask);
+
+// Copy the particles which pass the predicate into a new model
+ParticleModel filter(const ParticleModel &model, const Predicate &predicate);
+
+}
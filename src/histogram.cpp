@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include "layout.h"
+#include "parallel.h"
+#include "stats.h"
+#include "histogram.h"
+
+using namespace pl;
+
+// Particles are binned in blocks: their values are gathered and mapped to bin
+// indices in loops which can be vectorized, then added to the bins
+const size_t HISTOGRAM_BLOCK = 4096;
+const size_t HISTOGRAM_GRAIN = 16 * HISTOGRAM_BLOCK;
+
+double Histogram::edge(const size_t i) const {
+	const double t = static_cast<double>(i) / bins.size();
+	if (scale == BinScale::LOG) {
+		const double lo = std::log10(min);
+		return std::pow(10.0, lo + t * (std::log10(max) - lo));
+	}
+	return min + t * (max - min);
+}
+double Histogram::total() const {
+	double sum = 0.0;
+	for (const auto &b : bins) {
+		sum += b;
+	}
+	return sum;
+}
+
+// Gather the values being binned for particles [begin, end) of the view, mapped to
+// log10 for log bins with values <= 0 sent to -inf
+template<typename V>
+static void load_values(const V &view, const ComponentStrides &strides, const size_t components,
+		const size_t component, const BinScale scale, const size_t begin, const size_t end,
+		double *values)
+{
+	const size_t n = end - begin;
+	const auto *in = view.data() + begin * strides.particle_stride;
+	if (component == MAGNITUDE) {
+		std::fill(values, values + n, 0.0);
+		for (size_t c = 0; c < components; ++c) {
+			const auto *comp = in + c * strides.component_stride;
+			for (size_t i = 0; i < n; ++i) {
+				const double x = static_cast<double>(comp[i * strides.particle_stride]);
+				values[i] += x * x;
+			}
+		}
+		for (size_t i = 0; i < n; ++i) {
+			values[i] = std::sqrt(values[i]);
+		}
+	} else {
+		const auto *comp = in + component * strides.component_stride;
+		for (size_t i = 0; i < n; ++i) {
+			values[i] = static_cast<double>(comp[i * strides.particle_stride]);
+		}
+	}
+	if (scale == BinScale::LOG) {
+		for (size_t i = 0; i < n; ++i) {
+			values[i] = values[i] > 0.0 ? std::log10(values[i])
+				: -std::numeric_limits<double>::infinity();
+		}
+	}
+}
+
+// Call f(begin, end, load) for each thread's range of particles, in parallel. load(b, e, values)
+// gathers the values being binned for particles [b, e) in the range
+template<typename F>
+static void for_each_range(const Data &data, const size_t component, const BinScale scale,
+		const F &f)
+{
+	const size_t n = data.count();
+	const ComponentStrides strides(data);
+	visit(data, [&](const auto &view) {
+		parallel_for(0, n, HISTOGRAM_GRAIN, [&](const size_t begin, const size_t end) {
+			auto load = [&](const size_t b, const size_t e, double *values) {
+				load_values(view, strides, data.components, component, scale, b, e, values);
+			};
+			f(begin, end, load);
+		});
+	});
+}
+
+// Find the range of the values being binned, in the binning space (i.e. log10 for log bins)
+static void find_range(const Data &data, const size_t component, const BinScale scale,
+		double &lo, double &hi)
+{
+	// The cached range gives linear bins of a component for free
+	if (component != MAGNITUDE && scale == BinScale::LINEAR) {
+		auto r = range(data);
+		lo = r->components[component].min;
+		hi = r->components[component].max;
+		return;
+	}
+	std::mutex mutex;
+	lo = std::numeric_limits<double>::infinity();
+	hi = -std::numeric_limits<double>::infinity();
+	for_each_range(data, component, scale,
+		[&](const size_t begin, const size_t end, const auto &load) {
+			double l = std::numeric_limits<double>::infinity();
+			double h = -std::numeric_limits<double>::infinity();
+			std::vector<double> values(HISTOGRAM_BLOCK);
+			for (size_t b = begin; b < end; b += HISTOGRAM_BLOCK) {
+				const size_t e = std::min(b + HISTOGRAM_BLOCK, end);
+				load(b, e, values.data());
+				for (size_t i = 0; i < e - b; ++i) {
+					// Skips NaNs, and the -inf of non-positive values for log bins
+					if (std::isfinite(values[i])) {
+						l = std::min(l, values[i]);
+						h = std::max(h, values[i]);
+					}
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			lo = std::min(lo, l);
+			hi = std::max(hi, h);
+		});
+	if (lo > hi) {
+		lo = hi = 0.0;
+	}
+}
+
+Histogram pl::histogram(const Data &data, const size_t component, const HistogramOptions &options) {
+	if (options.bins == 0) {
+		throw std::runtime_error("histogram: at least one bin is required");
+	}
+	if (component != MAGNITUDE && component >= data.components) {
+		throw std::runtime_error("histogram: component is out of range");
+	}
+	const size_t n = data.count();
+	const Data *weights = options.weights.get();
+	if (weights && (weights->components != 1 || weights->size() != n)) {
+		throw std::runtime_error("histogram: weights must have one element per particle");
+	}
+
+	Histogram hist;
+	hist.scale = options.scale;
+	double lo = 0.0;
+	double hi = 0.0;
+	if (options.min < options.max) {
+		if (options.scale == BinScale::LOG && options.min <= 0.0) {
+			throw std::runtime_error("histogram: the range of log bins must be positive");
+		}
+		hist.min = options.min;
+		hist.max = options.max;
+		lo = options.scale == BinScale::LOG ? std::log10(options.min) : options.min;
+		hi = options.scale == BinScale::LOG ? std::log10(options.max) : options.max;
+	} else {
+		find_range(data, component, options.scale, lo, hi);
+		if (options.scale == BinScale::LOG) {
+			hist.min = std::pow(10.0, lo);
+			hist.max = std::pow(10.0, hi);
+		} else {
+			hist.min = lo;
+			hist.max = hi;
+		}
+	}
+
+	// Slot 0 is the underflow, the bins are in [1, bins], then the overflow and the NaNs
+	const size_t nbins = options.bins;
+	const size_t slots = nbins + 3;
+	const double inv_width = hi > lo ? nbins / (hi - lo) : 0.0;
+	const double max_t = static_cast<double>(nbins);
+
+	std::mutex mutex;
+	std::vector<std::pair<size_t, std::vector<double>>> partials;
+	for_each_range(data, component, options.scale,
+		[&](const size_t begin, const size_t end, const auto &load) {
+			std::vector<double> local(slots, 0.0);
+			std::vector<double> values(HISTOGRAM_BLOCK);
+			std::vector<double> w(weights ? HISTOGRAM_BLOCK : 0);
+			std::vector<uint32_t> slot(HISTOGRAM_BLOCK);
+			for (size_t b = begin; b < end; b += HISTOGRAM_BLOCK) {
+				const size_t e = std::min(b + HISTOGRAM_BLOCK, end);
+				const size_t count = e - b;
+				load(b, e, values.data());
+				for (size_t i = 0; i < count; ++i) {
+					const double x = values[i];
+					const double bin = std::min((x - lo) * inv_width, max_t - 1.0);
+					slot[i] = x < lo ? 0
+						: x > hi ? static_cast<uint32_t>(nbins + 1)
+						: x == x ? static_cast<uint32_t>(bin) + 1
+						: static_cast<uint32_t>(nbins + 2);
+				}
+				if (weights) {
+					weights->get_doubles(b, e, w.data());
+					for (size_t i = 0; i < count; ++i) {
+						local[slot[i]] += w[i];
+					}
+				} else {
+					for (size_t i = 0; i < count; ++i) {
+						local[slot[i]] += 1.0;
+					}
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			partials.emplace_back(begin, std::move(local));
+		});
+	std::sort(partials.begin(), partials.end(),
+		[](const std::pair<size_t, std::vector<double>> &a,
+			const std::pair<size_t, std::vector<double>> &b) {
+			return a.first < b.first;
+		});
+
+	std::vector<double> total(slots, 0.0);
+	for (const auto &p : partials) {
+		for (size_t i = 0; i < slots; ++i) {
+			total[i] += p.second[i];
+		}
+	}
+	hist.underflow = total[0];
+	hist.bins.assign(total.begin() + 1, total.begin() + 1 + nbins);
+	hist.overflow = total[nbins + 1];
+	return hist;
+}
+
+std::vector<Histogram> pl::histograms(const Data &data, const HistogramOptions &options) {
+	std::vector<Histogram> hists;
+	for (size_t c = 0; c < data.components; ++c) {
+		hists.push_back(histogram(data, c, options));
+	}
+	return hists;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+enum class BinScale {
+	LINEAR,
+	// Bins evenly spaced in log10, values <= 0 fall below the range
+	LOG
+};
+
+// Pass as the component to bin the length of each particle's vector,
+// e.g. the magnitude of the velocities
+const size_t MAGNITUDE = std::numeric_limits<size_t>::max();
+
+struct HistogramOptions {
+	size_t bins = 256;
+	BinScale scale = BinScale::LINEAR;
+	// The range covered by the bins. If min >= max it's taken from the values
+	// being binned, for log bins from the positive values
+	double min = 0.0;
+	double max = 0.0;
+	// Optional weight of each particle, a single component array with one element
+	// per particle. Without weights each particle counts as 1
+	std::shared_ptr<const Data> weights;
+};
+
+struct Histogram {
+	BinScale scale = BinScale::LINEAR;
+	double min = 0.0;
+	double max = 0.0;
+	// The count, or total weight, of the values in each bin. A value equal to
+	// max goes in the last bin
+	std::vector<double> bins;
+	// The count or weight of values outside the range, NaNs are skipped
+	double underflow = 0.0;
+	double overflow = 0.0;
+
+	// Get the lower edge of bin i, or the upper edge of the last bin if i == bins.size()
+	double edge(const size_t i) const;
+	// Get the count or weight of all the values in the bins
+	double total() const;
+};
+
+// Compute the histogram of a component of the data, or of the particle vectors'
+// MAGNITUDE. The particles are binned in parallel into per-thread histograms
+// which are merged in order at the end, so the result is deterministic
+Histogram histogram(const Data &data, const size_t component,
+		const HistogramOptions &options = HistogramOptions());
+
+// Compute a histogram of each component of the data
+std::vector<Histogram> histograms(const Data &data,
+		const HistogramOptions &options = HistogramOptions());
+
+}
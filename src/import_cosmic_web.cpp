@@ -2,6 +2,9 @@
 #include <algorithm>
 #include <limits>
 #include <fstream>
+#include "memory_report.h"
+#include "kernels.h"
+#include "transform.h"
 #include "import_cosmic_web.h"
 
 using namespace pl;
@@ -32,7 +35,9 @@ std::ostream& operator<<(std::ostream &os, const CosmicWebHeader &h) {
 	return os;
 }
 
-void pl::import_cosmic_web(const FileName &file_name, ParticleModel &model) {
+void pl::import_cosmic_web(const FileName &file_name, ParticleModel &model,
+		const Layout layout)
+{
 	std::ifstream fin(file_name.c_str(), std::ios::binary);
 
 	if (!fin.good()) {
@@ -62,30 +67,38 @@ void pl::import_cosmic_web(const FileName &file_name, ParticleModel &model) {
 	const float step = 768.f;
 	const vec3f offset(step * brick_x, step * brick_y, step * brick_z);
 
+	const size_t num_particles = header.np_local;
 	auto positions = std::make_shared<DataT<float>>();
 	auto velocities = std::make_shared<DataT<float>>();
-	positions->data.reserve(header.np_local * 3);
-	velocities->data.reserve(header.np_local * 3);
-
-	std::vector<char> file_data(header.np_local * 2 * sizeof(vec3f), 0);
-	if (!fin.read(file_data.data(), file_data.size())) {
-		throw std::runtime_error("Failed to read cosmic web file");
+	positions->data.resize(num_particles * 3);
+	velocities->data.resize(num_particles * 3);
+	positions->components = 3;
+	velocities->components = 3;
+	positions->layout = layout;
+	velocities->layout = layout;
+
+	std::vector<char, ResourceAllocator<char>> file_data(num_particles * 2 * sizeof(vec3f));
+	{
+		AllocationPhase phase("cosmic web: read");
+		if (!fin.read(file_data.data(), file_data.size())) {
+			throw std::runtime_error("Failed to read cosmic web file");
+		}
 	}
-
-	vec3f *vecs = reinterpret_cast<vec3f*>(file_data.data());
-
-	for (int i = 0; i < header.np_local; ++i) { 
-		const vec3f position = vecs[i * 2] + offset;
-		const vec3f velocity = vecs[i * 2 + 1];
-
-		positions->data.push_back(position.x);
-		positions->data.push_back(position.y);
-		positions->data.push_back(position.z);
-
-		velocities->data.push_back(velocity.x);
-		velocities->data.push_back(velocity.y);
-		velocities->data.push_back(velocity.z);
+	AllocationPhase phase("cosmic web: convert");
+
+	// The file interleaves positions and velocities, so we de-interleave them
+	// directly into the requested layout
+	float *pos = positions->data.data();
+	float *vel = velocities->data.data();
+	if (layout == Layout::AOS) {
+		vec3f *out[2] = {reinterpret_cast<vec3f*>(pos), reinterpret_cast<vec3f*>(vel)};
+		deinterleave(reinterpret_cast<const vec3f*>(file_data.data()), num_particles, 2, out);
+	} else {
+		float *out[6] = {pos, pos + num_particles, pos + 2 * num_particles,
+			vel, vel + num_particles, vel + 2 * num_particles};
+		deinterleave(reinterpret_cast<const float*>(file_data.data()), num_particles, 6, out);
 	}
+	translate(*positions, offset);
 
 	model["positions"] = std::move(positions);
 	model["velocities"] = std::move(velocities);
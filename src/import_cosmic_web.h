@@ -4,8 +4,10 @@
 
 namespace pl {
 
-// Import a single brick of the cosmic web dataset into the model
-void import_cosmic_web(const FileName &file_name, ParticleModel &model);
+// Import a single brick of the cosmic web dataset into the model, the positions
+// and velocities are written out in the layout requested
+void import_cosmic_web(const FileName &file_name, ParticleModel &model,
+		const Layout layout = Layout::AOS);
 
 }
 
@@ -2,15 +2,25 @@
 #include <algorithm>
 #include <limits>
 #include <fstream>
+#include <stdexcept>
+#include "memory_report.h"
 #include "import_gromacs.h"
 
 using namespace pl;
 
 // Original importer from @hoangthaiduong
-void pl::import_gromacs(const FileName &file_name, std::vector<ParticleModel> &timesteps) {
+void pl::import_gromacs(const FileName &file_name, std::vector<ParticleModel> &timesteps,
+		std::shared_ptr<MemoryResource> resource)
+{
 	std::ifstream fin(file_name.c_str());
+	// All the timesteps are carved out of one arena, so they're freed together
+	// when the trajectory is dropped instead of churning the heap each frame
+	if (!resource) {
+		resource = std::make_shared<Arena>();
+	}
 
 	std::cout << "Loading GROMACS File '" << file_name << "'\n";
+	AllocationPhase phase("gromacs: parse");
 
 	std::string line;
 	float time = -1;
@@ -28,10 +38,12 @@ void pl::import_gromacs(const FileName &file_name, std::vector<ParticleModel> &t
 			std::getline(fin, line);
 			num_particles = std::stoull(line);
 
-			auto positions = std::make_shared<DataT<float>>();
-			auto velocities = std::make_shared<DataT<float>>();
+			auto positions = make_data<float>(resource);
+			auto velocities = make_data<float>(resource);
 			positions->data.resize(num_particles * 3);
 			velocities->data.resize(num_particles * 3);
+			positions->components = 3;
+			velocities->components = 3;
 			auto &pos = positions->data;
 			auto &vel = velocities->data;
 
@@ -39,12 +51,17 @@ void pl::import_gromacs(const FileName &file_name, std::vector<ParticleModel> &t
 				std::getline(fin, line);
 				float px, py, pz, vx, vy, vz;
 				int id;
-				sscanf(line.data(), "%dDZATO DZ%d %f %f %f %f %f %f", &id, &id,
+				// The arrays aren't zero-filled, so a particle which can't be read
+				// would be left as garbage
+				const int read = sscanf(line.data(), "%dDZATO DZ%d %f %f %f %f %f %f", &id, &id,
 						&pos[i * 3], &pos[i * 3 + 1], &pos[i * 3 + 2],
 						&vel[i * 3], &vel[i * 3 + 1], &vel[i * 3 + 2]);
-
+				if (read != 8) {
+					throw std::runtime_error("import_gromacs: failed to read particle "
+							+ std::to_string(i) + " of the timestep at time " + std::to_string(time));
+				}
 			}
-			ParticleModel t;
+			ParticleModel t = make_model(resource);
 			t["positions"] = positions;
 			t["velocities"] = velocities;
 			timesteps.push_back(t);
@@ -4,7 +4,11 @@
 
 namespace pl {
 
-void import_gromacs(const FileName &file_name, std::vector<ParticleModel> &timesteps);
+// Import the trajectory into timesteps. The timesteps are allocated from the resource,
+// if no resource is passed a new Arena is used for the trajectory. Throws if a particle
+// of a timestep can't be read
+void import_gromacs(const FileName &file_name, std::vector<ParticleModel> &timesteps,
+		std::shared_ptr<MemoryResource> resource = nullptr);
 
 }
 
@@ -1,6 +1,9 @@
 #include <limits>
 #include <lasreader.hpp>
 #include "types.h"
+#include "stats.h"
+#include "memory_report.h"
+#include "kernels.h"
 #include "import_las.h"
 
 using namespace pl;
@@ -22,11 +25,23 @@ void pl::import_las(const FileName &file_name, ParticleModel &model){
 		|| reader->header.point_data_format == 3
 		|| reader->header.point_data_format == 5;
 
+	AllocationPhase phase("las: read points");
 	auto positions = std::make_shared<DataT<float>>();
 	auto colors = std::make_shared<DataT<uint8_t>>();
+	positions->components = 3;
+	colors->components = 4;
 	positions->data.reserve(reader->npoints * 3);
-	colors->data.reserve(reader->npoints);
-	const float inv_max_uint16 = 1.f / std::numeric_limits<uint16_t>::max();
+	colors->data.reserve(reader->npoints * 4);
+	// Colors are buffered a block of points at a time and scaled to 8 bits together
+	const size_t COLOR_BLOCK = 4096;
+	std::vector<uint16_t> rgba_block;
+	rgba_block.reserve(COLOR_BLOCK * 4);
+	auto flush_colors = [&](){
+		const size_t offset = colors->data.size();
+		colors->data.resize(offset + rgba_block.size());
+		normalize_u16_u8(rgba_block.data(), rgba_block.size(), colors->data.data() + offset);
+		rgba_block.clear();
+	};
 	size_t n_discarded = 0;
 	while (reader->read_point()){
 		// Points classified as low point are noise and should be discarded
@@ -40,8 +55,9 @@ void pl::import_las(const FileName &file_name, ParticleModel &model){
 		}
 		if (has_color){
 			const uint16_t *rgba = reader->point.get_rgb();
-			for (size_t i = 0; i < 4; ++i){
-				colors->data.push_back(static_cast<uint8_t>(255.0 * rgba[i] * inv_max_uint16));
+			rgba_block.insert(rgba_block.end(), rgba, rgba + 4);
+			if (rgba_block.size() == COLOR_BLOCK * 4){
+				flush_colors();
 			}
 		} else {
 			for (size_t i = 0; i < 4; ++i){
@@ -49,7 +65,20 @@ void pl::import_las(const FileName &file_name, ParticleModel &model){
 			}
 		}
 	}
+	flush_colors();
 	std::cout << "Discarded " << n_discarded << " noise classified points\n";
+
+	// The header bounds give us the range of the positions for free. They may be slightly
+	// conservative since they include the discarded noise points
+	Stats bounds;
+	bounds.components.resize(3);
+	bounds.components[0].min = reader->get_min_x();
+	bounds.components[0].max = reader->get_max_x();
+	bounds.components[1].min = reader->get_min_y();
+	bounds.components[1].max = reader->get_max_y();
+	bounds.components[2].min = reader->get_min_z();
+	bounds.components[2].max = reader->get_max_z();
+	seed_stats(*positions, bounds);
 	model["positions"] = std::move(positions);
 	model["colors"] = std::move(colors);
 }
@@ -6,6 +6,8 @@
 #include <limits>
 #include <unordered_map>
 #include <fstream>
+#include "mapped_file.h"
+#include "memory_report.h"
 #include "import_libbat_bpf.h"
 #include "json.hpp"
 
@@ -75,21 +77,31 @@ enum LIBBAT_DTYPE {
 };
 
 void pl::import_libbat_bpf(const FileName &file_name, ParticleModel &model) {
-    std::ifstream fin(file_name.c_str(), std::ios::binary);
+    auto file = std::make_shared<MappedFile>(file_name);
 
     uint64_t json_header_size = 0;
-    fin.read(reinterpret_cast<char *>(&json_header_size), sizeof(uint64_t));
+    if (file->size() < sizeof(uint64_t)) {
+        throw std::runtime_error("BPF file is too small to contain a header");
+    }
+    std::memcpy(&json_header_size, file->data(), sizeof(uint64_t));
     const uint64_t total_header_size = json_header_size + sizeof(uint64_t);
+    if (total_header_size > file->size()) {
+        throw std::runtime_error("BPF JSON header extends past the end of the file");
+    }
 
-    std::vector<uint8_t> json_header(json_header_size, 0);
-    fin.read(reinterpret_cast<char *>(json_header.data()), json_header.size());
-
-    json header = json::parse(json_header);
+    const char *json_header = file->data() + sizeof(uint64_t);
+    json header;
+    {
+        AllocationPhase phase("bpf: parse header");
+        header = json::parse(json_header, json_header + json_header_size);
+    }
+    AllocationPhase phase("bpf: map arrays");
 
-	auto points = std::make_shared<DataT<float>>();
-    points->data.resize(3 * header["num_points"].get<uint64_t>());
-    fin.read(reinterpret_cast<char *>(points->data.data()), points->data.size() * sizeof(float));
-    model["positions"] = points;
+    // The point and attribute arrays are aliased directly in the mapped file when
+    // their alignment allows it
+    const uint64_t num_points = header["num_points"].get<uint64_t>();
+    model["positions"] = map_array<float>(file, total_header_size, 3 * num_points);
+    model["positions"]->components = 3;
 
     for (size_t i = 0; i < header["attributes"].size(); ++i) {
         const std::string name = header["attributes"][i]["name"].get<std::string>();
@@ -101,17 +113,11 @@ void pl::import_libbat_bpf(const FileName &file_name, ParticleModel &model) {
 
         const size_t offset = header["attributes"][i]["offset"].get<uint64_t>();
         const size_t size = header["attributes"][i]["size"].get<uint64_t>();
-        fin.seekg(offset + total_header_size);
 
         if (dtype == FLOAT_32) {
-            auto data = std::make_shared<DataT<float>>();
-            fin.read(reinterpret_cast<char *>(data->data.data()), size);
-            model[name] = data;
+            model[name] = map_array<float>(file, offset + total_header_size, size / sizeof(float));
         } else {
-            auto data = std::make_shared<DataT<double>>();
-            fin.read(reinterpret_cast<char *>(data->data.data()), size);
-            model[name] = data;
+            model[name] = map_array<double>(file, offset + total_header_size, size / sizeof(double));
         }
     }
 }
-
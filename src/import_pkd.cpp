@@ -1,6 +1,12 @@
+#include <cstdio>
+#include <limits>
 #include <stdexcept>
 #include "tinyxml2.h"
 #include "types.h"
+#include "mapped_file.h"
+#include "kernels.h"
+#include "quantize.h"
+#include "memory_report.h"
 #include "import_pkd.h"
 
 using namespace pl;
@@ -8,43 +14,163 @@ using namespace tinyxml2;
 
 std::string tinyxml_error_string(const XMLError e);
 
-void load_pkd_data(XMLNode *elem, const FileName &bin_file, ParticleModel &model) {
-	std::ifstream fin(bin_file.c_str(), std::ios::binary);
+const size_t DEQUANTIZE_BLOCK = 64 * 1024;
 
+// Read a "x y z" vector from an attribute of the element
+static vec3f read_vec3f(const XMLElement *elem, const char *name) {
+	const char *text = elem->Attribute(name);
+	vec3f v;
+	if (!text || std::sscanf(text, "%f %f %f", &v.x, &v.y, &v.z) != 3) {
+		std::cout << "Error: quantized PKD " << elem->Value() << " is missing its "
+			<< name << " bounds\n";
+		throw std::runtime_error("Invalid quantized PKD data");
+	}
+	return v;
+}
+
+// Read a string attribute of the element, which must be present
+static std::string read_string(const XMLElement *elem, const char *name) {
+	const char *text = elem->Attribute(name);
+	if (!text) {
+		std::cout << "Error: PKD " << elem->Value() << " is missing its " << name << "\n";
+		throw std::runtime_error("Invalid PKD data");
+	}
+	return text;
+}
+
+static void dequantize_f32(const uint8_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	dequantize_u8_f32(in, n, components, scale, offset, out);
+}
+static void dequantize_f32(const uint16_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	dequantize_u16_f32(in, n, components, scale, offset, out);
+}
+
+// Decode count records of components quantized values, scaled to [lower, upper],
+// straight from the file into a float array
+template<typename T>
+static std::shared_ptr<Data> dequantize_array(const std::shared_ptr<MappedFile> &bin_file,
+		const size_t ofs, const size_t count, const size_t components,
+		const vec3f &lower, const vec3f &upper)
+{
+	const std::shared_ptr<Data> quantized = map_array<T>(bin_file, ofs, count * components);
+	const T *in = static_cast<const T*>(quantized->raw_data());
+	const float max_q = std::numeric_limits<T>::max();
+	float scale[3], offset[3];
+	for (size_t c = 0; c < components; ++c) {
+		scale[c] = (upper[c] - lower[c]) / max_q;
+		offset[c] = lower[c];
+	}
+	auto data = std::make_shared<DataT<float>>();
+	data->components = components;
+	data->data.resize(count * components);
+	float *out = data->data.data();
+	parallel_for(0, count, DEQUANTIZE_BLOCK, [&](const size_t b, const size_t e) {
+		dequantize_f32(in + b * components, e - b, components, scale, offset,
+				out + b * components);
+	});
+	return data;
+}
+
+// Load quantized positions into a QuantizedPositions without decoding them. 16 bit
+// positions alias the mapping, 8 bit positions are widened to 16 bits, q * 257 / 65535
+// == q / 255 so the positions decode to the same values
+static std::shared_ptr<Data> map_quantized_positions(const std::shared_ptr<MappedFile> &bin_file,
+		const size_t ofs, const size_t count, const bool bits8,
+		const vec3f &lower, const vec3f &upper)
+{
+	auto positions = std::make_shared<QuantizedPositions>();
+	positions->components = 3;
+	positions->lower = lower;
+	positions->scale = (upper - lower) / vec3f(std::numeric_limits<uint16_t>::max());
+	if (bits8) {
+		const std::shared_ptr<Data> quantized = map_array<uint8_t>(bin_file, ofs, count * 3);
+		const uint8_t *in = static_cast<const uint8_t*>(quantized->raw_data());
+		positions->data.resize(count * 3);
+		uint16_t *out = positions->data.data();
+		parallel_for(0, count * 3, DEQUANTIZE_BLOCK, [&](const size_t b, const size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				out[i] = static_cast<uint16_t>(in[i] * 257);
+			}
+		});
+	} else {
+		// map_array copies the values out if they can't be aliased, in which case
+		// the copy owns them instead of the mapping
+		const std::shared_ptr<Data> quantized = map_array<uint16_t>(bin_file, ofs, count * 3);
+		positions->alias(static_cast<const uint16_t*>(quantized->raw_data()), count * 3, quantized);
+	}
+	return positions;
+}
+
+void load_pkd_data(XMLNode *elem, const std::shared_ptr<MappedFile> &bin_file,
+		ParticleModel &model, const bool keep_quantized)
+{
 	for (XMLElement *c = elem->FirstChildElement(); c; c = c->NextSiblingElement()) {
 		if (std::strcmp(c->Value(), "position") == 0) {
 			const size_t ofs = c->Int64Attribute("ofs");
 			const size_t count = c->Int64Attribute("count");
-			const std::string format = c->Attribute("format");
-			if (format != "vec3f") {
-				std::cout << "Error: only non-quantized PKD are supported currently\n";
+			const std::string format = read_string(c, "format");
+			if (format == "vec3f") {
+				model["positions"] = map_array<float>(bin_file, ofs, count * 3);
+				model["positions"]->components = 3;
+			} else if (format == "vec3uc" || format == "vec3us") {
+				// Quantized positions are stored relative to the bounds of the particles
+				const vec3f lower = read_vec3f(c, "lower");
+				const vec3f upper = read_vec3f(c, "upper");
+				const bool bits8 = format == "vec3uc";
+				if (keep_quantized) {
+					model["positions"] = map_quantized_positions(bin_file, ofs, count, bits8,
+							lower, upper);
+				} else if (bits8) {
+					model["positions"] = dequantize_array<uint8_t>(bin_file, ofs, count, 3,
+							lower, upper);
+				} else {
+					model["positions"] = dequantize_array<uint16_t>(bin_file, ofs, count, 3,
+							lower, upper);
+				}
+			} else {
+				std::cout << "Error: unsupported PKD position format " << format << "\n";
 				throw std::runtime_error("Unsupported PKD format");
 			}
-			fin.seekg(ofs);
-			auto pos = std::make_shared<DataT<float>>();
-			pos->data.resize(count * 3);
-			const size_t read_bytes = pos->data.size() * sizeof(float);
-			if (!fin.read(reinterpret_cast<char*>(pos->data.data()), read_bytes)) {
-				throw std::runtime_error("Failed to read all bytes for position");
-			}
-			model["positions"] = std::move(pos);
 		} else if (std::strcmp(c->Value(), "attribute") == 0) {
 			const size_t ofs = c->Int64Attribute("ofs");
 			const size_t count = c->Int64Attribute("count");
-			const std::string format = c->Attribute("format");
-			const std::string name = c->Attribute("name");
-			if (format != "float") {
-				std::cout << "Error: only float attribs are supported currently\n";
+			const std::string format = read_string(c, "format");
+			const std::string name = read_string(c, "name");
+			// Normalized uchar and ushort attributes with a range are quantized floats,
+			// the others keep their type
+			const bool quantized = c->Attribute("lower") && c->Attribute("upper");
+			if (quantized && (format == "uchar" || format == "ushort")) {
+				const vec3f lower(c->FloatAttribute("lower"));
+				const vec3f upper(c->FloatAttribute("upper"));
+				if (format == "uchar") {
+					model[name] = dequantize_array<uint8_t>(bin_file, ofs, count, 1, lower, upper);
+				} else {
+					model[name] = dequantize_array<uint16_t>(bin_file, ofs, count, 1, lower, upper);
+				}
+			} else if (format == "float") {
+				model[name] = map_array<float>(bin_file, ofs, count);
+			} else if (format == "double") {
+				model[name] = map_array<double>(bin_file, ofs, count);
+			} else if (format == "char") {
+				model[name] = map_array<int8_t>(bin_file, ofs, count);
+			} else if (format == "uchar") {
+				model[name] = map_array<uint8_t>(bin_file, ofs, count);
+			} else if (format == "short") {
+				model[name] = map_array<int16_t>(bin_file, ofs, count);
+			} else if (format == "ushort") {
+				model[name] = map_array<uint16_t>(bin_file, ofs, count);
+			} else if (format == "int") {
+				model[name] = map_array<int32_t>(bin_file, ofs, count);
+			} else if (format == "uint") {
+				model[name] = map_array<uint32_t>(bin_file, ofs, count);
+			} else {
+				std::cout << "Error: unsupported PKD attribute format " << format << "\n";
 				throw std::runtime_error("Unsupported PKD attrib format");
 			}
-			fin.seekg(ofs);
-			auto attrib = std::make_shared<DataT<float>>();
-			attrib->data.resize(count);
-			const size_t read_bytes = attrib->data.size() * sizeof(float);
-			if (!fin.read(reinterpret_cast<char*>(attrib->data.data()), read_bytes)) {
-				throw std::runtime_error("Failed to read all bytes for position");
-			}
-			model[name] = std::move(attrib);
 		} else if (std::strcmp(c->Value(), "radius") == 0) {
 			const float radius = c->FloatText();
 			auto attrib = std::make_shared<DataT<float>>();
@@ -59,9 +185,10 @@ void load_pkd_data(XMLNode *elem, const FileName &bin_file, ParticleModel &model
 	}
 }
 
-void pl::import_pkd(const FileName &file_name, ParticleModel &model) {
+void pl::import_pkd(const FileName &file_name, ParticleModel &model, const bool keep_quantized) {
 	const FileName bin_file = file_name.path().join(FileName(file_name.name() + ".pkdbin"));
 	std::cout << "PKD bin file = " << bin_file << "\n";
+	AllocationPhase parse_phase("pkd: parse XML");
 	XMLDocument doc;
 	XMLError err = doc.LoadFile(file_name.c_str());
 	if (err != XML_SUCCESS){
@@ -74,13 +201,19 @@ void pl::import_pkd(const FileName &file_name, ParticleModel &model) {
 		std::cout << "No OSPRay root XML node found in file\n";
 		throw std::runtime_error("Failed to read PKD data");
 	}
+	// The bin file is mapped and shared by the arrays we load, instead of copying
+	// out each array we alias it directly in the mapping
+	AllocationPhase map_phase("pkd: map arrays");
+	std::shared_ptr<MappedFile> bin_data;
 	for (XMLNode *c = node->FirstChild(); c; c = c->NextSibling()) {
 		if (std::strcmp(c->Value(), "PKDGeometry") == 0) {
-			load_pkd_data(c, bin_file, model);
+			if (!bin_data) {
+				bin_data = std::make_shared<MappedFile>(bin_file);
+			}
+			load_pkd_data(c, bin_data, model, keep_quantized);
 		}
 	}
 
-	auto positions = dynamic_cast<DataT<float>*>(model["positions"].get());
-	std::cout << "Read PKD data with " << positions->data.size() / 3 << " particles\n";
+	std::cout << "Read PKD data with " << model["positions"]->count() << " particles\n";
 }
 
@@ -4,7 +4,11 @@
 
 namespace pl {
 
-void import_pkd(const FileName &file_name, ParticleModel &model);
+// Import the PKD geometry into the model. Quantized positions are decoded to floats,
+// unless keep_quantized is set, in which case they're kept as QuantizedPositions,
+// aliasing the mapped file for 16 bit positions. Throws if the file is malformed
+void import_pkd(const FileName &file_name, ParticleModel &model,
+		const bool keep_quantized = false);
 
 }
 
@@ -6,6 +6,8 @@
 #include <limits>
 #include <unordered_map>
 #include <fstream>
+#include "mapped_file.h"
+#include "memory_report.h"
 #include "import_scivis16.h"
 
 using namespace pl;
@@ -24,32 +26,30 @@ struct Header {
 void pl::import_scivis16(const FileName &file_name, ParticleModel &model){
 	std::cout << "Reading SciVis16 data from '" << file_name << "'\n";
 
+	AllocationPhase phase("scivis16: map arrays");
 	// Offset from the example code of reading the data
 	const size_t MAGIC_OFFSET = 4072;
-	std::ifstream file{file_name.file_name.c_str(), std::ios::binary};
-	file.seekg(MAGIC_OFFSET);
+	auto file = std::make_shared<MappedFile>(file_name);
+	if (file->size() < MAGIC_OFFSET + sizeof(Header)) {
+		throw std::runtime_error("SciVis16 file is too small to contain a header");
+	}
 
 	Header header;
-	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	std::memcpy(&header, file->data() + MAGIC_OFFSET, sizeof(header));
 	std::cout << "File contains " << header.size << " particles for timestep "
 		<< header.step << "\n";
 
-	auto positions = std::make_shared<DataT<float>>();
-	positions->data.resize(header.size * 3);
-	auto velocity = std::make_shared<DataT<float>>();
-	velocity->data.resize(header.size * 3);
-	auto concentration = std::make_shared<DataT<float>>();
-	concentration->data.resize(header.size);
-
-	file.seekg(4, std::ios_base::cur);
-	file.read(reinterpret_cast<char*>(positions->data.data()),
-			positions->data.size() * sizeof(float));
-	file.seekg(4, std::ios_base::cur);
-	file.read(reinterpret_cast<char*>(velocity->data.data()),
-			velocity->data.size() * sizeof(float));
-	file.seekg(4, std::ios_base::cur);
-	file.read(reinterpret_cast<char*>(concentration->data.data()),
-			concentration->data.size() * sizeof(float));
+	// Each array is preceded by 4 bytes of padding, and the arrays are aliased
+	// directly in the mapped file
+	const size_t count = header.size;
+	size_t offset = MAGIC_OFFSET + sizeof(Header) + 4;
+	auto positions = map_array<float>(file, offset, count * 3);
+	offset += count * 3 * sizeof(float) + 4;
+	auto velocity = map_array<float>(file, offset, count * 3);
+	offset += count * 3 * sizeof(float) + 4;
+	auto concentration = map_array<float>(file, offset, count);
+	positions->components = 3;
+	velocity->components = 3;
 
 	model["positions"] = std::move(positions);
 	model["velocity"] = std::move(velocity);
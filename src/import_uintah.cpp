@@ -5,7 +5,14 @@
 #include <cstdlib>
 #include <cstdio>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <exception>
 #include "tinyxml2.h"
+#include "model_builder.h"
+#include "memory_report.h"
+#include "kernels.h"
+#include "mapped_file.h"
 #include "import_uintah.h"
 
 using namespace pl;
@@ -15,8 +22,6 @@ struct UintahPatch {
 	vec3f lower;
 };
 
-bool uintah_is_big_endian = false;
-
 std::string tinyxml_error_string(const XMLError e){
 	switch (e){
 		case XML_NO_ATTRIBUTE:
@@ -58,28 +63,35 @@ std::string tinyxml_error_string(const XMLError e){
 			return "XML_SUCCESS";
 	}
 }
-double ntohd(double d){
-	double ret = 0;
-	char *in = reinterpret_cast<char*>(&d);
-	char *out = reinterpret_cast<char*>(&ret);
-	for (int i = 0; i < 8; ++i){
-		out[i] = in[7 - i];
-	}
-	return ret;
-}
-float ntohf(float f){
-	float ret = 0;
-	char *in = reinterpret_cast<char*>(&f);
-	char *out = reinterpret_cast<char*>(&ret);
-	for (int i = 0; i < 4; ++i){
-		out[i] = in[3 - i];
+// A particle variable of a patch, to be read from a Uintah data file
+struct UintahVariable {
+	std::string name;
+	std::string type;
+	FileName file_name;
+	size_t patch;
+	size_t start;
+	size_t end;
+	size_t num_particles;
+	// The attribute of the model builder the variable is read into
+	size_t attribute;
+};
+
+// The state of a single import, passed through the parser instead of kept
+// in globals so multiple files can be imported at once
+struct UintahContext {
+	// Endianness of the data files, given in the timestep meta data
+	bool big_endian;
+	std::vector<UintahVariable> variables;
+
+	UintahContext() : big_endian(false) {}
+	// Check if the data read from the files needs to be byte swapped on this host
+	bool swap_bytes() const {
+		return big_endian == host_is_little_endian();
 	}
-	return ret;
-}
-bool read_particles(const FileName &file_name, Data *pos_data, const size_t num_particles,
-		const size_t start, const size_t end) {
-	auto *positions = dynamic_cast<DataT<float>*>(pos_data);
-	assert(positions);
+};
+
+bool read_particles(const UintahContext &ctx, const FileName &file_name, DataT<float> &positions,
+		const size_t num_particles, const size_t start, const size_t end) {
 	// TODO: Would mmap'ing the file at the start and keeping each new file we encounter
 	// mapped be faster than fopen/fread/fclose?
 	FILE *fp = fopen(file_name.file_name.c_str(), "rb");
@@ -91,33 +103,28 @@ bool read_particles(const FileName &file_name, Data *pos_data, const size_t num_
 	size_t len = end - start;
 	if (len != num_particles * sizeof(double) * 3){
 		std::cout << "Length of data != expected length of particle data\n";
-		return false;
 		fclose(fp);
+		return false;
 	}
 
-	double position[3];
-	for (size_t i = 0; i < num_particles; ++i){
-		if (fread(position, sizeof(position), 1, fp) != 1){
-			std::cout << "Error reading particle from file\n";
-			fclose(fp);
-			return false;
-		}
-		if (uintah_is_big_endian){
-			position[0] = ntohd(position[0]);
-			position[1] = ntohd(position[1]);
-			position[2] = ntohd(position[2]);
-		}
-		positions->data.push_back(static_cast<float>(position[0]));
-		positions->data.push_back(static_cast<float>(position[1]));
-		positions->data.push_back(static_cast<float>(position[2]));
+	std::vector<double, ResourceAllocator<double>> data(num_particles * 3);
+	if (fread(data.data(), sizeof(double) * 3, num_particles, fp) != num_particles){
+		std::cout << "Error reading particle from file\n";
+		fclose(fp);
+		return false;
 	}
 	fclose(fp);
+	if (ctx.swap_bytes()){
+		byte_swap(data.data(), data.size());
+	}
+	const size_t offset = positions.data.size();
+	positions.data.resize(offset + data.size());
+	convert_f64_f32(data.data(), data.size(), positions.data.data() + offset);
 	return true;
 }
 template<typename In, typename Out = In>
-bool read_particle_attribute(const FileName &file_name, Data *attrib_data, const size_t num_particles,
-		const size_t start, const size_t end){
-	auto attribs = dynamic_cast<DataT<Out>*>(attrib_data);
+bool read_particle_attribute(const UintahContext &ctx, const FileName &file_name, DataT<Out> &attribs,
+		const size_t num_particles, const size_t start, const size_t end){
 	// TODO: Would mmap'ing the file at the start and keeping each new file we encounter
 	// mapped be faster than fopen/fread/fclose?
 	FILE *fp = fopen(file_name.file_name.c_str(), "rb");
@@ -129,23 +136,114 @@ bool read_particle_attribute(const FileName &file_name, Data *attrib_data, const
 	size_t len = end - start;
 	if (len != num_particles * sizeof(In)){
 		std::cout << "Length of data != expected length of particle data\n";
-		return false;
 		fclose(fp);
+		return false;
 	}
 
-	std::vector<In> data(num_particles, In());
-	if (fread(data.data(), sizeof(In), num_particles, fp) != num_particles){
+	const size_t offset = attribs.data.size();
+	attribs.data.resize(offset + num_particles);
+	Out *out = attribs.data.data() + offset;
+	// Read straight into the attribute if no conversion is needed
+	std::vector<In, ResourceAllocator<In>> data(std::is_same<In, Out>::value ? 0 : num_particles);
+	void *buf = std::is_same<In, Out>::value ? static_cast<void*>(out) : data.data();
+	if (fread(buf, sizeof(In), num_particles, fp) != num_particles){
 		std::cout << "Error reading particle attribute from file\n";
 		fclose(fp);
 		return false;
 	}
 	fclose(fp);
-	std::transform(data.begin(), data.end(), std::back_inserter(attribs->data),
-			[](const In &t){ return static_cast<Out>(t); });
+	if (ctx.swap_bytes()){
+		byte_swap(static_cast<In*>(buf), num_particles);
+	}
+	if (!std::is_same<In, Out>::value) {
+		convert_array(static_cast<const In*>(data.data()), num_particles, out);
+	}
+	return true;
+}
+bool read_uintah_variable(const UintahContext &ctx, const UintahVariable &var, ParticleChunk &chunk) {
+	if (var.name == "positions"){
+		return read_particles(ctx, var.file_name, chunk.array<float>(var.attribute),
+				var.num_particles, var.start, var.end);
+	} else if (var.type == "ParticleVariable<double>"){
+		return read_particle_attribute<double>(ctx, var.file_name, chunk.array<double>(var.attribute),
+				var.num_particles, var.start, var.end);
+	} else if (var.type == "ParticleVariable<float>"){
+		return read_particle_attribute<float>(ctx, var.file_name, chunk.array<float>(var.attribute),
+				var.num_particles, var.start, var.end);
+	} else if (var.type == "ParticleVariable<long64>"){
+		return read_particle_attribute<int64_t>(ctx, var.file_name, chunk.array<int64_t>(var.attribute),
+				var.num_particles, var.start, var.end);
+	}
+	return true;
+}
+// Read the variables into the model, the patches are loaded in parallel
+bool read_uintah_variables(UintahContext &ctx, ParticleModel &model) {
+	std::vector<UintahVariable> &variables = ctx.variables;
+	ParticleModelBuilder builder;
+	for (auto &v : variables) {
+		// TODO: This should handle arbitrary ParticleVariable<Point> types
+		if (v.name == "positions"){
+			v.attribute = builder.add_attribute<float>("positions", 3);
+		} else if (v.type == "ParticleVariable<double>"){
+			v.attribute = builder.add_attribute<double>(v.name);
+		} else if (v.type == "ParticleVariable<float>"){
+			v.attribute = builder.add_attribute<float>(v.name);
+		} else if (v.type == "ParticleVariable<long64>"){
+			v.attribute = builder.add_attribute<int64_t>(v.name);
+		}
+	}
+	// Each patch is read into its own chunk so the attributes of its particles line up,
+	// the chunks are added in the order the patches appear in the data files
+	std::map<std::pair<std::string, size_t>, size_t> patch_chunks;
+	std::vector<std::vector<size_t>> chunk_variables;
+	for (size_t i = 0; i < variables.size(); ++i) {
+		const auto key = std::make_pair(variables[i].file_name.file_name, variables[i].patch);
+		auto fnd = patch_chunks.find(key);
+		if (fnd == patch_chunks.end()) {
+			fnd = patch_chunks.insert(std::make_pair(key, builder.add_chunks())).first;
+			chunk_variables.emplace_back();
+		}
+		chunk_variables[fnd->second].push_back(i);
+	}
+
+	{
+		AllocationPhase phase("uintah: read particles");
+		std::vector<char> success(chunk_variables.size(), 1);
+		// Reading can throw, e.g. bad_alloc, so the first exception thrown by a
+		// worker is rethrown once all the workers are done
+		std::mutex mutex;
+		std::exception_ptr error;
+		parallel_for(0, chunk_variables.size(), 1, [&](const size_t begin, const size_t end) {
+			try {
+				for (size_t c = begin; c < end; ++c) {
+					ParticleChunk &chunk = builder.chunk(c);
+					for (const auto &v : chunk_variables[c]) {
+						if (!read_uintah_variable(ctx, variables[v], chunk)) {
+							success[c] = 0;
+							break;
+						}
+					}
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		});
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		if (std::find(success.begin(), success.end(), 0) != success.end()) {
+			return false;
+		}
+	}
+	AllocationPhase phase("uintah: gather");
+	builder.finalize(model);
 	return true;
 }
 bool read_uintah_particle_variable(const FileName &base_path, XMLElement *elem,
-		ParticleModel &model)
+		UintahContext &ctx)
 {
 	std::string type;
 	{
@@ -219,42 +317,30 @@ bool read_uintah_particle_variable(const FileName &base_path, XMLElement *elem,
 		}
 	}
 	if (num_particles > 0){
+		// Particle positions are p.x, rename them to position when we load them
 		if (variable == "p.x") {
 			variable = "positions";
 		}
-		const bool need_new_array = model.find(variable) == model.end();
-		// Particle positions are p.x, rename them to position when we load them
-		// TODO: This should handle arbitrary ParticleVariable<Point> types
-		if (variable == "positions"){
-			if (need_new_array) {
-				std::cout << "new positions array\n";
-				model["positions"] = std::make_shared<DataT<float>>();
-			}
-			return read_particles(base_path.join(FileName(file_name)),
-					model["positions"].get(), num_particles, start, end);
-		} else if (type == "ParticleVariable<double>"){
-			if (need_new_array) {
-				model[variable] = std::make_shared<DataT<double>>();
-			}
-			return read_particle_attribute<double>(base_path.join(FileName(file_name)),
-					model[variable].get(), num_particles, start, end);
-		} else if (type == "ParticleVariable<float>"){
-			if (need_new_array) {
-				model[variable] = std::make_shared<DataT<float>>();
-			}
-			return read_particle_attribute<float>(base_path.join(FileName(file_name)),
-					model[variable].get(), num_particles, start, end);
-		} else if (type == "ParticleVariable<long64>"){
-			if (need_new_array) {
-				model[variable] = std::make_shared<DataT<int64_t>>();
-			}
-			return read_particle_attribute<int64_t>(base_path.join(FileName(file_name)),
-					model[variable].get(), num_particles, start, end);
+		if (variable == "positions" || type == "ParticleVariable<double>"
+				|| type == "ParticleVariable<float>" || type == "ParticleVariable<long64>")
+		{
+			UintahVariable var;
+			var.name = variable;
+			var.type = type;
+			var.file_name = base_path.join(FileName(file_name));
+			var.patch = patch;
+			var.start = start;
+			var.end = end;
+			var.num_particles = num_particles;
+			var.attribute = 0;
+			ctx.variables.push_back(var);
 		}
 	}
 	return true;
 }
-bool read_uintah_datafile(const FileName &file_name, XMLDocument &doc, ParticleModel &model){
+bool read_uintah_datafile(const FileName &file_name, XMLDocument &doc,
+		UintahContext &ctx)
+{
 	XMLElement *node = doc.FirstChildElement("Uintah_Output");
 	const static std::string VAR_TYPE = "ParticleVariable";
 	for (XMLNode *c = node->FirstChild(); c; c = c->NextSibling()){
@@ -269,14 +355,14 @@ bool read_uintah_datafile(const FileName &file_name, XMLDocument &doc, ParticleM
 		}
 		std::string var_type = e->Attribute("type");
 		if (var_type.substr(0, VAR_TYPE.size()) == VAR_TYPE){
-			if (!read_uintah_particle_variable(file_name.path(), e, model)){
+			if (!read_uintah_particle_variable(file_name.path(), e, ctx)){
 				return false;
 			}
 		}
 	}
 	return true;
 }
-bool read_uintah_timestep_meta(XMLNode *node){
+bool read_uintah_timestep_meta(XMLNode *node, UintahContext &ctx){
 	for (XMLNode *c = node->FirstChild(); c; c = c->NextSibling()){
 		XMLElement *e = c->ToElement();
 		if (!e){
@@ -286,7 +372,7 @@ bool read_uintah_timestep_meta(XMLNode *node){
 		if (std::string(e->Value()) == "endianness"){
 			if (std::string(e->GetText()) == "big_endian"){
 				std::cout << "Uintah parser switching to big endian\n";
-				uintah_is_big_endian = true;
+				ctx.big_endian = true;
 			}
 		}
 	}
@@ -310,7 +396,7 @@ bool read_uintah_patches(XMLNode *node, std::vector<UintahPatch> &patches) {
 	return true;
 }
 bool read_uintah_timestep_data(const FileName &base_path, XMLNode *node,
-		ParticleModel &model)
+		UintahContext &ctx)
 {
 	for (XMLNode *c = node->FirstChild(); c; c = c->NextSibling()){
 		if (std::string(c->Value()) == "Datafile"){
@@ -333,7 +419,7 @@ bool read_uintah_timestep_data(const FileName &base_path, XMLNode *node,
 					<< tinyxml_error_string(err) << "\n";
 				return false;
 			}
-			if (!read_uintah_datafile(data_file, doc, model)){
+			if (!read_uintah_datafile(data_file, doc, ctx)){
 				std::cout << "Error reading Uintah data file " << data_file << "\n";
 				return false;
 			}
@@ -341,19 +427,21 @@ bool read_uintah_timestep_data(const FileName &base_path, XMLNode *node,
 	}
 	return true;
 }
-bool read_uintah_timestep(const FileName &file_name, XMLElement *node, ParticleModel &model){
+bool read_uintah_timestep(const FileName &file_name, XMLElement *node,
+		UintahContext &ctx)
+{
 	std::vector<UintahPatch> patches;
 	for (XMLNode *c = node->FirstChild(); c; c = c->NextSibling()){
 		std::cout << c->Value() << "\n" << std::flush;
 		const std::string node_type = c->Value();
 		if (node_type == "Meta") {
-			if (!read_uintah_timestep_meta(c)){
+			if (!read_uintah_timestep_meta(c, ctx)){
 				return false;
 			}
 		}
 	}
 	XMLNode *c = node->FirstChildElement("Data");
-	if (!c || !read_uintah_timestep_data(file_name.path(), c, model)){
+	if (!c || !read_uintah_timestep_data(file_name.path(), c, ctx)){
 		return false;
 	}
 	return true;
@@ -361,30 +449,37 @@ bool read_uintah_timestep(const FileName &file_name, XMLElement *node, ParticleM
 
 void pl::import_uintah(const FileName &file_name, ParticleModel &model){
 	std::cout << "Importing Uintah data from " << file_name << "\n";
-	XMLDocument doc;
-	XMLError err = doc.LoadFile(file_name.file_name.c_str());
-	if (err != XML_SUCCESS){
-		std::cout << "Error loading Uintah data file '" << file_name << "': "
-			<< tinyxml_error_string(err) << "\n";
-		throw std::runtime_error("Failed to open XML file");
-	}
-	if (doc.FirstChildElement("Uintah_timestep")) {
-		if (!read_uintah_timestep(file_name, doc.FirstChildElement("Uintah_timestep"), model)) {
-			std::cout << "Error reading Uintah timestep\n";
-			throw std::runtime_error("Failed to read Uintah timestep");
+	UintahContext ctx;
+	{
+		AllocationPhase phase("uintah: parse XML");
+		XMLDocument doc;
+		XMLError err = doc.LoadFile(file_name.file_name.c_str());
+		if (err != XML_SUCCESS){
+			std::cout << "Error loading Uintah data file '" << file_name << "': "
+				<< tinyxml_error_string(err) << "\n";
+			throw std::runtime_error("Failed to open XML file");
 		}
-	} else if (doc.FirstChildElement("Uintah_Output")) {
-		if (!read_uintah_datafile(file_name, doc, model)) {
-			std::cout << "Error reading Uintah Output\n";
-			throw std::runtime_error("Failed to read Uintah output");
+		if (doc.FirstChildElement("Uintah_timestep")) {
+			if (!read_uintah_timestep(file_name, doc.FirstChildElement("Uintah_timestep"), ctx)) {
+				std::cout << "Error reading Uintah timestep\n";
+				throw std::runtime_error("Failed to read Uintah timestep");
+			}
+		} else if (doc.FirstChildElement("Uintah_Output")) {
+			if (!read_uintah_datafile(file_name, doc, ctx)) {
+				std::cout << "Error reading Uintah Output\n";
+				throw std::runtime_error("Failed to read Uintah output");
+			}
+		} else {
+			std::cout << "Unrecognized UDA XML file!\n";
+			throw std::runtime_error("Failed to read Uintah data");
 		}
-	} else {
-		std::cout << "Unrecognized UDA XML file!\n";
-		throw std::runtime_error("Failed to read Uintah data");
+	}
+	if (!read_uintah_variables(ctx, model)) {
+		std::cout << "Error reading Uintah particle variables\n";
+		throw std::runtime_error("Failed to read Uintah particle data");
 	}
 	if (model.find("positions") != model.end()) {
-		auto positions = dynamic_cast<DataT<float>*>(model["positions"].get());
-		std::cout << "Read Uintah data with " << positions->data.size() / 3 << " particles\n";
+		std::cout << "Read Uintah data with " << model["positions"]->count() << " particles\n";
 	} else {
 		std::cout << "Warning! File " << file_name << " contained no particles\n";
 	}
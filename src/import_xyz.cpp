@@ -2,11 +2,13 @@
 #include <algorithm>
 #include <limits>
 #include <fstream>
+#include "memory_report.h"
 #include "import_xyz.h"
 
 using namespace pl;
 
 void pl::import_xyz(const FileName &file_name, ParticleModel &model){
+	AllocationPhase phase("xyz: parse");
 	std::ifstream file{file_name.file_name.c_str()};
 
 	size_t num_atoms = 0;
@@ -20,6 +22,7 @@ void pl::import_xyz(const FileName &file_name, ParticleModel &model){
 
 	auto positions = std::make_shared<DataT<float>>();
 	auto atom_type = std::make_shared<DataT<int>>();
+	positions->components = 3;
 	int next_atom_id = 0;
 	std::unordered_map<std::string, int> atom_type_id;
 
@@ -44,7 +47,7 @@ void pl::import_xyz(const FileName &file_name, ParticleModel &model){
 		std::cout << "Atom type '" << t.first << "' id = " << t.second << "\n";
 	}
 
-	std::cout << "Read XYZ data with " << positions->data.size() / 3 << " particles\n";
+	std::cout << "Read XYZ data with " << positions->count() << " particles\n";
 
 	model["positions"] = std::move(positions);
 	model["atom_type"] = std::move(atom_type);
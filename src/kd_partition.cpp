@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include "layout.h"
+#include "parallel.h"
+#include "view.h"
+#include "memory_report.h"
+#include "kd_partition.h"
+
+using namespace pl;
+
+// Ranges with fewer particles than this per thread are selected serially
+const size_t KD_GRAIN = 1 << 16;
+// Number of particles sampled to bracket the split in a parallel selection
+const size_t KD_SAMPLES = 1 << 14;
+
+struct KdParticle {
+	vec3f position;
+	size_t index;
+};
+
+// A range of particles still to be split into some number of pieces,
+// the first of which is first_piece
+struct KdRange {
+	size_t begin;
+	size_t end;
+	size_t pieces;
+	size_t first_piece;
+};
+
+static box3f range_bounds(const std::vector<KdParticle> &particles, const size_t begin,
+		const size_t end, const bool parallel)
+{
+	box3f bounds;
+	std::mutex mutex;
+	parallel_for(begin, end, parallel ? KD_GRAIN : end - begin,
+		[&](const size_t b, const size_t e) {
+			box3f local;
+			for (size_t i = b; i < e; ++i) {
+				local.extend(particles[i].position);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			bounds.extend(local);
+		});
+	return bounds;
+}
+
+// The widest axis of the bounds, ties go to the lower axis
+static size_t split_axis(const box3f &bounds) {
+	const vec3f size = bounds.size();
+	if (size.x >= size.y && size.x >= size.z) {
+		return 0;
+	}
+	return size.y >= size.z ? 1 : 2;
+}
+
+// Partition [begin, end) so the particle at rank is where it would be if the range was
+// sorted along the axis, with the particles before it no greater and those after no less
+static void select_serial(std::vector<KdParticle> &particles, const size_t begin,
+		const size_t end, const size_t rank, const size_t axis)
+{
+	std::nth_element(particles.begin() + begin, particles.begin() + rank, particles.begin() + end,
+		[&](const KdParticle &a, const KdParticle &b) {
+			return a.position[axis] < b.position[axis];
+		});
+}
+
+// The same selection in parallel. A sample of the range brackets the value at the rank,
+// the particles are then stably partitioned in parallel into those below, inside and
+// above the bracket, leaving only the few inside it to be selected serially
+static void select_parallel(std::vector<KdParticle> &particles, std::vector<KdParticle> &scratch,
+		const size_t begin, const size_t end, const size_t rank, const size_t axis)
+{
+	const size_t n = end - begin;
+	const size_t ranges = std::min(num_threads(), n / KD_GRAIN);
+	if (ranges < 2) {
+		select_serial(particles, begin, end, rank, axis);
+		return;
+	}
+	std::vector<float> samples(KD_SAMPLES);
+	for (size_t s = 0; s < KD_SAMPLES; ++s) {
+		samples[s] = particles[begin + s * n / KD_SAMPLES].position[axis];
+	}
+	std::sort(samples.begin(), samples.end());
+	const size_t target = (rank - begin) * KD_SAMPLES / n;
+	const size_t margin = 4 * static_cast<size_t>(std::sqrt(KD_SAMPLES));
+	const float lo = samples[target > margin ? target - margin : 0];
+	const float hi = samples[std::min(target + margin, KD_SAMPLES - 1)];
+	auto bucket = [&](const KdParticle &p) {
+		const float x = p.position[axis];
+		return x < lo ? 0 : (x > hi ? 2 : 1);
+	};
+
+	// Count each bucket in each range, then turn the counts into the offsets each
+	// range scatters its particles to, all the ranges' particles below the bracket
+	// come first, then those inside and those above
+	const size_t range_size = (n + ranges - 1) / ranges;
+	std::vector<size_t> offsets(ranges * 3, 0);
+	parallel_for(0, ranges, 1, [&](const size_t range_begin, const size_t range_end) {
+		for (size_t r = range_begin; r < range_end; ++r) {
+			const size_t e = std::min(end, begin + (r + 1) * range_size);
+			for (size_t i = begin + r * range_size; i < e; ++i) {
+				++offsets[r * 3 + bucket(particles[i])];
+			}
+		}
+	});
+	size_t totals[3] = {0, 0, 0};
+	size_t offset = begin;
+	for (size_t b = 0; b < 3; ++b) {
+		for (size_t r = 0; r < ranges; ++r) {
+			const size_t count = offsets[r * 3 + b];
+			offsets[r * 3 + b] = offset;
+			offset += count;
+			totals[b] += count;
+		}
+	}
+	// If the sample missed the rank the bracket doesn't help, this is very unlikely
+	if (rank < begin + totals[0] || rank >= begin + totals[0] + totals[1]) {
+		select_serial(particles, begin, end, rank, axis);
+		return;
+	}
+	parallel_for(0, ranges, 1, [&](const size_t range_begin, const size_t range_end) {
+		for (size_t r = range_begin; r < range_end; ++r) {
+			const size_t e = std::min(end, begin + (r + 1) * range_size);
+			for (size_t i = begin + r * range_size; i < e; ++i) {
+				scratch[offsets[r * 3 + bucket(particles[i])]++] = particles[i];
+			}
+		}
+	});
+	parallel_for(begin, end, KD_GRAIN, [&](const size_t b, const size_t e) {
+		std::copy(scratch.begin() + b, scratch.begin() + e, particles.begin() + b);
+	});
+	select_serial(particles, begin + totals[0], begin + totals[0] + totals[1], rank, axis);
+}
+
+// Split the particles into the pieces, writing the start of each piece to offsets
+static void kd_split(std::vector<KdParticle> &particles, const size_t pieces,
+		std::vector<size_t> &offsets)
+{
+	const size_t n = particles.size();
+	offsets.assign(pieces + 1, n);
+	std::vector<KdParticle> scratch;
+	std::vector<KdRange> ranges{KdRange{0, n, pieces, 0}};
+	while (!ranges.empty()) {
+		std::vector<KdRange> splitting;
+		for (const auto &r : ranges) {
+			if (r.pieces == 1) {
+				offsets[r.first_piece] = r.begin;
+			} else {
+				splitting.push_back(r);
+			}
+		}
+		ranges = std::move(splitting);
+
+		// Split each range in two, dividing its pieces between them
+		std::vector<KdRange> children(2 * ranges.size());
+		auto split = [&](const size_t t, const bool parallel) {
+			const KdRange &r = ranges[t];
+			const size_t left = r.pieces / 2;
+			const size_t rank = r.begin + (r.end - r.begin) * left / r.pieces;
+			if (rank > r.begin) {
+				const size_t axis = split_axis(range_bounds(particles, r.begin, r.end, parallel));
+				if (parallel) {
+					select_parallel(particles, scratch, r.begin, r.end, rank, axis);
+				} else {
+					select_serial(particles, r.begin, r.end, rank, axis);
+				}
+			}
+			children[2 * t] = KdRange{r.begin, rank, left, r.first_piece};
+			children[2 * t + 1] = KdRange{rank, r.end, r.pieces - left, r.first_piece + left};
+		};
+		// The few large ranges at the top of the tree are each split in parallel, once
+		// there are enough ranges to keep the threads busy they're split concurrently
+		if (ranges.size() >= num_threads()) {
+			parallel_for(0, ranges.size(), 1, [&](const size_t begin, const size_t end) {
+				for (size_t t = begin; t < end; ++t) {
+					split(t, false);
+				}
+			});
+		} else {
+			if (scratch.empty() && n >= 2 * KD_GRAIN) {
+				scratch.resize(n);
+			}
+			for (size_t t = 0; t < ranges.size(); ++t) {
+				split(t, true);
+			}
+		}
+		ranges = std::move(children);
+	}
+}
+
+static std::vector<KdParticle> load_particles(const Data &positions) {
+	if (positions.components != 3) {
+		throw std::runtime_error("kd_order: the positions must have 3 components");
+	}
+	const size_t n = positions.count();
+	const ComponentStrides strides(positions);
+	std::vector<KdParticle> particles(n);
+	visit(positions, [&](const auto &view) {
+		parallel_for(0, n, KD_GRAIN, [&](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				for (size_t c = 0; c < 3; ++c) {
+					particles[i].position[c] = static_cast<float>(
+							view.data()[i * strides.particle_stride + c * strides.component_stride]);
+				}
+				particles[i].index = i;
+			}
+		});
+	});
+	return particles;
+}
+
+std::vector<size_t> pl::kd_order(const Data &positions, const size_t pieces,
+		std::vector<size_t> &offsets)
+{
+	if (pieces == 0) {
+		throw std::runtime_error("kd_order: there must be at least one piece");
+	}
+	std::vector<KdParticle> particles = load_particles(positions);
+	kd_split(particles, pieces, offsets);
+	std::vector<size_t> order(particles.size());
+	parallel_for(0, particles.size(), KD_GRAIN, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			order[i] = particles[i].index;
+		}
+	});
+	return order;
+}
+
+std::vector<KdPiece> pl::kd_partition(const ParticleModel &model, const size_t pieces) {
+	auto fnd = model.find("positions");
+	if (fnd == model.end()) {
+		throw std::runtime_error("kd_partition: the model has no positions");
+	}
+	if (pieces == 0) {
+		throw std::runtime_error("kd_partition: there must be at least one piece");
+	}
+	AllocationPhase phase("kd: partition");
+	std::vector<KdParticle> particles = load_particles(*fnd->second);
+	std::vector<size_t> offsets;
+	kd_split(particles, pieces, offsets);
+
+	std::vector<KdPiece> result(pieces);
+	auto make_piece = [&](const size_t p, const bool parallel) {
+		const size_t begin = offsets[p];
+		const size_t end = offsets[p + 1];
+		result[p].bounds = range_bounds(particles, begin, end, parallel);
+		auto indices = std::make_shared<std::vector<size_t>>(end - begin);
+		for (size_t i = begin; i < end; ++i) {
+			(*indices)[i - begin] = particles[i].index;
+		}
+		result[p].model = view_rows(model, indices);
+	};
+	if (pieces >= num_threads()) {
+		parallel_for(0, pieces, 1, [&](const size_t begin, const size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				make_piece(p, false);
+			}
+		});
+	} else {
+		for (size_t p = 0; p < pieces; ++p) {
+			make_piece(p, true);
+		}
+	}
+	return result;
+}
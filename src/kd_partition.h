@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+#include "transform.h"
+
+namespace pl {
+
+struct KdPiece {
+	// The tight bounds of the piece's positions
+	box3f bounds;
+	// Views of the piece's particles in the model. Attributes without a value
+	// per particle are shared
+	ParticleModel model;
+};
+
+// Split the particles into pieces of near-equal counts by recursively splitting each range
+// along the widest axis of its bounds, at the rank dividing its pieces between the two
+// sides. Any number of pieces can be made, e.g. 3 pieces are split 1:2. Large ranges are
+// split with a parallel selection, the smaller ones below them are split in parallel.
+// Returns the order of the particles, piece i is [offsets[i], offsets[i + 1]) of the order
+std::vector<size_t> kd_order(const Data &positions, const size_t pieces,
+		std::vector<size_t> &offsets);
+
+// Split the model into count-balanced pieces with kd_order
+std::vector<KdPiece> kd_partition(const ParticleModel &model, const size_t pieces);
+
+}
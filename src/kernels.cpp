@@ -0,0 +1,845 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include "types.h"
+#include "kernels.h"
+
+// The SIMD paths are compiled with per-function target attributes and picked at
+// runtime, so the library still runs on CPUs without them
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PL_X86_KERNELS 1
+#include <immintrin.h>
+#include <cpuid.h>
+#define PL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+using namespace pl;
+
+static SimdLevel supported_simd_level() {
+	static const SimdLevel level = []() {
+#ifdef PL_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+				&& __builtin_cpu_supports("avx512dq"))
+		{
+			return SimdLevel::AVX512;
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			return SimdLevel::AVX2;
+		}
+		if (__builtin_cpu_supports("sse4.1")) {
+			return SimdLevel::SSE4;
+		}
+#endif
+		return SimdLevel::SCALAR;
+	}();
+	return level;
+}
+// F16C isn't part of the levels, the half conversions check for it on their own
+static bool supports_f16c() {
+	static const bool f16c = []() {
+#ifdef PL_X86_KERNELS
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C) != 0;
+#else
+		return false;
+#endif
+	}();
+	return f16c;
+}
+static std::atomic<int>& active_simd_level() {
+	static std::atomic<int> level(static_cast<int>(supported_simd_level()));
+	return level;
+}
+
+SimdLevel pl::simd_level() {
+	return static_cast<SimdLevel>(active_simd_level().load(std::memory_order_relaxed));
+}
+void pl::set_simd_level(const SimdLevel level) {
+	const int l = std::min(static_cast<int>(level), static_cast<int>(supported_simd_level()));
+	active_simd_level().store(l, std::memory_order_relaxed);
+}
+const char* pl::simd_level_name(const SimdLevel level) {
+	switch (level) {
+		case SimdLevel::SSE4:
+			return "SSE4";
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::AVX512:
+			return "AVX-512";
+		default:
+			return "scalar";
+	}
+}
+
+// Reverse the bytes of the unsigned integer at p, the shifts compile to a
+// single bswap instruction where there is one
+template<typename T>
+static void byte_swap_scalar(uint8_t *p) {
+	T x;
+	std::memcpy(&x, p, sizeof(T));
+	T y = 0;
+	for (size_t b = 0; b < sizeof(T); ++b) {
+		y = static_cast<T>((y << 8) | ((x >> (8 * b)) & 0xff));
+	}
+	std::memcpy(p, &y, sizeof(T));
+}
+
+#ifdef PL_X86_KERNELS
+PL_TARGET("sse4.1")
+static size_t convert_f64_f32_sse4(const double *in, const size_t n, float *out) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+		const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+		_mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+	}
+	return i;
+}
+PL_TARGET("avx2")
+static size_t convert_f64_f32_avx2(const double *in, const size_t n, float *out) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(in + i)));
+		_mm_storeu_ps(out + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4)));
+	}
+	return i;
+}
+PL_TARGET("avx512f")
+static size_t convert_f64_f32_avx512(const double *in, const size_t n, float *out) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// The zero-masked form avoids a spurious uninitialized warning from GCC's headers
+		_mm256_storeu_ps(out + i, _mm512_maskz_cvtpd_ps(0xff, _mm512_loadu_pd(in + i)));
+	}
+	return i;
+}
+
+// Only AVX-512DQ has a 64 bit integer to float conversion, emulating it on older
+// instruction sets wouldn't round the same as static_cast
+PL_TARGET("avx512f,avx512dq")
+static size_t convert_i64_f32_avx512(const int64_t *in, const size_t n, float *out) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(out + i, _mm512_cvtepi64_ps(_mm512_loadu_si512(in + i)));
+	}
+	return i;
+}
+
+// x / 257 = (x * 0xff01) >> 24 for all 16 bit x, so the division is a high
+// multiply and a shift
+PL_TARGET("sse4.1")
+static size_t normalize_u16_u8_sse4(const uint16_t *in, const size_t n, uint8_t *out) {
+	const __m128i m = _mm_set1_epi16(static_cast<short>(0xff01));
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+		const __m128i qa = _mm_srli_epi16(_mm_mulhi_epu16(a, m), 8);
+		const __m128i qb = _mm_srli_epi16(_mm_mulhi_epu16(b, m), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(qa, qb));
+	}
+	return i;
+}
+PL_TARGET("avx2")
+static size_t normalize_u16_u8_avx2(const uint16_t *in, const size_t n, uint8_t *out) {
+	const __m256i m = _mm256_set1_epi16(static_cast<short>(0xff01));
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+		const __m256i qa = _mm256_srli_epi16(_mm256_mulhi_epu16(a, m), 8);
+		const __m256i qb = _mm256_srli_epi16(_mm256_mulhi_epu16(b, m), 8);
+		// The pack works within each 128 bit lane, so put the lanes back in order
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(qa, qb),
+				_MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+	}
+	return i;
+}
+PL_TARGET("avx512f,avx512bw")
+static size_t normalize_u16_u8_avx512(const uint16_t *in, const size_t n, uint8_t *out) {
+	const __m512i m = _mm512_set1_epi16(static_cast<short>(0xff01));
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const __m512i a = _mm512_loadu_si512(in + i);
+		const __m512i q = _mm512_srli_epi16(_mm512_mulhi_epu16(a, m), 8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_maskz_cvtepi16_epi8(0xffffffff, q));
+	}
+	return i;
+}
+
+// Reverse the bytes of each element with a byte shuffle, the elements never cross a
+// 128 bit lane so the same in-lane shuffle works at every width
+static const uint8_t BYTE_SWAP_MASKS[3][16] = {
+	{1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+	{3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+	{7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+};
+PL_TARGET("sse4.1")
+static size_t byte_swap_sse4(uint8_t *data, const size_t bytes, const uint8_t *mask_bytes) {
+	const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes));
+	size_t i = 0;
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i *p = reinterpret_cast<__m128i*>(data + i);
+		_mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+	}
+	return i;
+}
+PL_TARGET("avx2")
+static size_t byte_swap_avx2(uint8_t *data, const size_t bytes, const uint8_t *mask_bytes) {
+	const __m256i mask = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes)));
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i *p = reinterpret_cast<__m256i*>(data + i);
+		_mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+	}
+	return i;
+}
+PL_TARGET("avx512f,avx512bw")
+static size_t byte_swap_avx512(uint8_t *data, const size_t bytes, const uint8_t *mask_bytes) {
+	// Zero-masked to avoid the same spurious warning as above
+	const __m512i mask = _mm512_maskz_broadcast_i32x4(0xffff,
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes)));
+	size_t i = 0;
+	for (; i + 64 <= bytes; i += 64) {
+		_mm512_storeu_si512(data + i, _mm512_shuffle_epi8(_mm512_loadu_si512(data + i), mask));
+	}
+	return i;
+}
+
+// The (de)interleaving is bound by memory bandwidth, so the 128 bit shuffles
+// are used at every level
+PL_TARGET("sse4.1")
+static size_t deinterleave_32_sse4(const float *in, const size_t n, const size_t components,
+		float **out)
+{
+	size_t i = 0;
+	if (components == 2) {
+		for (; i + 4 <= n; i += 4) {
+			const __m128 a = _mm_loadu_ps(in + 2 * i);
+			const __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+			_mm_storeu_ps(out[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(out[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+	} else if (components == 3) {
+		for (; i + 4 <= n; i += 4) {
+			// a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+			const __m128 a = _mm_loadu_ps(in + 3 * i);
+			const __m128 b = _mm_loadu_ps(in + 3 * i + 4);
+			const __m128 c = _mm_loadu_ps(in + 3 * i + 8);
+			// Blend each component's elements into one register, then put them in order
+			const __m128 x = _mm_blend_ps(_mm_blend_ps(a, b, 0x4), c, 0x2);
+			const __m128 y = _mm_blend_ps(_mm_blend_ps(a, b, 0x9), c, 0x4);
+			const __m128 z = _mm_blend_ps(_mm_blend_ps(a, b, 0x2), c, 0x9);
+			_mm_storeu_ps(out[0] + i, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 2, 3, 0)));
+			_mm_storeu_ps(out[1] + i, _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 3, 0, 1)));
+			_mm_storeu_ps(out[2] + i, _mm_shuffle_ps(z, z, _MM_SHUFFLE(3, 0, 1, 2)));
+		}
+	} else if (components == 4) {
+		for (; i + 4 <= n; i += 4) {
+			__m128 r0 = _mm_loadu_ps(in + 4 * i);
+			__m128 r1 = _mm_loadu_ps(in + 4 * i + 4);
+			__m128 r2 = _mm_loadu_ps(in + 4 * i + 8);
+			__m128 r3 = _mm_loadu_ps(in + 4 * i + 12);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out[0] + i, r0);
+			_mm_storeu_ps(out[1] + i, r1);
+			_mm_storeu_ps(out[2] + i, r2);
+			_mm_storeu_ps(out[3] + i, r3);
+		}
+	}
+	return i;
+}
+PL_TARGET("sse4.1")
+static size_t interleave_32_sse4(const float *const *in, const size_t n, const size_t components,
+		float *out)
+{
+	size_t i = 0;
+	if (components == 2) {
+		for (; i + 4 <= n; i += 4) {
+			const __m128 x = _mm_loadu_ps(in[0] + i);
+			const __m128 y = _mm_loadu_ps(in[1] + i);
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(x, y));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(x, y));
+		}
+	} else if (components == 3) {
+		for (; i + 4 <= n; i += 4) {
+			// The inverse of deinterleaving, the shuffles are their own inverses
+			__m128 x = _mm_loadu_ps(in[0] + i);
+			__m128 y = _mm_loadu_ps(in[1] + i);
+			__m128 z = _mm_loadu_ps(in[2] + i);
+			x = _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 2, 3, 0));
+			y = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 3, 0, 1));
+			z = _mm_shuffle_ps(z, z, _MM_SHUFFLE(3, 0, 1, 2));
+			_mm_storeu_ps(out + 3 * i, _mm_blend_ps(_mm_blend_ps(x, y, 0x2), z, 0x4));
+			_mm_storeu_ps(out + 3 * i + 4, _mm_blend_ps(_mm_blend_ps(y, z, 0x2), x, 0x4));
+			_mm_storeu_ps(out + 3 * i + 8, _mm_blend_ps(_mm_blend_ps(z, x, 0x2), y, 0x4));
+		}
+	} else if (components == 4) {
+		for (; i + 4 <= n; i += 4) {
+			__m128 r0 = _mm_loadu_ps(in[0] + i);
+			__m128 r1 = _mm_loadu_ps(in[1] + i);
+			__m128 r2 = _mm_loadu_ps(in[2] + i);
+			__m128 r3 = _mm_loadu_ps(in[3] + i);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 4 * i, r0);
+			_mm_storeu_ps(out + 4 * i + 4, r1);
+			_mm_storeu_ps(out + 4 * i + 8, r2);
+			_mm_storeu_ps(out + 4 * i + 12, r3);
+		}
+	}
+	return i;
+}
+
+// The bounds and transforms are bound by memory bandwidth, so the AVX-512 level uses
+// the AVX2 paths. They load K registers per iteration covering W records of K
+// interleaved components, lane j of register r holds component (r * W + j) % K
+template<size_t K>
+PL_TARGET("sse4.1")
+static size_t bounds_sse4(const float *in, const size_t n, float *lower, float *upper) {
+	__m128 lo[K], hi[K];
+	for (size_t r = 0; r < K; ++r) {
+		lo[r] = _mm_set1_ps(std::numeric_limits<float>::infinity());
+		hi[r] = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+	}
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		for (size_t r = 0; r < K; ++r) {
+			// With the new value first, min/max return the accumulator if it's NaN
+			const __m128 x = _mm_loadu_ps(in + i * K + r * 4);
+			lo[r] = _mm_min_ps(x, lo[r]);
+			hi[r] = _mm_max_ps(x, hi[r]);
+		}
+	}
+	float l[4], h[4];
+	for (size_t r = 0; r < K; ++r) {
+		_mm_storeu_ps(l, lo[r]);
+		_mm_storeu_ps(h, hi[r]);
+		for (size_t j = 0; j < 4; ++j) {
+			const size_t c = (r * 4 + j) % K;
+			lower[c] = std::min(lower[c], l[j]);
+			upper[c] = std::max(upper[c], h[j]);
+		}
+	}
+	return i;
+}
+template<size_t K>
+PL_TARGET("avx2")
+static size_t bounds_avx2(const float *in, const size_t n, float *lower, float *upper) {
+	__m256 lo[K], hi[K];
+	for (size_t r = 0; r < K; ++r) {
+		lo[r] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+		hi[r] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+	}
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		for (size_t r = 0; r < K; ++r) {
+			const __m256 x = _mm256_loadu_ps(in + i * K + r * 8);
+			lo[r] = _mm256_min_ps(x, lo[r]);
+			hi[r] = _mm256_max_ps(x, hi[r]);
+		}
+	}
+	float l[8], h[8];
+	for (size_t r = 0; r < K; ++r) {
+		_mm256_storeu_ps(l, lo[r]);
+		_mm256_storeu_ps(h, hi[r]);
+		for (size_t j = 0; j < 8; ++j) {
+			const size_t c = (r * 8 + j) % K;
+			lower[c] = std::min(lower[c], l[j]);
+			upper[c] = std::max(upper[c], h[j]);
+		}
+	}
+	return i;
+}
+template<size_t K>
+PL_TARGET("sse4.1")
+static size_t scale_offset_sse4(const float *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	__m128 s[K], o[K];
+	float sp[4], op[4];
+	for (size_t r = 0; r < K; ++r) {
+		for (size_t j = 0; j < 4; ++j) {
+			sp[j] = scale[(r * 4 + j) % K];
+			op[j] = offset[(r * 4 + j) % K];
+		}
+		s[r] = _mm_loadu_ps(sp);
+		o[r] = _mm_loadu_ps(op);
+	}
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		for (size_t r = 0; r < K; ++r) {
+			const size_t j = i * K + r * 4;
+			_mm_storeu_ps(out + j, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + j), s[r]), o[r]));
+		}
+	}
+	return i;
+}
+template<size_t K>
+PL_TARGET("avx2")
+static size_t scale_offset_avx2(const float *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	__m256 s[K], o[K];
+	float sp[8], op[8];
+	for (size_t r = 0; r < K; ++r) {
+		for (size_t j = 0; j < 8; ++j) {
+			sp[j] = scale[(r * 8 + j) % K];
+			op[j] = offset[(r * 8 + j) % K];
+		}
+		s[r] = _mm256_loadu_ps(sp);
+		o[r] = _mm256_loadu_ps(op);
+	}
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		for (size_t r = 0; r < K; ++r) {
+			const size_t j = i * K + r * 8;
+			_mm256_storeu_ps(out + j,
+					_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in + j), s[r]), o[r]));
+		}
+	}
+	return i;
+}
+// Load 4 or 8 unsigned integers and widen them to 32 bits
+PL_TARGET("sse4.1")
+static inline __m128i load_widen_sse4(const uint8_t *in) {
+	int32_t x;
+	std::memcpy(&x, in, sizeof(x));
+	return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(x));
+}
+PL_TARGET("sse4.1")
+static inline __m128i load_widen_sse4(const uint16_t *in) {
+	return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)));
+}
+PL_TARGET("avx2")
+static inline __m256i load_widen_avx2(const uint8_t *in) {
+	return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)));
+}
+PL_TARGET("avx2")
+static inline __m256i load_widen_avx2(const uint16_t *in) {
+	return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+}
+// The integers are converted exactly, then scaled and offset with the same
+// separate multiply and add as the scalar path
+template<size_t K, typename T>
+PL_TARGET("sse4.1")
+static size_t dequantize_sse4(const T *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	__m128 s[K], o[K];
+	float sp[4], op[4];
+	for (size_t r = 0; r < K; ++r) {
+		for (size_t j = 0; j < 4; ++j) {
+			sp[j] = scale[(r * 4 + j) % K];
+			op[j] = offset[(r * 4 + j) % K];
+		}
+		s[r] = _mm_loadu_ps(sp);
+		o[r] = _mm_loadu_ps(op);
+	}
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		for (size_t r = 0; r < K; ++r) {
+			const size_t j = i * K + r * 4;
+			const __m128 x = _mm_cvtepi32_ps(load_widen_sse4(in + j));
+			_mm_storeu_ps(out + j, _mm_add_ps(_mm_mul_ps(x, s[r]), o[r]));
+		}
+	}
+	return i;
+}
+template<size_t K, typename T>
+PL_TARGET("avx2")
+static size_t dequantize_avx2(const T *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	__m256 s[K], o[K];
+	float sp[8], op[8];
+	for (size_t r = 0; r < K; ++r) {
+		for (size_t j = 0; j < 8; ++j) {
+			sp[j] = scale[(r * 8 + j) % K];
+			op[j] = offset[(r * 8 + j) % K];
+		}
+		s[r] = _mm256_loadu_ps(sp);
+		o[r] = _mm256_loadu_ps(op);
+	}
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		for (size_t r = 0; r < K; ++r) {
+			const size_t j = i * K + r * 8;
+			const __m256 x = _mm256_cvtepi32_ps(load_widen_avx2(in + j));
+			_mm256_storeu_ps(out + j, _mm256_add_ps(_mm256_mul_ps(x, s[r]), o[r]));
+		}
+	}
+	return i;
+}
+// The products are summed in the same order as the scalar path, so the results match exactly
+PL_TARGET("sse4.1")
+static size_t affine_sse4(const float *const *in, const size_t n, const float *m,
+		float *const *out)
+{
+	__m128 mv[12];
+	for (size_t j = 0; j < 12; ++j) {
+		mv[j] = _mm_set1_ps(m[j]);
+	}
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 x = _mm_loadu_ps(in[0] + i);
+		const __m128 y = _mm_loadu_ps(in[1] + i);
+		const __m128 z = _mm_loadu_ps(in[2] + i);
+		for (size_t r = 0; r < 3; ++r) {
+			const __m128 *row = mv + r * 4;
+			const __m128 v = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(row[0], x),
+						_mm_mul_ps(row[1], y)), _mm_mul_ps(row[2], z)), row[3]);
+			_mm_storeu_ps(out[r] + i, v);
+		}
+	}
+	return i;
+}
+PL_TARGET("avx2")
+static size_t affine_avx2(const float *const *in, const size_t n, const float *m,
+		float *const *out)
+{
+	__m256 mv[12];
+	for (size_t j = 0; j < 12; ++j) {
+		mv[j] = _mm256_set1_ps(m[j]);
+	}
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256 x = _mm256_loadu_ps(in[0] + i);
+		const __m256 y = _mm256_loadu_ps(in[1] + i);
+		const __m256 z = _mm256_loadu_ps(in[2] + i);
+		for (size_t r = 0; r < 3; ++r) {
+			const __m256 *row = mv + r * 4;
+			const __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(row[0], x),
+						_mm256_mul_ps(row[1], y)), _mm256_mul_ps(row[2], z)), row[3]);
+			_mm256_storeu_ps(out[r] + i, v);
+		}
+	}
+	return i;
+}
+
+PL_TARGET("avx,f16c")
+static size_t convert_f32_f16_f16c(const float *in, const size_t n, uint16_t *out) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+	}
+	return i;
+}
+PL_TARGET("avx,f16c")
+static size_t convert_f16_f32_f16c(const uint16_t *in, const size_t n, float *out) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+	}
+	return i;
+}
+
+template<size_t K>
+static size_t bounds_simd(const float *in, const size_t n, float *lower, float *upper) {
+	const SimdLevel level = simd_level();
+	if (level >= SimdLevel::AVX2) {
+		return bounds_avx2<K>(in, n, lower, upper);
+	} else if (level == SimdLevel::SSE4) {
+		return bounds_sse4<K>(in, n, lower, upper);
+	}
+	return 0;
+}
+template<size_t K>
+static size_t scale_offset_simd(const float *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	const SimdLevel level = simd_level();
+	if (level >= SimdLevel::AVX2) {
+		return scale_offset_avx2<K>(in, n, scale, offset, out);
+	} else if (level == SimdLevel::SSE4) {
+		return scale_offset_sse4<K>(in, n, scale, offset, out);
+	}
+	return 0;
+}
+template<size_t K, typename T>
+static size_t dequantize_simd(const T *in, const size_t n, const float *scale,
+		const float *offset, float *out)
+{
+	const SimdLevel level = simd_level();
+	if (level >= SimdLevel::AVX2) {
+		return dequantize_avx2<K>(in, n, scale, offset, out);
+	} else if (level == SimdLevel::SSE4) {
+		return dequantize_sse4<K>(in, n, scale, offset, out);
+	}
+	return 0;
+}
+#endif
+
+void pl::convert_f64_f32(const double *in, const size_t n, float *out) {
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	switch (simd_level()) {
+		case SimdLevel::AVX512:
+			i = convert_f64_f32_avx512(in, n, out);
+			break;
+		case SimdLevel::AVX2:
+			i = convert_f64_f32_avx2(in, n, out);
+			break;
+		case SimdLevel::SSE4:
+			i = convert_f64_f32_sse4(in, n, out);
+			break;
+		default:
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		out[i] = static_cast<float>(in[i]);
+	}
+}
+void pl::convert_i64_f32(const int64_t *in, const size_t n, float *out) {
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	if (simd_level() == SimdLevel::AVX512) {
+		i = convert_i64_f32_avx512(in, n, out);
+	}
+#endif
+	for (; i < n; ++i) {
+		out[i] = static_cast<float>(in[i]);
+	}
+}
+void pl::normalize_u16_u8(const uint16_t *in, const size_t n, uint8_t *out) {
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	switch (simd_level()) {
+		case SimdLevel::AVX512:
+			i = normalize_u16_u8_avx512(in, n, out);
+			break;
+		case SimdLevel::AVX2:
+			i = normalize_u16_u8_avx2(in, n, out);
+			break;
+		case SimdLevel::SSE4:
+			i = normalize_u16_u8_sse4(in, n, out);
+			break;
+		default:
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		out[i] = static_cast<uint8_t>(in[i] / 257);
+	}
+}
+
+void pl::byte_swap(void *data, const size_t n, const size_t element_size) {
+	uint8_t *bytes = static_cast<uint8_t*>(data);
+	const size_t total = n * element_size;
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	if (element_size == 2 || element_size == 4 || element_size == 8) {
+		const uint8_t *mask = BYTE_SWAP_MASKS[element_size == 2 ? 0 : element_size == 4 ? 1 : 2];
+		switch (simd_level()) {
+			case SimdLevel::AVX512:
+				i = byte_swap_avx512(bytes, total, mask);
+				break;
+			case SimdLevel::AVX2:
+				i = byte_swap_avx2(bytes, total, mask);
+				break;
+			case SimdLevel::SSE4:
+				i = byte_swap_sse4(bytes, total, mask);
+				break;
+			default:
+				break;
+		}
+	}
+#endif
+	// The SIMD paths always stop on an element boundary
+	switch (element_size) {
+		case 1:
+			break;
+		case 2:
+			for (; i < total; i += 2) {
+				byte_swap_scalar<uint16_t>(bytes + i);
+			}
+			break;
+		case 4:
+			for (; i < total; i += 4) {
+				byte_swap_scalar<uint32_t>(bytes + i);
+			}
+			break;
+		case 8:
+			for (; i < total; i += 8) {
+				byte_swap_scalar<uint64_t>(bytes + i);
+			}
+			break;
+		default:
+			for (; i < total; i += element_size) {
+				std::reverse(bytes + i, bytes + i + element_size);
+			}
+			break;
+	}
+}
+
+void pl::bounds_f32(const float *in, const size_t n, const size_t components,
+		float *lower, float *upper)
+{
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	switch (components) {
+		case 1:
+			i = bounds_simd<1>(in, n, lower, upper);
+			break;
+		case 2:
+			i = bounds_simd<2>(in, n, lower, upper);
+			break;
+		case 3:
+			i = bounds_simd<3>(in, n, lower, upper);
+			break;
+		case 4:
+			i = bounds_simd<4>(in, n, lower, upper);
+			break;
+		default:
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			const float x = in[i * components + c];
+			lower[c] = std::min(lower[c], x);
+			upper[c] = std::max(upper[c], x);
+		}
+	}
+}
+void pl::scale_offset_f32(const float *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	switch (components) {
+		case 1:
+			i = scale_offset_simd<1>(in, n, scale, offset, out);
+			break;
+		case 2:
+			i = scale_offset_simd<2>(in, n, scale, offset, out);
+			break;
+		case 3:
+			i = scale_offset_simd<3>(in, n, scale, offset, out);
+			break;
+		case 4:
+			i = scale_offset_simd<4>(in, n, scale, offset, out);
+			break;
+		default:
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			const size_t j = i * components + c;
+			out[j] = in[j] * scale[c] + offset[c];
+		}
+	}
+}
+template<typename T>
+static void dequantize(const T *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	switch (components) {
+		case 1:
+			i = dequantize_simd<1>(in, n, scale, offset, out);
+			break;
+		case 2:
+			i = dequantize_simd<2>(in, n, scale, offset, out);
+			break;
+		case 3:
+			i = dequantize_simd<3>(in, n, scale, offset, out);
+			break;
+		case 4:
+			i = dequantize_simd<4>(in, n, scale, offset, out);
+			break;
+		default:
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			const size_t j = i * components + c;
+			out[j] = static_cast<float>(in[j]) * scale[c] + offset[c];
+		}
+	}
+}
+void pl::dequantize_u8_f32(const uint8_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	dequantize(in, n, components, scale, offset, out);
+}
+void pl::dequantize_u16_f32(const uint16_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out)
+{
+	dequantize(in, n, components, scale, offset, out);
+}
+void pl::affine_f32(const float *const *in, const size_t n, const float *m, float *const *out) {
+	size_t i = 0;
+#ifdef PL_X86_KERNELS
+	const SimdLevel level = simd_level();
+	if (level >= SimdLevel::AVX2) {
+		i = affine_avx2(in, n, m, out);
+	} else if (level == SimdLevel::SSE4) {
+		i = affine_sse4(in, n, m, out);
+	}
+#endif
+	for (; i < n; ++i) {
+		const float x = in[0][i];
+		const float y = in[1][i];
+		const float z = in[2][i];
+		for (size_t r = 0; r < 3; ++r) {
+			out[r][i] = m[r * 4] * x + m[r * 4 + 1] * y + m[r * 4 + 2] * z + m[r * 4 + 3];
+		}
+	}
+}
+
+size_t pl::detail::deinterleave_32(const void *in, const size_t n, const size_t components,
+		void **out)
+{
+#ifdef PL_X86_KERNELS
+	if (simd_level() >= SimdLevel::SSE4) {
+		return deinterleave_32_sse4(static_cast<const float*>(in), n, components,
+				reinterpret_cast<float**>(out));
+	}
+#endif
+	return 0;
+}
+size_t pl::detail::interleave_32(const void *const *in, const size_t n, const size_t components,
+		void *out)
+{
+#ifdef PL_X86_KERNELS
+	if (simd_level() >= SimdLevel::SSE4) {
+		return interleave_32_sse4(reinterpret_cast<const float *const *>(in), n, components,
+				static_cast<float*>(out));
+	}
+#endif
+	return 0;
+}
+
+size_t pl::detail::convert_f32_f16(const float *in, const size_t n, uint16_t *out) {
+#ifdef PL_X86_KERNELS
+	if (simd_level() >= SimdLevel::AVX2 && supports_f16c()) {
+		return convert_f32_f16_f16c(in, n, out);
+	}
+#endif
+	return 0;
+}
+size_t pl::detail::convert_f16_f32(const uint16_t *in, const size_t n, float *out) {
+#ifdef PL_X86_KERNELS
+	if (simd_level() >= SimdLevel::AVX2 && supports_f16c()) {
+		return convert_f16_f32_f16c(in, n, out);
+	}
+#endif
+	return 0;
+}
+
+void pl::convert_array(const double *in, const size_t n, float *out) {
+	convert_f64_f32(in, n, out);
+}
+void pl::convert_array(const int64_t *in, const size_t n, float *out) {
+	convert_i64_f32(in, n, out);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pl {
+
+// Instruction sets the kernels have paths for, in increasing order
+enum class SimdLevel {
+	SCALAR,
+	SSE4,
+	AVX2,
+	AVX512
+};
+
+// Get the instruction set used by the kernels. This is the best one the CPU supports,
+// detected on first use, unless it's been lowered by set_simd_level
+SimdLevel simd_level();
+// Make the kernels use a lower instruction set, e.g. to compare the paths. Levels
+// the CPU doesn't support are clamped to the best one it does
+void set_simd_level(const SimdLevel level);
+const char* simd_level_name(const SimdLevel level);
+
+// Convert n elements to floats, rounding to nearest as static_cast does
+void convert_f64_f32(const double *in, const size_t n, float *out);
+void convert_i64_f32(const int64_t *in, const size_t n, float *out);
+// Scale n 16 bit values in [0, 65535] to 8 bits in [0, 255], rounding down
+void normalize_u16_u8(const uint16_t *in, const size_t n, uint8_t *out);
+
+// Reverse the bytes of n elements of element_size bytes in place, e.g. to convert
+// big-endian data read from a file
+void byte_swap(void *data, const size_t n, const size_t element_size);
+template<typename T>
+void byte_swap(T *data, const size_t n) {
+	byte_swap(static_cast<void*>(data), n, sizeof(T));
+}
+
+// Merge the per-component min and max of n records of 1-4 interleaved float components
+// into lower and upper, e.g. 1 for a single stream or 3 for xyz positions. NaNs are ignored
+void bounds_f32(const float *in, const size_t n, const size_t components,
+		float *lower, float *upper);
+// Compute out = in * scale + offset for n records of 1-4 interleaved float components,
+// with a scale and offset per component. in and out may be the same array
+void scale_offset_f32(const float *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out);
+// Compute out = in * scale + offset for n records of 1-4 interleaved unsigned integer
+// components, with a scale and offset per component, e.g. to decode quantized positions
+void dequantize_u8_f32(const uint8_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out);
+void dequantize_u16_f32(const uint16_t *in, const size_t n, const size_t components,
+		const float *scale, const float *offset, float *out);
+// Apply the row-major 3x4 affine transform m to n points stored as x, y and z streams
+// in in, writing to the streams in out. in and out may be the same streams
+void affine_f32(const float *const *in, const size_t n, const float *m, float *const *out);
+
+namespace detail {
+
+// SIMD paths for 32 bit elements with 2, 3 or 4 components. They return the number of
+// records processed, the caller handles the remaining ones
+size_t deinterleave_32(const void *in, const size_t n, const size_t components, void **out);
+size_t interleave_32(const void *const *in, const size_t n, const size_t components, void *out);
+// F16C paths for the half precision conversions in quantize.h, used at the AVX2 level and
+// above if the CPU has F16C. They return the number of elements converted
+size_t convert_f32_f16(const float *in, const size_t n, uint16_t *out);
+size_t convert_f16_f32(const uint16_t *in, const size_t n, float *out);
+
+}
+
+// Split n records of interleaved components in into one array per component,
+// component c of record i is written to out[c][i]
+template<typename T>
+void deinterleave(const T *in, const size_t n, const size_t components, T *const *out) {
+	size_t i = 0;
+	if (sizeof(T) == 4 && components >= 2 && components <= 4) {
+		void *streams[4];
+		for (size_t c = 0; c < components; ++c) {
+			streams[c] = out[c];
+		}
+		i = detail::deinterleave_32(in, n, components, streams);
+	}
+	for (; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			out[c][i] = in[i * components + c];
+		}
+	}
+}
+
+// Interleave n elements from each component array in into records in out,
+// in[c][i] is written to component c of record i
+template<typename T>
+void interleave(const T *const *in, const size_t n, const size_t components, T *out) {
+	size_t i = 0;
+	if (sizeof(T) == 4 && components >= 2 && components <= 4) {
+		const void *streams[4];
+		for (size_t c = 0; c < components; ++c) {
+			streams[c] = in[c];
+		}
+		i = detail::interleave_32(streams, n, components, out);
+	}
+	for (; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			out[i * components + c] = in[c][i];
+		}
+	}
+}
+
+}
@@ -0,0 +1,36 @@
+#include <type_traits>
+#include "layout.h"
+#include "view.h"
+
+using namespace pl;
+
+std::shared_ptr<Data> pl::to_layout(const std::shared_ptr<Data> &data, const Layout layout) {
+	if (data->layout == layout || data->components == 1) {
+		return data;
+	}
+	if (data->stride() != 1) {
+		return to_layout(materialize(*data), layout);
+	}
+	std::shared_ptr<Data> result;
+	visit(*data, [&](const auto &view) {
+		using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+		auto transposed = std::make_shared<DataT<T>>();
+		transposed->data.resize(view.size());
+		const size_t n = view.size() / data->components;
+		if (layout == Layout::SOA) {
+			aos_to_soa(view.data(), transposed->data.data(), n, data->components);
+		} else {
+			soa_to_aos(view.data(), transposed->data.data(), n, data->components);
+		}
+		result = transposed;
+	});
+	result->components = data->components;
+	result->layout = layout;
+	return result;
+}
+
+void pl::set_layout(ParticleModel &model, const Layout layout) {
+	for (auto &d : model) {
+		d.second = to_layout(d.second, layout);
+	}
+}
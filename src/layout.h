@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "types.h"
+#include "kernels.h"
+#include "parallel.h"
+
+namespace pl {
+
+namespace detail {
+
+// Number of particles transposed at a time, sized so a block of
+// particles stays in L1 while its components are scattered out
+const size_t TRANSPOSE_BLOCK = 1024;
+const size_t TRANSPOSE_GRAIN = 64 * TRANSPOSE_BLOCK;
+
+}
+
+// Addressing of the components of each particle in the raw_data of an array, for
+// either layout. Component c of particle i is at i * particle_stride + c * component_stride
+struct ComponentStrides {
+	size_t particle_stride;
+	size_t component_stride;
+
+	ComponentStrides(const Data &data)
+		: particle_stride(data.stride() * (data.layout == Layout::AOS ? data.components : 1)),
+		component_stride(data.stride() * (data.layout == Layout::AOS ? 1 : data.count()))
+	{}
+};
+
+// Transpose n particles with interleaved components in aos to one contiguous
+// stream per component in soa. Arrays of 2-4 component 32 bit types use the SIMD kernels
+template<typename T>
+void aos_to_soa(const T *aos, T *soa, const size_t n, const size_t components) {
+	parallel_for(0, n, detail::TRANSPOSE_GRAIN, [&](const size_t begin, const size_t end) {
+		std::vector<T*> out(components);
+		for (size_t b = begin; b < end; b += detail::TRANSPOSE_BLOCK) {
+			const size_t e = std::min(b + detail::TRANSPOSE_BLOCK, end);
+			for (size_t c = 0; c < components; ++c) {
+				out[c] = soa + c * n + b;
+			}
+			deinterleave(aos + b * components, e - b, components, out.data());
+		}
+	});
+}
+
+// Transpose n particles stored as one contiguous stream per component in soa
+// to interleaved components in aos, the inverse of aos_to_soa
+template<typename T>
+void soa_to_aos(const T *soa, T *aos, const size_t n, const size_t components) {
+	parallel_for(0, n, detail::TRANSPOSE_GRAIN, [&](const size_t begin, const size_t end) {
+		std::vector<const T*> in(components);
+		for (size_t b = begin; b < end; b += detail::TRANSPOSE_BLOCK) {
+			const size_t e = std::min(b + detail::TRANSPOSE_BLOCK, end);
+			for (size_t c = 0; c < components; ++c) {
+				in[c] = soa + c * n + b;
+			}
+			interleave(in.data(), e - b, components, aos + b * components);
+		}
+	});
+}
+
+// Get the data in the requested layout. If the data is already in this layout
+// it's returned as is, otherwise a transposed copy is returned
+std::shared_ptr<Data> to_layout(const std::shared_ptr<Data> &data, const Layout layout);
+
+// Transpose all the multi-component arrays in the model to the layout
+void set_layout(ParticleModel &model, const Layout layout);
+
+}
@@ -0,0 +1,94 @@
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "mapped_file.h"
+
+using namespace pl;
+
+#ifdef _WIN32
+MappedFile::MappedFile(const FileName &file_name)
+	: mapping(nullptr), file_size(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr)
+{
+	file_handle = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("could not open file " + file_name.file_name);
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file_handle, &size);
+	file_size = static_cast<size_t>(size.QuadPart);
+	if (file_size == 0) {
+		return;
+	}
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (!mapping_handle) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("could not map file " + file_name.file_name);
+	}
+	mapping = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0));
+	if (!mapping) {
+		CloseHandle(mapping_handle);
+		CloseHandle(file_handle);
+		throw std::runtime_error("could not map file " + file_name.file_name);
+	}
+}
+MappedFile::~MappedFile() {
+	if (mapping) {
+		UnmapViewOfFile(mapping);
+	}
+	if (mapping_handle) {
+		CloseHandle(mapping_handle);
+	}
+	CloseHandle(file_handle);
+}
+#else
+MappedFile::MappedFile(const FileName &file_name) : mapping(nullptr), file_size(0) {
+	const int fd = open(file_name.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("could not open file " + file_name.file_name);
+	}
+	struct stat stats;
+	if (fstat(fd, &stats) == -1) {
+		close(fd);
+		throw std::runtime_error("could not stat file " + file_name.file_name);
+	}
+	file_size = static_cast<size_t>(stats.st_size);
+	if (file_size == 0) {
+		close(fd);
+		return;
+	}
+	void *m = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// The mapping holds its own reference to the file
+	close(fd);
+	if (m == MAP_FAILED) {
+		throw std::runtime_error("could not map file " + file_name.file_name);
+	}
+	mapping = static_cast<char*>(m);
+}
+MappedFile::~MappedFile() {
+	if (mapping) {
+		munmap(mapping, file_size);
+	}
+}
+#endif
+char* MappedFile::data() {
+	return mapping;
+}
+const char* MappedFile::data() const {
+	return mapping;
+}
+size_t MappedFile::size() const {
+	return file_size;
+}
+
+bool pl::host_is_little_endian() {
+	const uint16_t x = 1;
+	return *reinterpret_cast<const uint8_t*>(&x) == 1;
+}
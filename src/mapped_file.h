@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include "types.h"
+#include "buffer.h"
+#include "kernels.h"
+#include "parallel.h"
+
+namespace pl {
+
+// A file mapped into memory. The pages are mapped copy-on-write, so arrays
+// aliasing the mapping can be modified in place without changing the file
+class MappedFile {
+	char *mapping;
+	size_t file_size;
+#ifdef _WIN32
+	void *file_handle;
+	void *mapping_handle;
+#endif
+
+public:
+	MappedFile(const FileName &file_name);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile& operator=(const MappedFile &) = delete;
+
+	char* data();
+	const char* data() const;
+	size_t size() const;
+};
+
+bool host_is_little_endian();
+
+// An array of T aliasing a region of a mapped file. The data is never copied,
+// and the mapping is kept alive as long as some array refers to it
+template<typename T>
+struct MappedDataT : ExternalDataT<T> {
+	MappedDataT(const std::shared_ptr<MappedFile> &file, const size_t offset, const size_t count)
+		: ExternalDataT<T>(reinterpret_cast<T*>(file->data() + offset), count, file)
+	{}
+};
+
+// Get count little-endian T's starting at offset bytes into the file. The
+// mapping is aliased directly when possible, if the data is misaligned or
+// the host is big-endian it's copied out into a DataT instead
+template<typename T>
+std::shared_ptr<Data> map_array(const std::shared_ptr<MappedFile> &file, const size_t offset,
+		const size_t count)
+{
+	if (offset > file->size() || count > (file->size() - offset) / sizeof(T)) {
+		throw std::runtime_error("map_array: array extends past the end of the file");
+	}
+	const char *begin = file->data() + offset;
+	const bool aligned = reinterpret_cast<uintptr_t>(begin) % alignof(T) == 0;
+	if (aligned && host_is_little_endian()) {
+		return std::make_shared<MappedDataT<T>>(file, offset, count);
+	}
+
+	auto data = std::make_shared<DataT<T>>();
+	data->data.resize(count);
+	T *out = data->data.data();
+	parallel_for(0, count, 1 << 16, [&](const size_t b, const size_t e) {
+		std::memcpy(out + b, begin + b * sizeof(T), (e - b) * sizeof(T));
+	});
+	if (!host_is_little_endian()) {
+		byte_swap(out, count);
+	}
+	return data;
+}
+
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <iomanip>
+#include "memory_report.h"
+
+using namespace pl;
+
+std::vector<AttributeFootprint> pl::model_footprint(const ParticleModel &model) {
+	std::vector<AttributeFootprint> footprint;
+	for (const auto &a : model) {
+		footprint.push_back(AttributeFootprint{a.first, type_name(a.second->type()),
+				a.second->count(), a.second->components, a.second->bytes()});
+	}
+	std::sort(footprint.begin(), footprint.end(),
+			[](const AttributeFootprint &a, const AttributeFootprint &b) {
+				return a.name < b.name;
+			});
+	return footprint;
+}
+size_t pl::model_bytes(const ParticleModel &model) {
+	size_t total = 0;
+	for (const auto &a : model) {
+		total += a.second->bytes();
+	}
+	return total;
+}
+void pl::print_footprint(std::ostream &os, const ParticleModel &model) {
+	os << "Model memory footprint:\n";
+	for (const auto &a : model_footprint(model)) {
+		os << "\t" << a.name << ": " << a.count << " x " << a.components << " " << a.type
+			<< ", " << a.bytes << " bytes\n";
+	}
+	os << "\ttotal: " << model_bytes(model) << " bytes\n";
+}
+
+std::string pl::type_name(const std::type_info &type) {
+	if (type == typeid(float)) {
+		return "float";
+	} else if (type == typeid(double)) {
+		return "double";
+	} else if (type == typeid(int8_t)) {
+		return "int8";
+	} else if (type == typeid(uint8_t)) {
+		return "uint8";
+	} else if (type == typeid(int16_t)) {
+		return "int16";
+	} else if (type == typeid(uint16_t)) {
+		return "uint16";
+	} else if (type == typeid(int32_t)) {
+		return "int32";
+	} else if (type == typeid(uint32_t)) {
+		return "uint32";
+	} else if (type == typeid(int64_t)) {
+		return "int64";
+	} else if (type == typeid(uint64_t)) {
+		return "uint64";
+	}
+	return type.name();
+}
+
+AllocationTracker::AllocationTracker(const std::shared_ptr<MemoryResource> &upstream)
+	: upstream(upstream ? upstream : default_resource()), current(0), peak(0)
+{}
+void* AllocationTracker::allocate(const size_t bytes, const size_t alignment) {
+	void *ptr = upstream->allocate(bytes, alignment);
+	std::lock_guard<std::mutex> lock(mutex);
+	current += bytes;
+	peak = std::max(peak, current);
+	for (auto &p : phases) {
+		if (p.running) {
+			p.peak_bytes = std::max(p.peak_bytes, current);
+			p.allocated_bytes += bytes;
+		}
+	}
+	return ptr;
+}
+void AllocationTracker::deallocate(void *ptr, const size_t bytes, const size_t alignment) {
+	upstream->deallocate(ptr, bytes, alignment);
+	std::lock_guard<std::mutex> lock(mutex);
+	current -= bytes;
+}
+const std::shared_ptr<MemoryResource>& AllocationTracker::upstream_resource() const {
+	return upstream;
+}
+size_t AllocationTracker::current_bytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+size_t AllocationTracker::peak_bytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return peak;
+}
+size_t AllocationTracker::begin_phase(const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	phases.push_back(Phase{name, current, current, current, 0, true});
+	return phases.size() - 1;
+}
+void AllocationTracker::end_phase(const size_t phase) {
+	std::lock_guard<std::mutex> lock(mutex);
+	phases.at(phase).end_bytes = current;
+	phases.at(phase).running = false;
+}
+std::vector<AllocationTracker::Phase> AllocationTracker::phase_report() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<Phase> report = phases;
+	for (auto &p : report) {
+		if (p.running) {
+			p.end_bytes = current;
+		}
+	}
+	return report;
+}
+void AllocationTracker::print_report(std::ostream &os) {
+	const auto report = phase_report();
+	os << "Tracked allocations: " << current_bytes() << " bytes current, "
+		<< peak_bytes() << " bytes peak\n";
+	for (const auto &p : report) {
+		os << "\t" << p.name << ": peak " << p.peak_bytes << " bytes, allocated "
+			<< p.allocated_bytes << " bytes, " << p.start_bytes << " -> " << p.end_bytes
+			<< " bytes" << (p.running ? " (running)" : "") << "\n";
+	}
+}
+
+static std::shared_ptr<AllocationTracker>& active_tracker() {
+	static std::shared_ptr<AllocationTracker> tracker;
+	return tracker;
+}
+std::shared_ptr<AllocationTracker> pl::enable_allocation_tracking() {
+	auto tracker = allocation_tracker();
+	if (tracker) {
+		return tracker;
+	}
+	tracker = std::make_shared<AllocationTracker>(default_resource());
+	set_default_resource(tracker);
+	std::atomic_store(&active_tracker(), tracker);
+	return tracker;
+}
+void pl::disable_allocation_tracking() {
+	auto tracker = std::atomic_exchange(&active_tracker(), std::shared_ptr<AllocationTracker>());
+	if (tracker) {
+		set_default_resource(tracker->upstream_resource());
+	}
+}
+std::shared_ptr<AllocationTracker> pl::allocation_tracker() {
+	return std::atomic_load(&active_tracker());
+}
+
+AllocationPhase::AllocationPhase(const std::string &name)
+	: tracker(allocation_tracker()), phase(0)
+{
+	if (tracker) {
+		phase = tracker->begin_phase(name);
+	}
+}
+AllocationPhase::~AllocationPhase() {
+	if (tracker) {
+		tracker->end_phase(phase);
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+// The memory used by an attribute of a model
+struct AttributeFootprint {
+	std::string name;
+	// Readable name of the element type, e.g. float or uint16
+	std::string type;
+	size_t count;
+	size_t components;
+	size_t bytes;
+};
+
+// Get the memory used by each attribute of the model, sorted by name
+std::vector<AttributeFootprint> model_footprint(const ParticleModel &model);
+// Get the total memory used by the arrays of the model
+size_t model_bytes(const ParticleModel &model);
+void print_footprint(std::ostream &os, const ParticleModel &model);
+
+// Get a readable name for the scalar types supported by DataT
+std::string type_name(const std::type_info &type);
+
+// Wraps another resource and tracks the bytes currently allocated through it and the
+// peak, overall and for each phase of an import, e.g. parsing the header, reading the
+// payload and converting it.
+class AllocationTracker : public MemoryResource {
+public:
+	struct Phase {
+		std::string name;
+		// Bytes allocated through the tracker when the phase began and ended
+		size_t start_bytes;
+		size_t end_bytes;
+		// The most bytes allocated at once while the phase was running
+		size_t peak_bytes;
+		// Total bytes allocated during the phase, including ones since freed
+		size_t allocated_bytes;
+		bool running;
+	};
+
+private:
+	std::shared_ptr<MemoryResource> upstream;
+	std::mutex mutex;
+	size_t current;
+	size_t peak;
+	std::vector<Phase> phases;
+
+public:
+	AllocationTracker(const std::shared_ptr<MemoryResource> &upstream = nullptr);
+	void* allocate(const size_t bytes, const size_t alignment) override;
+	void deallocate(void *ptr, const size_t bytes, const size_t alignment) override;
+
+	const std::shared_ptr<MemoryResource>& upstream_resource() const;
+	size_t current_bytes();
+	size_t peak_bytes();
+	// Begin a new phase and return its index, phases can be nested
+	size_t begin_phase(const std::string &name);
+	void end_phase(const size_t phase);
+	std::vector<Phase> phase_report();
+	void print_report(std::ostream &os);
+};
+
+// Track the allocations made through the default resource, by replacing it with
+// a tracker wrapping it. Only memory allocated through memory resources is tracked,
+// not allocations made by third party parsers. Returns the tracker
+std::shared_ptr<AllocationTracker> enable_allocation_tracking();
+// Stop tracking and restore the default resource the tracker was wrapping
+void disable_allocation_tracking();
+// Get the active tracker, or null if tracking isn't enabled
+std::shared_ptr<AllocationTracker> allocation_tracker();
+
+// Marks a phase on the active tracker for the lifetime of the object,
+// does nothing if tracking isn't enabled
+class AllocationPhase {
+	std::shared_ptr<AllocationTracker> tracker;
+	size_t phase;
+
+public:
+	AllocationPhase(const std::string &name);
+	~AllocationPhase();
+	AllocationPhase(const AllocationPhase &) = delete;
+	AllocationPhase& operator=(const AllocationPhase &) = delete;
+};
+
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "memory_resource.h"
+
+using namespace pl;
+
+static size_t round_up(const size_t x, const size_t multiple) {
+	return ((x + multiple - 1) / multiple) * multiple;
+}
+
+const size_t LargeBufferResource::LARGE_ALLOCATION;
+
+LargeBufferResource::LargeBufferResource(const bool huge_pages) : huge_pages(huge_pages) {}
+void* LargeBufferResource::allocate(const size_t bytes, const size_t alignment) {
+	const size_t align = std::max(alignment, CACHE_LINE_SIZE);
+#ifdef _WIN32
+	void *ptr = _aligned_malloc(bytes, align);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+#else
+	if (bytes < LARGE_ALLOCATION) {
+		void *ptr = nullptr;
+		if (posix_memalign(&ptr, align, bytes) != 0) {
+			throw std::bad_alloc();
+		}
+		return ptr;
+	}
+	// Over-allocate by a huge page so we can trim the mapping to start on a huge
+	// page boundary, which lets the kernel back it with huge pages
+	const size_t size = round_up(bytes, LARGE_ALLOCATION);
+	void *mapping = mmap(nullptr, size + LARGE_ALLOCATION, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	char *begin = static_cast<char*>(mapping);
+	char *aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(begin),
+				LARGE_ALLOCATION));
+	if (aligned != begin) {
+		munmap(begin, aligned - begin);
+	}
+	munmap(aligned + size, begin + LARGE_ALLOCATION - aligned);
+#ifdef MADV_HUGEPAGE
+	if (huge_pages) {
+		madvise(aligned, size, MADV_HUGEPAGE);
+	}
+#endif
+	return aligned;
+#endif
+}
+void LargeBufferResource::deallocate(void *ptr, const size_t bytes, const size_t) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	if (bytes < LARGE_ALLOCATION) {
+		free(ptr);
+	} else {
+		munmap(ptr, round_up(bytes, LARGE_ALLOCATION));
+	}
+#endif
+}
+
+static std::shared_ptr<MemoryResource>& default_memory_resource() {
+	static std::shared_ptr<MemoryResource> resource = std::make_shared<LargeBufferResource>();
+	return resource;
+}
+std::shared_ptr<MemoryResource> pl::default_resource() {
+	return std::atomic_load(&default_memory_resource());
+}
+void pl::set_default_resource(const std::shared_ptr<MemoryResource> &resource) {
+	std::atomic_store(&default_memory_resource(), resource);
+}
+
+Arena::Arena(const size_t block_size, const std::shared_ptr<MemoryResource> &upstream)
+	: upstream(upstream ? upstream : default_resource()), block_size(block_size),
+	next(nullptr), remaining(0), reserved(0)
+{}
+Arena::~Arena() {
+	for (const auto &b : blocks) {
+		upstream->deallocate(b.first, b.second, CACHE_LINE_SIZE);
+	}
+}
+void* Arena::allocate(const size_t bytes, const size_t alignment) {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+	if (next && padding + bytes <= remaining) {
+		char *ptr = next + padding;
+		next += padding + bytes;
+		remaining -= padding + bytes;
+		return ptr;
+	}
+
+	// Allocations larger than a block get a block of their own, and we keep
+	// filling the current block
+	const size_t size = std::max(block_size, bytes + alignment);
+	char *block = static_cast<char*>(upstream->allocate(size, CACHE_LINE_SIZE));
+	blocks.emplace_back(block, size);
+	reserved += size;
+	padding = (alignment - reinterpret_cast<uintptr_t>(block) % alignment) % alignment;
+	if (size == block_size) {
+		next = block + padding + bytes;
+		remaining = size - padding - bytes;
+	}
+	return block + padding;
+}
+void Arena::deallocate(void *, const size_t, const size_t) {}
+size_t Arena::reserved_bytes() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return reserved;
+}
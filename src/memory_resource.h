@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "parallel.h"
+
+namespace pl {
+
+// The memory backing particle arrays and models, similar to std::pmr::memory_resource
+struct MemoryResource {
+	virtual void* allocate(const size_t bytes, const size_t alignment) = 0;
+	virtual void deallocate(void *ptr, const size_t bytes, const size_t alignment) = 0;
+	virtual ~MemoryResource(){}
+};
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Allocates memory aligned to at least a cache line. Large allocations are mapped
+// directly from the OS and, if huge_pages is set, are advised to be backed by
+// transparent huge pages.
+class LargeBufferResource : public MemoryResource {
+	bool huge_pages;
+
+public:
+	// Allocations at least this large are mapped from the OS
+	static const size_t LARGE_ALLOCATION = 2 * 1024 * 1024;
+
+	LargeBufferResource(const bool huge_pages = false);
+	void* allocate(const size_t bytes, const size_t alignment) override;
+	void deallocate(void *ptr, const size_t bytes, const size_t alignment) override;
+};
+
+// Get the default resource, used by arrays and models not given a resource. This
+// is a LargeBufferResource without huge pages unless changed by set_default_resource
+std::shared_ptr<MemoryResource> default_resource();
+void set_default_resource(const std::shared_ptr<MemoryResource> &resource);
+
+// An arena which carves allocations out of a few large blocks. Deallocation is a
+// no-op, all the blocks are released at once when the arena is destroyed. This
+// makes it a good fit for data which is loaded and dropped together, e.g. all
+// the timesteps of a trajectory. The blocks are allocated from an upstream
+// resource, or the default resource if none is given.
+class Arena : public MemoryResource {
+	std::mutex mutex;
+	std::shared_ptr<MemoryResource> upstream;
+	// The blocks allocated and their sizes
+	std::vector<std::pair<char*, size_t>> blocks;
+	size_t block_size;
+	char *next;
+	size_t remaining;
+	size_t reserved;
+
+public:
+	Arena(const size_t block_size = 32 * 1024 * 1024,
+			const std::shared_ptr<MemoryResource> &upstream = nullptr);
+	~Arena();
+	Arena(const Arena &) = delete;
+	Arena& operator=(const Arena &) = delete;
+
+	void* allocate(const size_t bytes, const size_t alignment) override;
+	void deallocate(void *ptr, const size_t bytes, const size_t alignment) override;
+	// Get the total size of the blocks allocated by the arena
+	size_t reserved_bytes();
+};
+
+// An STL allocator which allocates from a MemoryResource. The allocator holds
+// a reference to the resource, keeping it alive while containers use it
+template<typename T>
+struct ResourceAllocator {
+	using value_type = T;
+
+	std::shared_ptr<MemoryResource> resource;
+
+	ResourceAllocator(const std::shared_ptr<MemoryResource> &resource = nullptr)
+		: resource(resource ? resource : default_resource())
+	{}
+	template<typename U>
+	ResourceAllocator(const ResourceAllocator<U> &a) : resource(a.resource) {}
+
+	// Elements are default initialized instead of value initialized, so resizing
+	// an array of scalars leaves the new elements uninitialized instead of zero
+	// filling them just before they're overwritten
+	template<typename U>
+	void construct(U *ptr) {
+		::new(static_cast<void*>(ptr)) U;
+	}
+	template<typename U, typename... Args>
+	void construct(U *ptr, Args&&... args) {
+		::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+	}
+
+	T* allocate(const size_t n) {
+		return static_cast<T*>(resource->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T *ptr, const size_t n) {
+		resource->deallocate(ptr, n * sizeof(T), alignof(T));
+	}
+};
+
+// Touch the pages of the array from the threads parallel_for assigns them to, so on
+// NUMA systems the pages are placed on the nodes of the threads which will process them.
+// The first element of each page touched is zeroed.
+template<typename T>
+void first_touch(T *array, const size_t n) {
+	const size_t page_elements = std::max(size_t(4096) / sizeof(T), size_t(1));
+	parallel_for(0, n, page_elements, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i += page_elements) {
+			array[i] = T();
+		}
+	});
+}
+
+template<typename T, typename U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) {
+	return a.resource == b.resource;
+}
+template<typename T, typename U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) {
+	return a.resource != b.resource;
+}
+
+}
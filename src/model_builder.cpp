@@ -0,0 +1,177 @@
+#include <algorithm>
+#include "model_builder.h"
+
+using namespace pl;
+
+ChunkedData::ChunkedData(const std::vector<std::shared_ptr<Data>> &chunks)
+	: chunks(chunks), offsets(1, 0)
+{
+	if (chunks.empty()) {
+		throw std::runtime_error("ChunkedData: at least one chunk is required");
+	}
+	components = chunks[0]->components;
+	for (const auto &c : chunks) {
+		if (c->type() != chunks[0]->type() || c->components != components) {
+			throw std::runtime_error("ChunkedData: chunks must have the same type and components");
+		}
+		offsets.push_back(offsets.back() + c->size());
+	}
+}
+size_t ChunkedData::find_chunk(const size_t i) const {
+	return std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+}
+const std::type_info& ChunkedData::type() const {
+	return chunks[0]->type();
+}
+void ChunkedData::write(std::ofstream &os) const {
+	for (const auto &c : chunks) {
+		c->write(os);
+	}
+}
+float ChunkedData::get_float(const size_t i) const {
+	const size_t c = find_chunk(i);
+	return chunks[c]->get_float(i - offsets[c]);
+}
+size_t ChunkedData::size() const {
+	return offsets.back();
+}
+void ChunkedData::get_floats(const size_t begin, const size_t end, float *out) const {
+	for (size_t i = begin, c = find_chunk(begin); i < end; ++c) {
+		const size_t n = std::min(end, offsets[c + 1]) - i;
+		chunks[c]->get_floats(i - offsets[c], i - offsets[c] + n, out + i - begin);
+		i += n;
+	}
+}
+void ChunkedData::get_doubles(const size_t begin, const size_t end, double *out) const {
+	for (size_t i = begin, c = find_chunk(begin); i < end; ++c) {
+		const size_t n = std::min(end, offsets[c + 1]) - i;
+		chunks[c]->get_doubles(i - offsets[c], i - offsets[c] + n, out + i - begin);
+		i += n;
+	}
+}
+void ChunkedData::get_values(const size_t begin, const size_t end, void *out) const {
+	const size_t element_size = type_size(type());
+	for (size_t i = begin, c = find_chunk(begin); i < end; ++c) {
+		const size_t n = std::min(end, offsets[c + 1]) - i;
+		chunks[c]->get_values(i - offsets[c], i - offsets[c] + n,
+				static_cast<char*>(out) + (i - begin) * element_size);
+		i += n;
+	}
+}
+bool ChunkedData::can_get_values() const {
+	return std::all_of(chunks.begin(), chunks.end(), [](const std::shared_ptr<Data> &c) {
+		return c->can_get_values();
+	});
+}
+void* ChunkedData::raw_data() {
+	return chunks.size() == 1 ? chunks[0]->raw_data() : nullptr;
+}
+const void* ChunkedData::raw_data() const {
+	return chunks.size() == 1 ? static_cast<const Data&>(*chunks[0]).raw_data() : nullptr;
+}
+size_t ChunkedData::bytes() const {
+	size_t total = offsets.capacity() * sizeof(size_t);
+	for (const auto &c : chunks) {
+		total += c->bytes();
+	}
+	return total;
+}
+size_t ChunkedData::num_chunks() const {
+	return chunks.size();
+}
+const std::shared_ptr<Data>& ChunkedData::chunk(const size_t i) const {
+	return chunks[i];
+}
+
+ParticleModelBuilder::ParticleModelBuilder(const std::shared_ptr<MemoryResource> &resource)
+	: resource(resource)
+{}
+size_t ParticleModelBuilder::add_attribute(const std::string &name, const size_t components,
+		const std::type_info &type,
+		std::shared_ptr<Data> (*make_array)(const std::shared_ptr<MemoryResource>&),
+		std::shared_ptr<Data> (*gather)(const std::vector<const Data*>&,
+			const std::vector<size_t>&, const std::shared_ptr<MemoryResource>&))
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		if (attributes[i].name == name) {
+			if (*attributes[i].type != type || attributes[i].components != components) {
+				throw std::runtime_error("ParticleModelBuilder: attribute " + name
+						+ " was already added with a different type");
+			}
+			return i;
+		}
+	}
+	if (!chunks.empty()) {
+		throw std::runtime_error("ParticleModelBuilder: attributes must be added before chunks");
+	}
+	attributes.push_back(Attribute{name, components, &type, make_array, gather});
+	return attributes.size() - 1;
+}
+size_t ParticleModelBuilder::attribute(const std::string &name) const {
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		if (attributes[i].name == name) {
+			return i;
+		}
+	}
+	throw std::runtime_error("ParticleModelBuilder: no attribute named " + name);
+}
+size_t ParticleModelBuilder::num_attributes() const {
+	return attributes.size();
+}
+size_t ParticleModelBuilder::add_chunks(const size_t n) {
+	std::lock_guard<std::mutex> lock(mutex);
+	const size_t first = chunks.size();
+	for (size_t i = 0; i < n; ++i) {
+		// The chunks are temporary, so they're allocated from the default resource
+		chunks.emplace_back();
+		for (const auto &a : attributes) {
+			chunks.back().arrays.push_back(a.make_array(nullptr));
+			chunks.back().arrays.back()->components = a.components;
+		}
+	}
+	return first;
+}
+ParticleChunk& ParticleModelBuilder::chunk(const size_t i) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return chunks.at(i);
+}
+size_t ParticleModelBuilder::num_chunks() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return chunks.size();
+}
+void ParticleModelBuilder::finalize(ParticleModel &model, const bool chunked) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t a = 0; a < attributes.size(); ++a) {
+		std::vector<std::shared_ptr<Data>> arrays;
+		for (auto &c : chunks) {
+			if (c.arrays[a]->size() != 0) {
+				arrays.push_back(c.arrays[a]);
+			}
+		}
+		if (arrays.empty()) {
+			continue;
+		}
+
+		std::shared_ptr<Data> data;
+		// The chunks were allocated from the default resource, so a single chunk
+		// is only kept as-is if that's where the array should live anyway
+		if (arrays.size() == 1 && (chunked || !resource)) {
+			data = arrays[0];
+		} else if (chunked) {
+			data = std::make_shared<ChunkedData>(arrays);
+		} else {
+			std::vector<const Data*> in;
+			std::vector<size_t> offsets(1, 0);
+			for (const auto &x : arrays) {
+				in.push_back(x.get());
+				offsets.push_back(offsets.back() + x->size());
+			}
+			data = attributes[a].gather(in, offsets, resource);
+		}
+		data->components = attributes[a].components;
+		model[attributes[a].name] = data;
+	}
+	chunks.clear();
+	attributes.clear();
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "parallel.h"
+
+namespace pl {
+
+// An array stored as a sequence of chunk arrays, read through without
+// gathering them into one contiguous array
+class ChunkedData : public Data {
+	std::vector<std::shared_ptr<Data>> chunks;
+	// The index of the first element of each chunk, and the total size at the end
+	std::vector<size_t> offsets;
+
+	// Get the chunk containing element i
+	size_t find_chunk(const size_t i) const;
+
+public:
+	// The chunks must all have the same type and number of components
+	ChunkedData(const std::vector<std::shared_ptr<Data>> &chunks);
+
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	void get_values(const size_t begin, const size_t end, void *out) const override;
+	bool can_get_values() const override;
+	// The raw data is only available if there is a single chunk
+	void* raw_data() override;
+	const void* raw_data() const override;
+	size_t bytes() const override;
+	size_t num_chunks() const;
+	const std::shared_ptr<Data>& chunk(const size_t i) const;
+};
+
+// A chunk of particles being built, holding an array for each attribute of the builder.
+// Each array of a chunk should only be written to by one thread at a time, but
+// different chunks can be filled in parallel
+class ParticleChunk {
+	std::vector<std::shared_ptr<Data>> arrays;
+
+	friend class ParticleModelBuilder;
+
+public:
+	// Get the array for an attribute, T must match the type the attribute was added with
+	template<typename T>
+	DataT<T>& array(const size_t attribute) {
+		auto *a = dynamic_cast<DataT<T>*>(arrays.at(attribute).get());
+		if (!a) {
+			throw std::runtime_error(std::string("ParticleChunk: attribute is not an array of ")
+					+ typeid(T).name());
+		}
+		return *a;
+	}
+	// Append n elements to the attribute
+	template<typename T>
+	void append(const size_t attribute, const T *values, const size_t n) {
+		auto &a = array<T>(attribute);
+		a.data.insert(a.data.end(), values, values + n);
+	}
+};
+
+// Builds a ParticleModel from particles loaded by multiple threads. Each worker
+// appends to its own chunks, finalize then concatenates the chunks of each
+// attribute in the order the chunks were added.
+//
+// All attributes must be added before adding the first chunk.
+class ParticleModelBuilder {
+	struct Attribute {
+		std::string name;
+		size_t components;
+		const std::type_info *type;
+		std::shared_ptr<Data> (*make_array)(const std::shared_ptr<MemoryResource> &resource);
+		std::shared_ptr<Data> (*gather)(const std::vector<const Data*> &chunks,
+				const std::vector<size_t> &offsets, const std::shared_ptr<MemoryResource> &resource);
+	};
+
+	std::shared_ptr<MemoryResource> resource;
+	std::vector<Attribute> attributes;
+	std::deque<ParticleChunk> chunks;
+	std::mutex mutex;
+
+	template<typename T>
+	static std::shared_ptr<Data> make_array(const std::shared_ptr<MemoryResource> &resource);
+	template<typename T>
+	static std::shared_ptr<Data> gather(const std::vector<const Data*> &chunks,
+			const std::vector<size_t> &offsets, const std::shared_ptr<MemoryResource> &resource);
+
+	size_t add_attribute(const std::string &name, const size_t components,
+			const std::type_info &type,
+			std::shared_ptr<Data> (*make_array)(const std::shared_ptr<MemoryResource>&),
+			std::shared_ptr<Data> (*gather)(const std::vector<const Data*>&,
+				const std::vector<size_t>&, const std::shared_ptr<MemoryResource>&));
+
+public:
+	// The gathered arrays are allocated from the resource, or the default resource if
+	// null. Chunks are always allocated from the default resource
+	ParticleModelBuilder(const std::shared_ptr<MemoryResource> &resource = nullptr);
+	ParticleModelBuilder(const ParticleModelBuilder &) = delete;
+	ParticleModelBuilder& operator=(const ParticleModelBuilder &) = delete;
+
+	// Add an attribute of T with some number of components per particle and return its index.
+	// If the attribute was already added its index is returned
+	template<typename T>
+	size_t add_attribute(const std::string &name, const size_t components = 1) {
+		return add_attribute(name, components, typeid(T), &make_array<T>, &gather<T>);
+	}
+	// Get the index of an attribute, or throw if it wasn't added
+	size_t attribute(const std::string &name) const;
+	size_t num_attributes() const;
+	// Add n new chunks and return the index of the first. Chunks can be added by
+	// multiple threads, but to get a deterministic particle order they should be
+	// added up front, e.g. one per file or patch being loaded
+	size_t add_chunks(const size_t n = 1);
+	ParticleChunk& chunk(const size_t i);
+	size_t num_chunks();
+	// Write the attributes into the model, overwriting any existing arrays of the same name.
+	// The chunks of each attribute are gathered in parallel into a contiguous array, or,
+	// if chunked is set, kept as they are in a ChunkedData. Attributes with no elements
+	// are skipped. The builder is left empty
+	void finalize(ParticleModel &model, const bool chunked = false);
+};
+
+template<typename T>
+std::shared_ptr<Data> ParticleModelBuilder::make_array(const std::shared_ptr<MemoryResource> &resource) {
+	return std::make_shared<DataT<T>>(resource);
+}
+
+template<typename T>
+std::shared_ptr<Data> ParticleModelBuilder::gather(const std::vector<const Data*> &chunks,
+		const std::vector<size_t> &offsets, const std::shared_ptr<MemoryResource> &resource)
+{
+	auto data = make_data<T>(resource);
+	data->data.resize(offsets.back());
+	T *out = data->data.data();
+	// Split the output evenly instead of by chunk so one large chunk doesn't leave
+	// the other threads idle
+	parallel_for(0, offsets.back(), 1 << 16, [&](const size_t begin, const size_t end) {
+		size_t c = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+		for (size_t i = begin; i < end; ++c) {
+			const size_t n = std::min(end, offsets[c + 1]) - i;
+			const T *in = static_cast<const T*>(chunks[c]->raw_data()) + (i - offsets[c]);
+			std::copy(in, in + n, out + i);
+			i += n;
+		}
+	});
+	return data;
+}
+
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <unordered_set>
+#include "parallel.h"
+#include "narrow.h"
+
+using namespace pl;
+
+// Number of elements decoded at a time when writing out the decoded values
+const size_t WRITE_BLOCK = 64 * 1024;
+// Grain size of the parallel scans over the values
+const size_t SCAN_GRAIN = 1 << 16;
+
+template<typename C, typename Out>
+static void decode_codes(const DictionaryData &data, const size_t begin, const size_t end, Out *out) {
+	const C *codes = static_cast<const C*>(static_cast<const Data&>(*data.codes).raw_data());
+	visit(*data.dictionary, [&](const auto &dict) {
+		for (size_t i = begin; i < end; ++i) {
+			out[i - begin] = static_cast<Out>(dict[codes[i]]);
+		}
+	});
+}
+template<typename Out>
+static void decode(const DictionaryData &data, const size_t begin, const size_t end, Out *out) {
+	if (data.codes->holds<uint8_t>()) {
+		decode_codes<uint8_t>(data, begin, end, out);
+	} else {
+		decode_codes<uint16_t>(data, begin, end, out);
+	}
+}
+
+DictionaryData::DictionaryData(const std::shared_ptr<Data> &codes,
+		const std::shared_ptr<Data> &dictionary)
+	: codes(codes), dictionary(dictionary)
+{
+	if (!codes->holds<uint8_t>() && !codes->holds<uint16_t>()) {
+		throw std::runtime_error("DictionaryData: codes must be a uint8 or uint16 array");
+	}
+	components = codes->components;
+	layout = codes->layout;
+}
+const std::type_info& DictionaryData::type() const {
+	return dictionary->type();
+}
+void DictionaryData::write(std::ofstream &os) const {
+	visit(*dictionary, [&](const auto &dict) {
+		using T = typename std::remove_const<typename std::decay<decltype(dict)>::type::value_type>::type;
+		std::cout << "Writing " << size() << " " << typeid(T).name()
+			<< ", file is " << sizeof(T) * size() << " bytes\n";
+		std::vector<T> block(std::min(size(), WRITE_BLOCK));
+		for (size_t i = 0; i < size(); i += WRITE_BLOCK) {
+			const size_t end = std::min(i + WRITE_BLOCK, size());
+			decode(*this, i, end, block.data());
+			os.write(reinterpret_cast<const char*>(block.data()), sizeof(T) * (end - i));
+		}
+	});
+}
+float DictionaryData::get_float(const size_t i) const {
+	return dictionary->get_float(static_cast<size_t>(codes->get_float(i)));
+}
+size_t DictionaryData::size() const {
+	return codes->size();
+}
+void DictionaryData::get_floats(const size_t begin, const size_t end, float *out) const {
+	decode(*this, begin, end, out);
+}
+void DictionaryData::get_doubles(const size_t begin, const size_t end, double *out) const {
+	decode(*this, begin, end, out);
+}
+void DictionaryData::get_values(const size_t begin, const size_t end, void *out) const {
+	visit(*dictionary, [&](const auto &dict) {
+		using T = typename std::remove_const<typename std::decay<decltype(dict)>::type::value_type>::type;
+		decode(*this, begin, end, static_cast<T*>(out));
+	});
+}
+bool DictionaryData::can_get_values() const {
+	return true;
+}
+size_t DictionaryData::bytes() const {
+	return codes->bytes() + dictionary->bytes();
+}
+
+// Copy the values to a new array of Out, the caller has checked that they fit
+template<typename Out, typename T>
+static std::shared_ptr<Data> convert_to(const ArrayView<const T> &values) {
+	auto out = std::make_shared<DataT<Out>>();
+	out->data.resize(values.size());
+	Out *o = out->data.data();
+	parallel_for(0, values.size(), SCAN_GRAIN, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			o[i] = static_cast<Out>(values[i]);
+		}
+	});
+	return out;
+}
+
+// Encode the values as codes into the sorted dictionary
+template<typename C, typename T>
+static std::shared_ptr<Data> encode(const ArrayView<const T> &values, const std::vector<T> &dict) {
+	auto codes = std::make_shared<DataT<C>>();
+	codes->data.resize(values.size());
+	C *c = codes->data.data();
+	parallel_for(0, values.size(), SCAN_GRAIN, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			c[i] = static_cast<C>(std::lower_bound(dict.begin(), dict.end(), values[i]) - dict.begin());
+		}
+	});
+	auto dictionary = std::make_shared<DataT<T>>();
+	dictionary->data.assign(dict.begin(), dict.end());
+	return std::make_shared<DictionaryData>(codes, dictionary);
+}
+
+template<typename T>
+static std::shared_ptr<Data> narrow_array(const ArrayView<const T> &values) {
+	// Find the range of the values
+	T lo = std::numeric_limits<T>::max();
+	T hi = std::numeric_limits<T>::lowest();
+	std::mutex mutex;
+	parallel_for(0, values.size(), SCAN_GRAIN, [&](const size_t begin, const size_t end) {
+		T range_lo = values[begin];
+		T range_hi = values[begin];
+		for (size_t i = begin; i < end; ++i) {
+			range_lo = std::min(range_lo, values[i]);
+			range_hi = std::max(range_hi, values[i]);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		lo = std::min(lo, range_lo);
+		hi = std::max(hi, range_hi);
+	});
+
+	if (lo >= 0) {
+		const uint64_t max = static_cast<uint64_t>(hi);
+		if (sizeof(T) > 1 && max <= std::numeric_limits<uint8_t>::max()) {
+			return convert_to<uint8_t>(values);
+		}
+		if (sizeof(T) > 2 && max <= std::numeric_limits<uint16_t>::max()) {
+			return convert_to<uint16_t>(values);
+		}
+		if (sizeof(T) > 4 && max <= std::numeric_limits<uint32_t>::max()) {
+			return convert_to<uint32_t>(values);
+		}
+	}
+	// A dictionary needs at least 8 bit codes, and 16 bits beyond 256 distinct values
+	if (sizeof(T) == 1) {
+		return nullptr;
+	}
+
+	// Collect the distinct values, giving up once there are too many for a dictionary
+	std::unordered_set<T> distinct;
+	std::atomic<bool> too_many(false);
+	parallel_for(0, values.size(), SCAN_GRAIN, [&](const size_t begin, const size_t end) {
+		std::unordered_set<T> local;
+		for (size_t i = begin; i < end && !too_many; ++i) {
+			local.insert(values[i]);
+			if (local.size() > MAX_DICTIONARY_SIZE) {
+				too_many = true;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		distinct.insert(local.begin(), local.end());
+		if (distinct.size() > MAX_DICTIONARY_SIZE) {
+			too_many = true;
+		}
+	});
+	if (too_many || (sizeof(T) == 2 && distinct.size() > 256)) {
+		return nullptr;
+	}
+
+	std::vector<T> dict(distinct.begin(), distinct.end());
+	std::sort(dict.begin(), dict.end());
+	if (dict.size() <= 256) {
+		return encode<uint8_t>(values, dict);
+	}
+	return encode<uint16_t>(values, dict);
+}
+
+template<typename T>
+static void narrow_as(const std::shared_ptr<Data> &data, std::shared_ptr<Data> &narrowed) {
+	if (!narrowed && data->holds<T>()) {
+		narrowed = narrow_array(static_cast<const Data&>(*data).view<T>());
+		if (!narrowed) {
+			narrowed = data;
+		}
+	}
+}
+
+std::shared_ptr<Data> pl::narrow_integers(const std::shared_ptr<Data> &data) {
+	if (data->size() == 0 || data->stride() != 1) {
+		return data;
+	}
+	std::shared_ptr<Data> narrowed;
+	narrow_as<int16_t>(data, narrowed);
+	narrow_as<uint16_t>(data, narrowed);
+	narrow_as<int32_t>(data, narrowed);
+	narrow_as<uint32_t>(data, narrowed);
+	narrow_as<int64_t>(data, narrowed);
+	narrow_as<uint64_t>(data, narrowed);
+	narrow_as<int8_t>(data, narrowed);
+	if (!narrowed) {
+		return data;
+	}
+	if (narrowed != data) {
+		narrowed->components = data->components;
+		narrowed->layout = data->layout;
+		// The values are unchanged, so any stats computed still hold
+		narrowed->cached_stats = std::atomic_load(&data->cached_stats);
+	}
+	return narrowed;
+}
+
+size_t pl::narrow_model(ParticleModel &model) {
+	size_t saved = 0;
+	for (auto &a : model) {
+		auto narrowed = narrow_integers(a.second);
+		if (narrowed != a.second) {
+			const size_t before = a.second->bytes();
+			const size_t after = narrowed->bytes();
+			std::cout << "Narrowed " << a.first << " from " << before << " to " << after << " bytes\n";
+			saved += before > after ? before - after : 0;
+			a.second = narrowed;
+		}
+	}
+	return saved;
+}
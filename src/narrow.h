@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+
+namespace pl {
+
+// An integer attribute stored as uint8 or uint16 codes into a dictionary of its
+// distinct values. The logical type of the data is the type of the dictionary,
+// and write outputs the decoded values
+struct DictionaryData : Data {
+	// DataT<uint8_t> or DataT<uint16_t> holding a code per element
+	std::shared_ptr<Data> codes;
+	// The distinct values of the attribute in ascending order
+	std::shared_ptr<Data> dictionary;
+
+	DictionaryData(const std::shared_ptr<Data> &codes, const std::shared_ptr<Data> &dictionary);
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	// Decodes the values exactly in the dictionary's type
+	void get_values(const size_t begin, const size_t end, void *out) const override;
+	bool can_get_values() const override;
+	size_t bytes() const override;
+};
+
+// The most distinct values a dictionary can hold
+const size_t MAX_DICTIONARY_SIZE = 65536;
+
+// Store an integer attribute in the narrowest type it fits. Non-negative values which
+// fit in a uint8, uint16 or uint32 are stored as that type directly, otherwise if
+// there are few distinct values they're stored as a DictionaryData. The values are
+// unchanged in either case. The data is returned as-is if it isn't an integer array
+// or can't be narrowed
+std::shared_ptr<Data> narrow_integers(const std::shared_ptr<Data> &data);
+
+// Narrow each integer attribute of the model, returns the number of bytes saved
+size_t narrow_model(ParticleModel &model);
+
+}
@@ -0,0 +1,724 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "json.hpp"
+#include "layout.h"
+#include "parallel.h"
+#include "memory_report.h"
+#include "particle_lasso.h"
+#include "octree.h"
+
+using namespace pl;
+using json = nlohmann::json;
+
+// Particles are decoded in blocks of OCTREE_BLOCK by each thread, and distributed
+// to the chunks DISTRIBUTE_BLOCK at a time
+const size_t OCTREE_BLOCK = 4096;
+const size_t DISTRIBUTE_BLOCK = 1 << 20;
+// Nodes this deep are always leaves, e.g. if many particles share a position
+const size_t MAX_LEVEL = 24;
+const size_t NO_CHUNK = std::numeric_limits<uint32_t>::max();
+
+struct OctreeAttribute {
+	std::string name;
+	size_t components;
+
+	bool operator==(const OctreeAttribute &a) const {
+		return name == a.name && components == a.components;
+	}
+};
+
+// The particles are moved around as records of floats, the position followed by the
+// components of each attribute
+struct OctreeBuild {
+	FileName output;
+	OctreeOptions options;
+	bool have_attributes = false;
+	std::vector<OctreeAttribute> attributes;
+	std::shared_ptr<Data> radius;
+	size_t record_size = 3;
+	// Resolution of the grid inner nodes are subsampled on
+	size_t sample_grid = 1;
+	// The cube the octree is built over
+	box3f bounds;
+};
+
+// A cell of the count grid or one of its parent levels, which is either a chunk
+// built in memory or one of the inner nodes above the chunks
+struct OctreeCell {
+	std::string name;
+	size_t level;
+	size_t x, y, z;
+	size_t count;
+};
+
+// The arrays of an imported input which the records are read from, in AOS layout
+struct OctreeInput {
+	std::shared_ptr<Data> positions;
+	std::vector<std::shared_ptr<Data>> attributes;
+	size_t count;
+};
+
+static FileName node_file(const FileName &output, const std::string &name) {
+	return output.path().join(FileName(output.name() + "_" + name + ".bin"));
+}
+static FileName chunk_file(const FileName &output, const size_t chunk) {
+	return output.path().join(FileName(output.name() + "_chunk" + std::to_string(chunk) + ".tmp"));
+}
+
+static box3f cell_bounds(const box3f &root, const size_t level, const size_t x, const size_t y,
+		const size_t z)
+{
+	const float size = root.size().x / static_cast<float>(size_t(1) << level);
+	const vec3f lower = root.lower + vec3f(x, y, z) * vec3f(size);
+	return box3f(lower, lower + vec3f(size));
+}
+
+// Get the index of the cell along each axis of a res^3 grid over the bounds holding p.
+// Positions outside the bounds are clamped to the grid, NaNs go to the first cell
+static void grid_cell(const box3f &bounds, const vec3f &inv_size, const size_t res,
+		const float *p, size_t *cell)
+{
+	for (size_t c = 0; c < 3; ++c) {
+		const float f = (p[c] - bounds.lower[c]) * inv_size[c];
+		cell[c] = f >= 0.f ? (f < static_cast<float>(res) ? static_cast<size_t>(f) : res - 1) : 0;
+	}
+}
+static vec3f grid_inv_size(const box3f &bounds, const size_t res) {
+	const vec3f size = bounds.size();
+	vec3f inv;
+	for (size_t c = 0; c < 3; ++c) {
+		inv[c] = size[c] > 0.f ? res / size[c] : 0.f;
+	}
+	return inv;
+}
+
+// Run f(i) for each i in [0, n) on a pool of threads which each take the next task when
+// they finish one, for tasks that vary a lot in cost. The first exception thrown by
+// a task is rethrown once all the threads are done
+template<typename F>
+static void parallel_tasks(const size_t n, const F &f) {
+	std::atomic<size_t> next(0);
+	std::mutex mutex;
+	std::exception_ptr error;
+	parallel_for(0, std::min(num_threads(), n), 1, [&](const size_t, const size_t) {
+		for (size_t i = next++; i < n; i = next++) {
+			try {
+				f(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+	});
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+static ParticleModel load_input(const FileName &file) {
+	std::vector<ParticleModel> timesteps = lasso_particles(file);
+	if (timesteps.empty() || timesteps[0].find("positions") == timesteps[0].end()) {
+		throw std::runtime_error("build_octree: no particles loaded from " + file.file_name);
+	}
+	return timesteps[0];
+}
+
+// Record the per-particle attributes of the first input in the build, the attributes
+// of the other inputs must match them
+static void check_attributes(OctreeBuild &build, const ParticleModel &model,
+		const FileName &file)
+{
+	const size_t n = model.at("positions")->count();
+	std::vector<OctreeAttribute> attributes;
+	std::shared_ptr<Data> radius;
+	for (const auto &a : model) {
+		if (a.first == "positions") {
+			continue;
+		}
+		if (a.second->count() == n) {
+			attributes.push_back(OctreeAttribute{a.first, a.second->components});
+		} else if (a.first == "radius" && a.second->size() == 1) {
+			radius = a.second;
+		}
+	}
+	std::sort(attributes.begin(), attributes.end(),
+		[](const OctreeAttribute &a, const OctreeAttribute &b) {
+			return a.name < b.name;
+		});
+	if (!build.have_attributes) {
+		build.have_attributes = true;
+		build.attributes = attributes;
+		build.radius = radius;
+		build.record_size = 3;
+		for (const auto &a : attributes) {
+			build.record_size += a.components;
+		}
+	} else if (attributes != build.attributes) {
+		throw std::runtime_error("build_octree: the attributes of " + file.file_name
+				+ " don't match the first input");
+	}
+}
+
+static OctreeInput prepare_input(OctreeBuild &build, const ParticleModel &model,
+		const FileName &file)
+{
+	check_attributes(build, model, file);
+	OctreeInput input;
+	input.positions = to_layout(model.at("positions"), Layout::AOS);
+	input.count = input.positions->count();
+	if (input.positions->components != 3) {
+		throw std::runtime_error("build_octree: the positions of " + file.file_name
+				+ " don't have 3 components");
+	}
+	for (const auto &a : build.attributes) {
+		input.attributes.push_back(to_layout(model.at(a.name), Layout::AOS));
+	}
+	return input;
+}
+
+// Decode the records of particles [begin, end) into out, scratch holds the
+// components of an array being interleaved into the records
+static void read_records(const OctreeInput &input, const size_t record_size,
+		const size_t begin, const size_t end, float *out, std::vector<float> &scratch)
+{
+	size_t offset = 0;
+	auto interleave = [&](const Data &data) {
+		const size_t k = data.components;
+		scratch.resize((end - begin) * k);
+		data.get_floats(begin * k, end * k, scratch.data());
+		for (size_t i = 0; i < end - begin; ++i) {
+			std::copy(scratch.data() + i * k, scratch.data() + (i + 1) * k,
+					out + i * record_size + offset);
+		}
+		offset += k;
+	};
+	interleave(*input.positions);
+	for (const auto &a : input.attributes) {
+		interleave(*a);
+	}
+}
+
+// Write the records to the node's file, the positions followed by each attribute
+static void write_node(const OctreeBuild &build, const std::string &name,
+		const std::vector<float> &records)
+{
+	const FileName file = node_file(build.output, name);
+	std::ofstream out(file.c_str(), std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("build_octree: could not open " + file.file_name);
+	}
+	const size_t n = records.size() / build.record_size;
+	std::vector<float> column;
+	size_t offset = 0;
+	auto write_column = [&](const size_t k) {
+		column.resize(n * k);
+		for (size_t i = 0; i < n; ++i) {
+			std::copy(records.data() + i * build.record_size + offset,
+					records.data() + i * build.record_size + offset + k, column.data() + i * k);
+		}
+		out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(float));
+		offset += k;
+	};
+	write_column(3);
+	for (const auto &a : build.attributes) {
+		write_column(a.components);
+	}
+	if (!out) {
+		throw std::runtime_error("build_octree: failed to write " + file.file_name);
+	}
+}
+
+// Read the records of a node back from its file, appending them to records
+static void read_node(const OctreeBuild &build, const std::string &name, const size_t count,
+		std::vector<float> &records)
+{
+	const FileName file = node_file(build.output, name);
+	std::ifstream in(file.c_str(), std::ios::binary);
+	const size_t first = records.size();
+	records.resize(first + count * build.record_size);
+	std::vector<float> column;
+	size_t offset = 0;
+	auto read_column = [&](const size_t k) {
+		column.resize(count * k);
+		in.read(reinterpret_cast<char*>(column.data()), column.size() * sizeof(float));
+		for (size_t i = 0; i < count; ++i) {
+			std::copy(column.data() + i * k, column.data() + (i + 1) * k,
+					records.data() + first + i * build.record_size + offset);
+		}
+		offset += k;
+	};
+	read_column(3);
+	for (const auto &a : build.attributes) {
+		read_column(a.components);
+	}
+	if (!in) {
+		throw std::runtime_error("build_octree: failed to read " + file.file_name);
+	}
+}
+
+// Keep the particle nearest the center of each occupied cell of a grid over the bounds,
+// giving an evenly spread subsample of at most sample_grid^3 particles. The samples
+// are ordered by cell, ties are kept in the order of the records
+static std::vector<float> grid_sample(const OctreeBuild &build, const box3f &bounds,
+		const std::vector<float> &records)
+{
+	struct Candidate {
+		size_t cell;
+		float distance;
+		size_t index;
+	};
+	const size_t r = build.record_size;
+	const size_t res = build.sample_grid;
+	const vec3f inv_size = grid_inv_size(bounds, res);
+	std::vector<Candidate> candidates(records.size() / r);
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		const float *p = records.data() + i * r;
+		size_t cell[3];
+		grid_cell(bounds, inv_size, res, p, cell);
+		float distance = 0.f;
+		for (size_t c = 0; c < 3; ++c) {
+			const float d = (p[c] - bounds.lower[c]) * inv_size[c] - (cell[c] + 0.5f);
+			distance += d * d;
+		}
+		candidates[i] = Candidate{cell[0] + res * (cell[1] + res * cell[2]), distance, i};
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const Candidate &a, const Candidate &b) {
+			return std::tie(a.cell, a.distance, a.index) < std::tie(b.cell, b.distance, b.index);
+		});
+	std::vector<float> samples;
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		if (i == 0 || candidates[i].cell != candidates[i - 1].cell) {
+			const float *p = records.data() + candidates[i].index * r;
+			samples.insert(samples.end(), p, p + r);
+		}
+	}
+	return samples;
+}
+
+// Build the subtree of a node from its particles, writing out each node and appending
+// it to nodes. Returns the particles kept by the node, all of them for a leaf or the
+// subsample of an inner node
+static std::vector<float> build_node(const OctreeBuild &build, const std::string &name,
+		const box3f &bounds, const size_t level, std::vector<float> records,
+		std::vector<OctreeNode> &nodes)
+{
+	const size_t r = build.record_size;
+	const size_t n = records.size() / r;
+	if (n <= build.options.node_capacity || level >= MAX_LEVEL) {
+		write_node(build, name, records);
+		nodes.push_back(OctreeNode{name, bounds, n, true});
+		return records;
+	}
+
+	const vec3f center = bounds.center();
+	std::vector<std::vector<float>> children(8);
+	{
+		std::vector<uint8_t> child(n);
+		size_t counts[8] = {0};
+		for (size_t i = 0; i < n; ++i) {
+			const float *p = records.data() + i * r;
+			child[i] = (p[0] >= center.x ? 1 : 0) | (p[1] >= center.y ? 2 : 0)
+				| (p[2] >= center.z ? 4 : 0);
+			++counts[child[i]];
+		}
+		for (size_t c = 0; c < 8; ++c) {
+			children[c].reserve(counts[c] * r);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			const float *p = records.data() + i * r;
+			children[child[i]].insert(children[child[i]].end(), p, p + r);
+		}
+		std::vector<float>().swap(records);
+	}
+
+	std::vector<float> samples;
+	for (size_t c = 0; c < 8; ++c) {
+		if (children[c].empty()) {
+			continue;
+		}
+		box3f child_bounds = bounds;
+		for (size_t i = 0; i < 3; ++i) {
+			if (c & (1 << i)) {
+				child_bounds.lower[i] = center[i];
+			} else {
+				child_bounds.upper[i] = center[i];
+			}
+		}
+		const std::vector<float> child_samples = build_node(build, name + char('0' + c),
+				child_bounds, level + 1, std::move(children[c]), nodes);
+		samples.insert(samples.end(), child_samples.begin(), child_samples.end());
+	}
+	std::vector<float> kept = grid_sample(build, bounds, samples);
+	write_node(build, name, kept);
+	nodes.push_back(OctreeNode{name, bounds, kept.size() / r, false});
+	return kept;
+}
+
+// Split the cell into chunks of at most chunk_capacity particles, recursing into
+// the cells below it until they're small enough or at the count grid resolution
+static void split_cells(const std::vector<std::vector<uint64_t>> &pyramid, const OctreeCell &cell,
+		const size_t chunk_capacity, std::vector<OctreeCell> &chunks, std::vector<OctreeCell> &inner)
+{
+	if (cell.count == 0) {
+		return;
+	}
+	if (cell.count <= chunk_capacity || cell.level + 1 == pyramid.size()) {
+		if (cell.count > chunk_capacity) {
+			std::cout << "build_octree: a cell of the count grid holds " << cell.count
+				<< " particles, more than the " << chunk_capacity << " which fit in the memory"
+				<< " budget, a finer count grid would split it\n";
+		}
+		chunks.push_back(cell);
+		return;
+	}
+	inner.push_back(cell);
+	const size_t res = size_t(1) << (cell.level + 1);
+	for (size_t c = 0; c < 8; ++c) {
+		OctreeCell child;
+		child.name = cell.name + char('0' + c);
+		child.level = cell.level + 1;
+		child.x = 2 * cell.x + (c & 1);
+		child.y = 2 * cell.y + ((c >> 1) & 1);
+		child.z = 2 * cell.z + ((c >> 2) & 1);
+		child.count = pyramid[child.level][child.x + res * (child.y + res * child.z)];
+		split_cells(pyramid, child, chunk_capacity, chunks, inner);
+	}
+}
+
+static void write_hierarchy(const OctreeBuild &build, const std::vector<OctreeNode> &nodes,
+		const size_t total)
+{
+	json index;
+	const box3f &b = build.bounds;
+	index["bounds"] = {
+		{"lower", {b.lower.x, b.lower.y, b.lower.z}},
+		{"upper", {b.upper.x, b.upper.y, b.upper.z}}
+	};
+	index["particles"] = total;
+	index["node_capacity"] = build.options.node_capacity;
+	index["attributes"] = json::array();
+	index["attributes"].push_back({{"name", "positions"}, {"components", 3}});
+	for (const auto &a : build.attributes) {
+		index["attributes"].push_back({{"name", a.name}, {"components", a.components}});
+	}
+	if (build.radius) {
+		index["radius"] = build.radius->get_float(0);
+	}
+	index["nodes"] = json::array();
+	for (const auto &n : nodes) {
+		index["nodes"].push_back({
+			{"name", n.name},
+			{"level", n.name.size() - 1},
+			{"count", n.count},
+			{"leaf", n.leaf},
+			{"file", build.output.name() + "_" + n.name + ".bin"},
+			{"lower", {n.bounds.lower.x, n.bounds.lower.y, n.bounds.lower.z}},
+			{"upper", {n.bounds.upper.x, n.bounds.upper.y, n.bounds.upper.z}}
+		});
+	}
+	std::ofstream out(build.output.c_str());
+	out << index.dump(4) << "\n";
+	if (!out) {
+		throw std::runtime_error("build_octree: failed to write " + build.output.file_name);
+	}
+}
+
+std::vector<OctreeNode> pl::build_octree(const std::vector<FileName> &inputs,
+		const FileName &output, const OctreeOptions &options)
+{
+	const size_t res = options.count_grid;
+	if (res == 0 || (res & (res - 1)) != 0 || res > 512) {
+		throw std::runtime_error("build_octree: the count grid must be a power of two up to 512");
+	}
+	if (options.node_capacity == 0) {
+		throw std::runtime_error("build_octree: the node capacity must be at least 1");
+	}
+	OctreeBuild build;
+	build.output = output;
+	build.options = options;
+	while (build.sample_grid * 2 * build.sample_grid * 2 * build.sample_grid * 2
+			<= options.node_capacity)
+	{
+		build.sample_grid *= 2;
+	}
+
+	box3f bounds = options.bounds;
+	if (bounds.empty()) {
+		AllocationPhase phase("octree: bounds");
+		for (const auto &file : inputs) {
+			const ParticleModel model = load_input(file);
+			check_attributes(build, model, file);
+			bounds.extend(pl::bounds(*model.at("positions")));
+		}
+		if (bounds.empty()) {
+			throw std::runtime_error("build_octree: no particles to build the octree over");
+		}
+	}
+	// The octree is built over the cube around the bounds
+	{
+		const vec3f size = bounds.size();
+		float extent = std::max(size.x, std::max(size.y, size.z));
+		if (!(extent > 0.f)) {
+			extent = 1.f;
+		}
+		const vec3f center = bounds.center();
+		build.bounds = box3f(center - vec3f(0.5f * extent), center + vec3f(0.5f * extent));
+	}
+	const vec3f inv_size = grid_inv_size(build.bounds, res);
+
+	// Count the particles in each cell of the grid, then sum the counts up to the root
+	size_t grid_level = 0;
+	while ((size_t(1) << grid_level) < res) {
+		++grid_level;
+	}
+	std::vector<std::vector<uint64_t>> pyramid(grid_level + 1);
+	size_t total = 0;
+	{
+		AllocationPhase phase("octree: count");
+		// Each range of particles counts into its own grid, so clustered particles don't
+		// contend on the same cells, with as many ranges as the memory budget holds grids
+		const size_t cells = res * res * res;
+		const size_t max_ranges = clamp(options.memory_budget / (cells * sizeof(uint64_t)),
+				size_t(1), num_threads());
+		std::vector<uint64_t> range_counts(cells, 0);
+		for (const auto &file : inputs) {
+			const ParticleModel model = load_input(file);
+			const OctreeInput input = prepare_input(build, model, file);
+			const size_t ranges = clamp(input.count / OCTREE_BLOCK, size_t(1), max_ranges);
+			const size_t range_size = (input.count + ranges - 1) / ranges;
+			range_counts.resize(std::max(range_counts.size(), ranges * cells), 0);
+			parallel_for(0, ranges, 1, [&](const size_t range_begin, const size_t range_end) {
+				std::vector<float> p(OCTREE_BLOCK * 3);
+				for (size_t r = range_begin; r < range_end; ++r) {
+					uint64_t *counts = range_counts.data() + r * cells;
+					const size_t end = std::min(input.count, (r + 1) * range_size);
+					for (size_t b = r * range_size; b < end; b += OCTREE_BLOCK) {
+						const size_t e = std::min(end, b + OCTREE_BLOCK);
+						input.positions->get_floats(b * 3, e * 3, p.data());
+						for (size_t i = 0; i < e - b; ++i) {
+							size_t cell[3];
+							grid_cell(build.bounds, inv_size, res, p.data() + i * 3, cell);
+							++counts[cell[0] + res * (cell[1] + res * cell[2])];
+						}
+					}
+				}
+			});
+			total += input.count;
+		}
+		std::vector<uint64_t> &grid = pyramid[grid_level];
+		grid.resize(cells);
+		const size_t ranges = range_counts.size() / cells;
+		parallel_for(0, cells, OCTREE_BLOCK, [&](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				uint64_t sum = 0;
+				for (size_t r = 0; r < ranges; ++r) {
+					sum += range_counts[r * cells + i];
+				}
+				grid[i] = sum;
+			}
+		});
+	}
+	for (size_t l = grid_level; l-- > 0;) {
+		const size_t r = size_t(1) << l;
+		pyramid[l].resize(r * r * r);
+		for (size_t z = 0; z < r; ++z) {
+			for (size_t y = 0; y < r; ++y) {
+				for (size_t x = 0; x < r; ++x) {
+					uint64_t sum = 0;
+					for (size_t c = 0; c < 8; ++c) {
+						const size_t cx = 2 * x + (c & 1);
+						const size_t cy = 2 * y + ((c >> 1) & 1);
+						const size_t cz = 2 * z + ((c >> 2) & 1);
+						sum += pyramid[l + 1][cx + 2 * r * (cy + 2 * r * cz)];
+					}
+					pyramid[l][x + r * (y + r * z)] = sum;
+				}
+			}
+		}
+	}
+
+	// Each thread builds one chunk at a time, holding its records, the copies split
+	// into its children and the samples gathered from them
+	const size_t chunk_capacity = std::max(options.node_capacity,
+			options.memory_budget / (3 * num_threads() * build.record_size * sizeof(float)));
+	std::vector<OctreeCell> chunks;
+	std::vector<OctreeCell> inner;
+	split_cells(pyramid, OctreeCell{"r", 0, 0, 0, 0, pyramid[0][0]}, chunk_capacity,
+			chunks, inner);
+	std::cout << "build_octree: " << total << " particles split into " << chunks.size()
+		<< " chunks of up to " << chunk_capacity << " particles\n";
+
+	std::vector<uint32_t> cell_chunk(res * res * res, NO_CHUNK);
+	for (size_t k = 0; k < chunks.size(); ++k) {
+		const OctreeCell &c = chunks[k];
+		const size_t shift = grid_level - c.level;
+		for (size_t z = c.z << shift; z < (c.z + 1) << shift; ++z) {
+			for (size_t y = c.y << shift; y < (c.y + 1) << shift; ++y) {
+				for (size_t x = c.x << shift; x < (c.x + 1) << shift; ++x) {
+					cell_chunk[x + res * (y + res * z)] = static_cast<uint32_t>(k);
+				}
+			}
+		}
+	}
+
+	std::vector<std::vector<OctreeNode>> chunk_nodes(chunks.size());
+	// The chunk files are removed as they're built, if any phase fails the remaining
+	// ones are removed before passing the error on
+	try {
+		// Stream the particles out to their chunk's file, buffering them in memory up to
+		// half the budget before writing them out
+		{
+			AllocationPhase phase("octree: distribute");
+			for (size_t k = 0; k < chunks.size(); ++k) {
+				std::ofstream out(chunk_file(output, k).c_str(), std::ios::binary | std::ios::trunc);
+				if (!out) {
+					throw std::runtime_error("build_octree: could not open "
+							+ chunk_file(output, k).file_name);
+				}
+			}
+			const size_t r = build.record_size;
+			const size_t buffer_limit = std::max(options.memory_budget / (2 * sizeof(float)),
+					OCTREE_BLOCK * r);
+			std::vector<std::vector<float>> buffers(chunks.size());
+			size_t buffered = 0;
+			auto flush = [&]() {
+				for (size_t k = 0; k < buffers.size(); ++k) {
+					if (buffers[k].empty()) {
+						continue;
+					}
+					std::ofstream out(chunk_file(output, k).c_str(), std::ios::binary | std::ios::app);
+					out.write(reinterpret_cast<const char*>(buffers[k].data()),
+							buffers[k].size() * sizeof(float));
+					if (!out) {
+						throw std::runtime_error("build_octree: failed to write "
+								+ chunk_file(output, k).file_name);
+					}
+					std::vector<float>().swap(buffers[k]);
+				}
+				buffered = 0;
+			};
+
+			std::vector<float> records;
+			std::vector<uint32_t> record_chunk;
+			for (const auto &file : inputs) {
+				const ParticleModel model = load_input(file);
+				const OctreeInput input = prepare_input(build, model, file);
+				for (size_t b = 0; b < input.count; b += DISTRIBUTE_BLOCK) {
+					const size_t n = std::min(input.count - b, DISTRIBUTE_BLOCK);
+					records.resize(n * r);
+					record_chunk.resize(n);
+					parallel_for(0, n, OCTREE_BLOCK, [&](const size_t begin, const size_t end) {
+						std::vector<float> scratch;
+						read_records(input, r, b + begin, b + end, records.data() + begin * r, scratch);
+						for (size_t i = begin; i < end; ++i) {
+							size_t cell[3];
+							grid_cell(build.bounds, inv_size, res, records.data() + i * r, cell);
+							record_chunk[i] = cell_chunk[cell[0] + res * (cell[1] + res * cell[2])];
+						}
+					});
+					for (size_t i = 0; i < n; ++i) {
+						std::vector<float> &buffer = buffers[record_chunk[i]];
+						buffer.insert(buffer.end(), records.data() + i * r, records.data() + (i + 1) * r);
+					}
+					buffered += n * r;
+					if (buffered > buffer_limit) {
+						flush();
+					}
+				}
+			}
+			flush();
+		}
+
+		// Build the chunks in parallel, largest first so a large one isn't left for last
+		{
+			AllocationPhase phase("octree: build chunks");
+			std::vector<size_t> order(chunks.size());
+			for (size_t k = 0; k < order.size(); ++k) {
+				order[k] = k;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+				return chunks[a].count > chunks[b].count;
+			});
+			parallel_tasks(order.size(), [&](const size_t t) {
+				const size_t k = order[t];
+				const OctreeCell &c = chunks[k];
+				const FileName file = chunk_file(output, k);
+				std::vector<float> records(c.count * build.record_size);
+				{
+					std::ifstream in(file.c_str(), std::ios::binary);
+					in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(float));
+					if (!in) {
+						throw std::runtime_error("build_octree: failed to read " + file.file_name);
+					}
+				}
+				std::remove(file.c_str());
+				build_node(build, c.name, cell_bounds(build.bounds, c.level, c.x, c.y, c.z), c.level,
+						std::move(records), chunk_nodes[k]);
+			});
+		}
+	} catch (...) {
+		for (size_t k = 0; k < chunks.size(); ++k) {
+			std::remove(chunk_file(output, k).c_str());
+		}
+		throw;
+	}
+
+	// Build the nodes above the chunks a level at a time from the bottom up, subsampling
+	// the nodes below them which are read back from their files
+	std::vector<OctreeNode> nodes;
+	std::map<std::string, size_t> node_counts;
+	for (const auto &cn : chunk_nodes) {
+		for (const auto &n : cn) {
+			node_counts[n.name] = n.count;
+		}
+		nodes.insert(nodes.end(), cn.begin(), cn.end());
+	}
+	{
+		AllocationPhase phase("octree: build hierarchy");
+		std::stable_sort(inner.begin(), inner.end(), [](const OctreeCell &a, const OctreeCell &b) {
+			return a.level > b.level;
+		});
+		for (size_t first = 0; first < inner.size();) {
+			size_t last = first;
+			while (last < inner.size() && inner[last].level == inner[first].level) {
+				++last;
+			}
+			std::vector<OctreeNode> level_nodes(last - first);
+			parallel_tasks(last - first, [&](const size_t t) {
+				const OctreeCell &c = inner[first + t];
+				std::vector<float> samples;
+				for (size_t i = 0; i < 8; ++i) {
+					auto child = node_counts.find(c.name + char('0' + i));
+					if (child != node_counts.end()) {
+						read_node(build, child->first, child->second, samples);
+					}
+				}
+				const box3f bounds = cell_bounds(build.bounds, c.level, c.x, c.y, c.z);
+				const std::vector<float> kept = grid_sample(build, bounds, samples);
+				write_node(build, c.name, kept);
+				level_nodes[t] = OctreeNode{c.name, bounds, kept.size() / build.record_size, false};
+			});
+			for (const auto &n : level_nodes) {
+				node_counts[n.name] = n.count;
+			}
+			nodes.insert(nodes.end(), level_nodes.begin(), level_nodes.end());
+			first = last;
+		}
+	}
+
+	std::sort(nodes.begin(), nodes.end(), [](const OctreeNode &a, const OctreeNode &b) {
+		return a.name.size() < b.name.size() || (a.name.size() == b.name.size() && a.name < b.name);
+	});
+	write_hierarchy(build, nodes, total);
+	return nodes;
+}
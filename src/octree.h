@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "transform.h"
+
+namespace pl {
+
+struct OctreeOptions {
+	// The most particles stored in a leaf, and the most samples kept by an inner node
+	size_t node_capacity = 1 << 16;
+	// Roughly how many bytes of particles the build holds in memory at once, not
+	// counting the memory used to import each input
+	size_t memory_budget = size_t(1) << 30;
+	// Resolution of the grid the particles are counted in to split the data into
+	// chunks which are built in memory, must be a power of two
+	size_t count_grid = 128;
+	// The bounds of the data, if empty they're found with an extra pass over the inputs
+	box3f bounds;
+};
+
+// A node of the octree, named by its path from the root r, e.g. r, r5, r53. Child i
+// of a node is in the upper half of its x, y and z axes if bits 0, 1 and 2 of i are set
+struct OctreeNode {
+	std::string name;
+	box3f bounds;
+	size_t count = 0;
+	bool leaf = false;
+};
+
+// Build a multi-resolution octree over the particles of the inputs, without holding
+// the whole data set in memory. The inputs are imported one at a time, each must fit
+// in memory on its own. Leaves hold all the particles inside them, and inner nodes
+// hold a spatially uniform subsample of their children for viewing at lower detail.
+//
+// The build counts the particles in a coarse grid to split the data into chunks that
+// fit in the memory budget, streams the particles out to a temporary file per chunk,
+// then builds the subtree of each chunk in parallel, followed by the nodes above them.
+//
+// Each node is written to <output name>_<node name>.bin next to the output, holding
+// its positions as vec3f followed by each attribute's components as floats. The
+// hierarchy, bounds and attributes are written to the output as JSON. All inputs
+// must have the same per-particle attributes. The nodes are returned in the order
+// they're listed in the hierarchy, by level and then name
+std::vector<OctreeNode> build_octree(const std::vector<FileName> &inputs,
+		const FileName &output, const OctreeOptions &options = OctreeOptions());
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace pl {
+
+inline std::atomic<size_t>& num_threads_override() {
+	static std::atomic<size_t> n(0);
+	return n;
+}
+
+// Get the number of threads to use for parallel loops, the hardware concurrency
+// unless it's been overridden by set_num_threads
+inline size_t num_threads() {
+	const size_t forced = num_threads_override().load(std::memory_order_relaxed);
+	if (forced != 0) {
+		return forced;
+	}
+	const size_t n = std::thread::hardware_concurrency();
+	return n == 0 ? 1 : n;
+}
+
+// Override the number of threads used by parallel loops, e.g. to run the parallel
+// paths on a machine with few cores. 0 goes back to the hardware concurrency
+inline void set_num_threads(const size_t n) {
+	num_threads_override().store(n, std::memory_order_relaxed);
+}
+
+// Split [begin, end) into one contiguous range per thread, each of at least grain
+// elements, and call f(range_begin, range_end) on each range in parallel.
+// The calling thread processes the first range, f must not throw.
+template<typename F>
+void parallel_for(const size_t begin, const size_t end, const size_t grain, const F &f) {
+	if (end <= begin) {
+		return;
+	}
+	const size_t n = end - begin;
+	const size_t max_threads = std::max(n / std::max(grain, size_t(1)), size_t(1));
+	const size_t threads = std::min(num_threads(), max_threads);
+	if (threads == 1) {
+		f(begin, end);
+		return;
+	}
+	const size_t range = (n + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for (size_t b = begin + range; b < end; b += range) {
+		workers.emplace_back([&f, b, end, range]() {
+			f(b, std::min(b + range, end));
+		});
+	}
+	f(begin, begin + range);
+	for (auto &w : workers) {
+		w.join();
+	}
+}
+
+}
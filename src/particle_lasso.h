@@ -2,6 +2,24 @@
 
 #include "particle_lasso_cfg.h"
 #include "types.h"
+#include "buffer.h"
+#include "layout.h"
+#include "quantize.h"
+#include "compress.h"
+#include "stats.h"
+#include "view.h"
+#include "model_builder.h"
+#include "memory_report.h"
+#include "narrow.h"
+#include "kernels.h"
+#include "transform.h"
+#include "histogram.h"
+#include "filter.h"
+#include "reorder.h"
+#include "pkd_builder.h"
+#include "octree.h"
+#include "bricking.h"
+#include "kd_partition.h"
 #include "import_scivis16.h"
 #include "import_uintah.h"
 #include "import_xyz.h"
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include "tinyxml2.h"
+#include "layout.h"
+#include "parallel.h"
+#include "transform.h"
+#include "view.h"
+#include "memory_report.h"
+#include "pkd_builder.h"
+
+using namespace pl;
+using namespace tinyxml2;
+
+const size_t WRITE_BLOCK = 64 * 1024;
+
+std::string tinyxml_error_string(const XMLError e);
+
+struct PkdParticle {
+	vec3f position;
+	size_t index;
+};
+
+// A subtree still to be built, rooted at node and holding particles [begin, end)
+struct PkdSubtree {
+	size_t node;
+	size_t begin;
+	size_t end;
+	box3f bounds;
+};
+
+// Get the number of nodes in the subtree rooted at node, in a complete tree of n nodes
+static size_t subtree_size(const size_t node, const size_t n) {
+	size_t size = 0;
+	for (size_t first = node, last = node; first < n; first = 2 * first + 1, last = 2 * last + 2) {
+		size += std::min(last, n - 1) - first + 1;
+	}
+	return size;
+}
+
+// The widest axis of the bounds, ties go to the lower axis
+static size_t split_axis(const box3f &bounds) {
+	const vec3f size = bounds.size();
+	if (size.x >= size.y && size.x >= size.z) {
+		return 0;
+	}
+	return size.y >= size.z ? 1 : 2;
+}
+
+// Split the subtree at its median, writing the node's particle to order and
+// returning its child subtrees in children
+static size_t split_subtree(std::vector<PkdParticle> &particles, const PkdSubtree &t,
+		const size_t n, std::vector<size_t> &order, PkdSubtree *children)
+{
+	const size_t axis = split_axis(t.bounds);
+	const size_t left = 2 * t.node + 1;
+	const size_t mid = t.begin + (left < n ? subtree_size(left, n) : 0);
+	std::nth_element(particles.begin() + t.begin, particles.begin() + mid,
+		particles.begin() + t.end,
+		[&](const PkdParticle &a, const PkdParticle &b) {
+			return a.position[axis] < b.position[axis];
+		});
+	order[t.node] = particles[mid].index;
+	const float split = particles[mid].position[axis];
+
+	size_t num_children = 0;
+	if (mid > t.begin) {
+		PkdSubtree &l = children[num_children++];
+		l = PkdSubtree{left, t.begin, mid, t.bounds};
+		l.bounds.upper[axis] = split;
+	}
+	if (mid + 1 < t.end) {
+		PkdSubtree &r = children[num_children++];
+		r = PkdSubtree{left + 1, mid + 1, t.end, t.bounds};
+		r.bounds.lower[axis] = split;
+	}
+	return num_children;
+}
+
+static void build_subtree(std::vector<PkdParticle> &particles, const PkdSubtree &t,
+		const size_t n, std::vector<size_t> &order)
+{
+	PkdSubtree children[2];
+	const size_t num_children = split_subtree(particles, t, n, order, children);
+	for (size_t i = 0; i < num_children; ++i) {
+		build_subtree(particles, children[i], n, order);
+	}
+}
+
+std::vector<size_t> pl::pkd_order(const Data &positions) {
+	if (positions.components != 3) {
+		throw std::runtime_error("pkd_order: positions must have 3 components");
+	}
+	const size_t n = positions.count();
+	std::vector<size_t> order(n);
+	if (n == 0) {
+		return order;
+	}
+	// The root bounds are taken from the loaded particles, as the cached range of the
+	// positions may be a looser one seeded from a file header
+	std::vector<PkdParticle> particles(n);
+	const ComponentStrides strides(positions);
+	std::mutex mutex;
+	box3f root_bounds;
+	visit(positions, [&](const auto &view) {
+		parallel_for(0, n, WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+			box3f local;
+			for (size_t i = begin; i < end; ++i) {
+				for (size_t c = 0; c < 3; ++c) {
+					particles[i].position[c] = static_cast<float>(
+							view.data()[i * strides.particle_stride + c * strides.component_stride]);
+				}
+				particles[i].index = i;
+				local.extend(particles[i].position);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			root_bounds.extend(local);
+		});
+	});
+
+	// Split the top of the tree a level at a time, with the subtrees of each level
+	// partitioned in parallel, until there are enough subtrees to build the rest of
+	// the tree in parallel
+	std::vector<PkdSubtree> subtrees{PkdSubtree{0, 0, n, root_bounds}};
+	while (!subtrees.empty() && subtrees.size() < 4 * num_threads()) {
+		std::vector<PkdSubtree> next(2 * subtrees.size());
+		std::vector<size_t> num_children(subtrees.size());
+		parallel_for(0, subtrees.size(), 1, [&](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				num_children[i] = split_subtree(particles, subtrees[i], n, order, &next[2 * i]);
+			}
+		});
+		std::vector<PkdSubtree> level;
+		for (size_t i = 0; i < subtrees.size(); ++i) {
+			level.insert(level.end(), next.begin() + 2 * i, next.begin() + 2 * i + num_children[i]);
+		}
+		subtrees = std::move(level);
+	}
+	parallel_for(0, subtrees.size(), 1, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			build_subtree(particles, subtrees[i], n, order);
+		}
+	});
+	return order;
+}
+
+// Write the floats of the data to the file a block at a time
+static void write_floats(std::ofstream &out, const Data &data) {
+	std::vector<float> block(WRITE_BLOCK);
+	for (size_t b = 0; b < data.size(); b += WRITE_BLOCK) {
+		const size_t e = std::min(b + WRITE_BLOCK, data.size());
+		data.get_floats(b, e, block.data());
+		out.write(reinterpret_cast<const char*>(block.data()), (e - b) * sizeof(float));
+	}
+}
+
+void pl::export_pkd(const FileName &file_name, const ParticleModel &model) {
+	auto positions = model.find("positions");
+	if (positions == model.end()) {
+		throw std::runtime_error("export_pkd: the model has no positions");
+	}
+	const size_t n = positions->second->count();
+	std::shared_ptr<const std::vector<size_t>> order;
+	{
+		AllocationPhase phase("pkd: build tree");
+		order = std::make_shared<const std::vector<size_t>>(pkd_order(*positions->second));
+	}
+
+	AllocationPhase phase("pkd: write");
+	const FileName bin_file = file_name.path().join(FileName(file_name.name() + ".pkdbin"));
+	std::ofstream bin(bin_file.c_str(), std::ios::binary);
+	if (!bin) {
+		throw std::runtime_error("export_pkd: could not open " + bin_file.file_name);
+	}
+	XMLDocument doc;
+	XMLElement *root = doc.NewElement("OSPRay");
+	doc.InsertEndChild(doc.NewDeclaration());
+	doc.InsertEndChild(root);
+	XMLElement *geometry = doc.NewElement("PKDGeometry");
+	root->InsertEndChild(geometry);
+
+	// The positions are written as AOS vec3f, the other attributes a component at a time
+	size_t offset = 0;
+	{
+		auto aos = to_layout(positions->second, Layout::AOS);
+		std::cout << "Writing " << n << " positions to " << bin_file << "\n";
+		write_floats(bin, RowView(aos, order));
+		XMLElement *e = doc.NewElement("position");
+		e->SetAttribute("ofs", static_cast<int64_t>(offset));
+		e->SetAttribute("count", static_cast<int64_t>(n));
+		e->SetAttribute("format", "vec3f");
+		geometry->InsertEndChild(e);
+		offset += n * 3 * sizeof(float);
+	}
+	for (const auto &a : model) {
+		if (a.first == "positions") {
+			continue;
+		}
+		if (a.second->count() != n) {
+			if (a.first == "radius" && a.second->size() == 1) {
+				XMLElement *e = doc.NewElement("radius");
+				e->SetText(a.second->get_float(0));
+				geometry->InsertEndChild(e);
+			} else {
+				std::cout << "export_pkd: skipping attribute " << a.first
+					<< " which doesn't have a value per particle\n";
+			}
+			continue;
+		}
+		for (size_t c = 0; c < a.second->components; ++c) {
+			const std::string name = a.second->components == 1 ? a.first
+				: a.first + "." + std::to_string(c);
+			std::cout << "Writing attribute " << name << "\n";
+			if (a.second->components == 1) {
+				write_floats(bin, RowView(a.second, order));
+			} else {
+				write_floats(bin, RowView(component_view(a.second, c), order));
+			}
+			XMLElement *e = doc.NewElement("attribute");
+			e->SetAttribute("name", name.c_str());
+			e->SetAttribute("ofs", static_cast<int64_t>(offset));
+			e->SetAttribute("count", static_cast<int64_t>(n));
+			e->SetAttribute("format", "float");
+			geometry->InsertEndChild(e);
+			offset += n * sizeof(float);
+		}
+	}
+	if (!bin) {
+		throw std::runtime_error("export_pkd: failed to write " + bin_file.file_name);
+	}
+	const XMLError err = doc.SaveFile(file_name.c_str());
+	if (err != XML_SUCCESS) {
+		std::cout << "Error writing PKD file " << tinyxml_error_string(err) << "\n";
+		throw std::runtime_error("export_pkd: failed to write " + file_name.file_name);
+	}
+}
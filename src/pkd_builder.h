@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+// Compute the order of the particles in a balanced implicit kd-tree (PKD), as rendered by
+// OSPRay's PKD geometry. Particle i of the order is node i of a complete binary tree
+// with the children of node k at 2k + 1 and 2k + 2. Each node splits its subtree at
+// its median along the widest axis of the subtree's bounds, which are narrowed at each
+// split. Subtrees are partitioned in parallel, level by level at the top of the tree
+std::vector<size_t> pkd_order(const Data &positions);
+
+// Write the model as a PKD, with the XML description in file_name and the arrays in a .pkdbin
+// file of the same name alongside it, as read by import_pkd. The positions and every other
+// attribute with a value per particle are written in PKD order as floats, attributes with
+// multiple components are split into one attribute per component, named name.0, name.1, ...
+// A single value radius attribute is written as the radius of the geometry
+void export_pkd(const FileName &file_name, const ParticleModel &model);
+
+}
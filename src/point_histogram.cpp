@@ -0,0 +1,136 @@
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <vector>
+#include "particle_lasso.h"
+#include "histogram.h"
+#include "json.hpp"
+
+using namespace pl;
+using json = nlohmann::json;
+
+std::string histogram_label(const std::string &attribute, const size_t component) {
+	if (component == MAGNITUDE) {
+		return attribute + " magnitude";
+	}
+	return attribute + "[" + std::to_string(component) + "]";
+}
+
+void write_histogram_json(const std::string &file_name, const std::string &attribute,
+		const std::vector<size_t> &components, const std::vector<Histogram> &hists)
+{
+	json report;
+	report["attribute"] = attribute;
+	report["histograms"] = json::array();
+	for (size_t i = 0; i < hists.size(); ++i) {
+		const Histogram &h = hists[i];
+		json edges = json::array();
+		for (size_t b = 0; b <= h.bins.size(); ++b) {
+			edges.push_back(h.edge(b));
+		}
+		report["histograms"].push_back({
+			{"component", components[i] == MAGNITUDE ? json("magnitude") : json(components[i])},
+			{"scale", h.scale == BinScale::LOG ? "log" : "linear"},
+			{"min", h.min},
+			{"max", h.max},
+			{"edges", edges},
+			{"bins", h.bins},
+			{"underflow", h.underflow},
+			{"overflow", h.overflow}
+		});
+	}
+	std::ofstream out(file_name);
+	out << report.dump(4) << "\n";
+}
+
+int main(int argc, char **argv){
+	if (argc < 3){
+		std::cout << "Usage: point_histogram input.(las|laz|xml|xyz|vtu|pkd|dat|gro) <attribute> [options]\n"
+			<< "Options:\n"
+			<< "     -bins <n>              - number of bins (default 256)\n"
+			<< "     -log                   - space the bins evenly in log10\n"
+			<< "     -component <c>         - only bin component c, by default each component is binned\n"
+			<< "     -magnitude             - bin the length of each particle's vector\n"
+			<< "     -range <min> <max>     - range of the bins, by default the range of the values\n"
+			<< "     -weights <attribute>   - weight each particle by a single component attribute\n"
+			<< "     -json <file>           - write the histograms to a JSON file instead of printing them\n";
+		return 1;
+	}
+	std::vector<std::string> args{argv, argv + argc};
+	HistogramOptions options;
+	std::vector<size_t> components;
+	std::string weights;
+	std::string json_file;
+	for (size_t i = 3; i < args.size(); ++i) {
+		if (args[i] == "-bins" && i + 1 < args.size()) {
+			options.bins = std::stoull(args[++i]);
+		} else if (args[i] == "-log") {
+			options.scale = BinScale::LOG;
+		} else if (args[i] == "-component" && i + 1 < args.size()) {
+			components.push_back(std::stoull(args[++i]));
+		} else if (args[i] == "-magnitude") {
+			components.push_back(MAGNITUDE);
+		} else if (args[i] == "-range" && i + 2 < args.size()) {
+			options.min = std::stod(args[++i]);
+			options.max = std::stod(args[++i]);
+		} else if (args[i] == "-weights" && i + 1 < args.size()) {
+			weights = args[++i];
+		} else if (args[i] == "-json" && i + 1 < args.size()) {
+			json_file = args[++i];
+		} else {
+			std::cout << "Unrecognized option " << args[i] << "\n";
+			return 1;
+		}
+	}
+
+	std::vector<ParticleModel> timesteps = lasso_particles(FileName(args[1]));
+	if (timesteps.empty()){
+		std::cout << "Error: No data loaded\n";
+		return 1;
+	}
+	// Only the first timestep is binned
+	ParticleModel &model = timesteps[0];
+	auto fnd = model.find(args[2]);
+	if (fnd == model.end()) {
+		std::cout << "Error: No attribute " << args[2] << " in the data, the attributes are:";
+		for (const auto &a : model) {
+			std::cout << " " << a.first;
+		}
+		std::cout << "\n";
+		return 1;
+	}
+	const Data &data = *fnd->second;
+	if (!weights.empty()) {
+		auto w = model.find(weights);
+		if (w == model.end()) {
+			std::cout << "Error: No weights attribute " << weights << " in the data\n";
+			return 1;
+		}
+		options.weights = w->second;
+	}
+	if (components.empty()) {
+		for (size_t c = 0; c < data.components; ++c) {
+			components.push_back(c);
+		}
+	}
+
+	std::vector<Histogram> hists;
+	for (const auto &c : components) {
+		hists.push_back(histogram(data, c, options));
+	}
+	if (!json_file.empty()) {
+		std::cout << "Writing histograms to '" << json_file << "'\n";
+		write_histogram_json(json_file, args[2], components, hists);
+		return 0;
+	}
+	for (size_t i = 0; i < hists.size(); ++i) {
+		const Histogram &h = hists[i];
+		std::cout << "# " << histogram_label(args[2], components[i])
+			<< ": underflow " << h.underflow << ", overflow " << h.overflow << "\n"
+			<< "# bin_min bin_max count\n";
+		for (size_t b = 0; b < h.bins.size(); ++b) {
+			std::cout << h.edge(b) << " " << h.edge(b + 1) << " " << h.bins[b] << "\n";
+		}
+	}
+	return 0;
+}
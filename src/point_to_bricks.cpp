@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "particle_lasso.h"
+#include "bricking.h"
+
+using namespace pl;
+
+int main(int argc, char **argv){
+	if (argc < 6){
+		std::cout << "Usage: point_to_bricks input.(las|laz|xml|xyz|vtu|pkd|dat|gro) <output>.json <nx> <ny> <nz> [options]\n"
+			<< "Splits the particles into a grid of nx * ny * nz bricks, each written to\n"
+			<< "<output>_brick<i>_<attribute>.raw, with the brick bounds written to <output>.json\n"
+			<< "Options:\n"
+			<< "     -ghost <w>         - copy particles within w of a brick into it as ghosts\n"
+			<< "     -ghost radius      - use the largest particle radius as the ghost width\n"
+			<< "     -memory            - print the memory used by each phase of the conversion\n";
+		return 1;
+	}
+	std::vector<std::string> args{argv, argv + argc};
+	BrickOptions options;
+	for (size_t c = 0; c < 3; ++c) {
+		options.dims[c] = std::stoull(args[3 + c]);
+	}
+	bool print_memory = false;
+	std::string ghost;
+	for (size_t i = 6; i < args.size(); ++i) {
+		if (args[i] == "-ghost" && i + 1 < args.size()) {
+			ghost = args[++i];
+		} else if (args[i] == "-memory") {
+			print_memory = true;
+		} else {
+			std::cout << "Unrecognized option " << args[i] << "\n";
+			return 1;
+		}
+	}
+	std::shared_ptr<AllocationTracker> tracker;
+	if (print_memory) {
+		tracker = enable_allocation_tracking();
+	}
+
+	std::vector<ParticleModel> timesteps = lasso_particles(FileName(args[1]));
+	if (timesteps.empty() || timesteps[0].empty()){
+		std::cout << "Error: No data loaded\n";
+		return 1;
+	}
+	// Only the first timestep is bricked
+	const ParticleModel &model = timesteps[0];
+	if (ghost == "radius") {
+		auto radius = model.find("radius");
+		if (radius == model.end()) {
+			std::cout << "Error: the data has no radius to use as the ghost width\n";
+			return 1;
+		}
+		options.ghost_width = static_cast<float>(range(*radius->second)->components[0].max);
+	} else if (!ghost.empty()) {
+		options.ghost_width = std::stof(ghost);
+	}
+
+	const std::vector<Brick> bricks = brick_particles(model, options);
+	for (size_t i = 0; i < bricks.size(); ++i) {
+		std::cout << "Brick " << i << ": " << bricks[i].owned << " particles, "
+			<< bricks[i].ghosts << " ghosts\n";
+	}
+	export_bricks(FileName(args[2]), bricks);
+	if (print_memory) {
+		tracker->print_report(std::cout);
+	}
+	return 0;
+}
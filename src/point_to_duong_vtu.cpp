@@ -83,7 +83,7 @@ void write_duong_vtu(const FileName &file_name, const std::shared_ptr<Data> &pos
     file.write(padding.data(), padding.size());
 
 	DuongVTUHeader header;
-    header.size = positions->size() / 3;
+    header.size = positions->count();
     header.step = 0;
     header.time = 0.f;
 	std::cout << "Writing out " << header.size << " particles\n";
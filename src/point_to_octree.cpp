@@ -0,0 +1,63 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "particle_lasso.h"
+#include "octree.h"
+
+using namespace pl;
+
+int main(int argc, char **argv){
+	if (argc < 3){
+		std::cout << "Usage: point_to_octree <output>.json input.(las|laz|xml|xyz|vtu|pkd|dat|gro)... [options]\n"
+			<< "Builds a multi-resolution octree over the inputs, which are loaded one at a time.\n"
+			<< "The hierarchy is written to <output>.json and each node to <output>_<node>.bin\n"
+			<< "Options:\n"
+			<< "     -capacity <n>      - most particles in a leaf or samples in an inner node (default 65536)\n"
+			<< "     -budget <MB>       - memory to use for the particles being built (default 1024)\n"
+			<< "     -grid <n>          - resolution of the grid the particles are counted in (default 128)\n"
+			<< "     -memory            - print the memory used by each phase of the build\n";
+		return 1;
+	}
+	std::vector<std::string> args{argv, argv + argc};
+	std::vector<FileName> inputs;
+	OctreeOptions options;
+	bool print_memory = false;
+	for (size_t i = 2; i < args.size(); ++i) {
+		if (args[i] == "-capacity" && i + 1 < args.size()) {
+			options.node_capacity = std::stoull(args[++i]);
+		} else if (args[i] == "-budget" && i + 1 < args.size()) {
+			options.memory_budget = std::stoull(args[++i]) << 20;
+		} else if (args[i] == "-grid" && i + 1 < args.size()) {
+			options.count_grid = std::stoull(args[++i]);
+		} else if (args[i] == "-memory") {
+			print_memory = true;
+		} else if (args[i][0] == '-') {
+			std::cout << "Unrecognized option " << args[i] << "\n";
+			return 1;
+		} else {
+			inputs.push_back(FileName(args[i]));
+		}
+	}
+	if (inputs.empty()) {
+		std::cout << "Error: No inputs given\n";
+		return 1;
+	}
+	std::shared_ptr<AllocationTracker> tracker;
+	if (print_memory) {
+		tracker = enable_allocation_tracking();
+	}
+
+	const std::vector<OctreeNode> nodes = build_octree(inputs, FileName(args[1]), options);
+	size_t leaves = 0;
+	size_t depth = 0;
+	for (const auto &n : nodes) {
+		leaves += n.leaf ? 1 : 0;
+		depth = std::max(depth, n.name.size() - 1);
+	}
+	std::cout << "Wrote " << nodes.size() << " nodes, " << leaves << " leaves, "
+		<< depth + 1 << " levels\n";
+	if (print_memory) {
+		tracker->print_report(std::cout);
+	}
+	return 0;
+}
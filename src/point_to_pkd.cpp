@@ -0,0 +1,53 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "particle_lasso.h"
+#include "pkd_builder.h"
+
+using namespace pl;
+
+int main(int argc, char **argv){
+	if (argc < 3){
+		std::cout << "Usage: point_to_pkd input.(las|laz|xml|xyz|vtu|pkd|dat|gro) <output>.pkd [options]\n"
+			<< "Writes <output>.pkd and <output>.pkdbin for OSPRay's PKD geometry\n"
+			<< "Options:\n"
+			<< "     -radius <r>        - radius of the particles, if the data doesn't have one\n"
+			<< "     -memory            - print the memory used by each phase of the conversion\n";
+		return 1;
+	}
+	std::vector<std::string> args{argv, argv + argc};
+	bool print_memory = false;
+	std::string radius;
+	for (size_t i = 3; i < args.size(); ++i) {
+		if (args[i] == "-memory") {
+			print_memory = true;
+		} else if (args[i] == "-radius" && i + 1 < args.size()) {
+			radius = args[++i];
+		} else {
+			std::cout << "Unrecognized option " << args[i] << "\n";
+			return 1;
+		}
+	}
+	std::shared_ptr<AllocationTracker> tracker;
+	if (print_memory) {
+		tracker = enable_allocation_tracking();
+	}
+
+	std::vector<ParticleModel> timesteps = lasso_particles(FileName(args[1]));
+	if (timesteps.empty() || timesteps[0].empty()){
+		std::cout << "Error: No data loaded\n";
+		return 1;
+	}
+	// Only the first timestep is converted
+	ParticleModel &model = timesteps[0];
+	if (!radius.empty()) {
+		auto r = std::make_shared<DataT<float>>();
+		r->data.push_back(std::stof(radius));
+		model["radius"] = r;
+	}
+	export_pkd(FileName(args[2]), model);
+	if (print_memory) {
+		tracker->print_report(std::cout);
+	}
+	return 0;
+}
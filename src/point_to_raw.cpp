@@ -10,23 +10,83 @@
 #include "import_xyz.h"
 #include "import_scivis16.h"
 #include "import_pkd.h"
+#include "memory_report.h"
+#include "narrow.h"
+#include "json.hpp"
 
 using namespace pl;
+using json = nlohmann::json;
+
+void write_memory_json(const std::string &file_name, const ParticleModel &model,
+		AllocationTracker &tracker)
+{
+	json report;
+	report["model_bytes"] = model_bytes(model);
+	report["attributes"] = json::array();
+	for (const auto &a : model_footprint(model)) {
+		report["attributes"].push_back({
+			{"name", a.name},
+			{"type", a.type},
+			{"count", a.count},
+			{"components", a.components},
+			{"bytes", a.bytes}
+		});
+	}
+	report["current_bytes"] = tracker.current_bytes();
+	report["peak_bytes"] = tracker.peak_bytes();
+	report["phases"] = json::array();
+	for (const auto &p : tracker.phase_report()) {
+		report["phases"].push_back({
+			{"name", p.name},
+			{"start_bytes", p.start_bytes},
+			{"end_bytes", p.end_bytes},
+			{"peak_bytes", p.peak_bytes},
+			{"allocated_bytes", p.allocated_bytes}
+		});
+	}
+	std::ofstream out(file_name);
+	out << report.dump(4) << "\n";
+}
 
 int main(int argc, char **argv){
 	if (argc < 3){
-		std::cout << "Usage: point_to_raw input.(las|laz|xml|xyz|vtu|pkd) <output>.raw\n"
+		std::cout << "Usage: point_to_raw input.(las|laz|xml|xyz|vtu|pkd) <output>.raw [options]\n"
 #if PARTICLE_LASSO_ENABLE_LIDAR
 			<< "     (las|laz) - LIDAR data\n"
 #endif
 			<< "     xml       - Uintah data\n"
 			<< "     xyz       - XYZ atomic data\n"
 			<< "     pkd       - PKD data\n"
-			<< "     vtu       - SciVis16 contest data\n";
+			<< "     vtu       - SciVis16 contest data\n"
+			<< "Options:\n"
+			<< "     -narrow            - store integer attributes in the narrowest type that fits\n"
+			<< "     -memory            - print the memory used by the model and each import phase\n"
+			<< "     -memory-json <file> - write the memory report to a JSON file\n";
 		return 1;
 	}
-	ParticleModel model;
 	std::vector<std::string> args{argv, argv + argc};
+	bool print_memory = false;
+	bool narrow = false;
+	std::string memory_json;
+	for (size_t i = 3; i < args.size(); ++i) {
+		if (args[i] == "-memory") {
+			print_memory = true;
+		} else if (args[i] == "-narrow") {
+			narrow = true;
+		} else if (args[i] == "-memory-json" && i + 1 < args.size()) {
+			memory_json = args[++i];
+		} else {
+			std::cout << "Unrecognized option " << args[i] << "\n";
+			return 1;
+		}
+	}
+	// Tracking must be enabled before the model's arrays are allocated
+	std::shared_ptr<AllocationTracker> tracker;
+	if (print_memory || !memory_json.empty()) {
+		tracker = enable_allocation_tracking();
+	}
+
+	ParticleModel model;
 	FileName input(args[1]);
     if (input.extension() == "xml"){
 		std::cout << "Converting Uintah data\n";
@@ -52,12 +112,22 @@ int main(int argc, char **argv){
 		std::cout << "Error: No data loaded\n";
 		return 1;
 	}
+	if (narrow) {
+		std::cout << "Narrowing saved " << narrow_model(model) << " bytes\n";
+	}
 	for (const auto &d : model){
 		std::cout << "Writing data " << d.first << " to '"
 			<< args[2] + "_" + d.first + ".raw'\n";
 		std::ofstream out(args[2] + "_" + d.first + ".raw", std::ios::binary);
 		d.second->write(out);
 	}
+	if (print_memory) {
+		print_footprint(std::cout, model);
+		tracker->print_report(std::cout);
+	}
+	if (!memory_json.empty()) {
+		write_memory_json(memory_json, model, *tracker);
+	}
 	return 0;
 }
 
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "kernels.h"
+#include "layout.h"
+#include "stats.h"
+#include "quantize.h"
+
+using namespace pl;
+
+// Number of elements decoded at a time when writing out encoded data
+const size_t WRITE_BLOCK = 64 * 1024;
+
+static uint32_t float_bits(const float f) {
+	uint32_t u;
+	std::memcpy(&u, &f, sizeof(float));
+	return u;
+}
+static float bits_float(const uint32_t u) {
+	float f;
+	std::memcpy(&f, &u, sizeof(float));
+	return f;
+}
+
+// The conversions follow Fabian Giesen's branch-light float/half conversions, so
+// the compiler can if-convert and vectorize the bulk loops when F16C isn't available
+uint16_t pl::float_to_half(const float f) {
+	const uint32_t f32_infinity = 255u << 23;
+	const uint32_t f16_max = (127u + 16u) << 23;
+	const uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+	uint32_t x = float_bits(f);
+	const uint32_t sign = x & 0x80000000u;
+	x ^= sign;
+
+	uint32_t h = 0;
+	if (x >= f16_max) {
+		// Overflow to infinity, NaNs stay NaN
+		h = x > f32_infinity ? 0x7e00 : 0x7c00;
+	} else if (x < (113u << 23)) {
+		// Denormal or zero, let the FPU do the rounding
+		h = float_bits(bits_float(x) + bits_float(denorm_magic)) - denorm_magic;
+	} else {
+		const uint32_t mantissa_odd = (x >> 13) & 1;
+		x += ((15u - 127u) << 23) + 0xfff;
+		x += mantissa_odd;
+		h = x >> 13;
+	}
+	return static_cast<uint16_t>(h | (sign >> 16));
+}
+float pl::half_to_float(const uint16_t h) {
+	const uint32_t shifted_exponent = 0x7c00u << 13;
+	uint32_t x = (h & 0x7fffu) << 13;
+	const uint32_t exponent = x & shifted_exponent;
+	x += (127u - 15u) << 23;
+	if (exponent == shifted_exponent) {
+		// Infinity or NaN
+		x += (128u - 16u) << 23;
+	} else if (exponent == 0) {
+		// Denormal or zero, renormalize
+		x += 1u << 23;
+		x = float_bits(bits_float(x) - bits_float(113u << 23));
+	}
+	return bits_float(x | ((h & 0x8000u) << 16));
+}
+void pl::encode_half(const float *in, uint16_t *out, const size_t n) {
+	size_t i = detail::convert_f32_f16(in, n, out);
+	for (; i < n; ++i) {
+		out[i] = float_to_half(in[i]);
+	}
+}
+void pl::decode_half(const uint16_t *in, float *out, const size_t n) {
+	size_t i = detail::convert_f16_f32(in, n, out);
+	for (; i < n; ++i) {
+		out[i] = half_to_float(in[i]);
+	}
+}
+
+// Write the data out block by block, decoded to floats
+static void write_decoded(const Data &data, std::ofstream &os) {
+	std::cout << "Writing " << data.size() << " " << typeid(float).name()
+		<< ", file is " << sizeof(float) * data.size() << " bytes\n";
+	std::vector<float> block(std::min(data.size(), WRITE_BLOCK));
+	for (size_t i = 0; i < data.size(); i += WRITE_BLOCK) {
+		const size_t end = std::min(i + WRITE_BLOCK, data.size());
+		data.get_floats(i, end, block.data());
+		os.write(reinterpret_cast<const char*>(block.data()), sizeof(float) * (end - i));
+	}
+}
+
+HalfData::HalfData(const std::shared_ptr<MemoryResource> &resource)
+	: data(ResourceAllocator<uint16_t>(resource))
+{}
+const std::type_info& HalfData::type() const {
+	return typeid(float);
+}
+void HalfData::write(std::ofstream &os) const {
+	write_decoded(*this, os);
+}
+float HalfData::get_float(const size_t i) const {
+	return half_to_float(data[i]);
+}
+size_t HalfData::size() const {
+	return data.size();
+}
+size_t HalfData::bytes() const {
+	return data.capacity() * sizeof(uint16_t);
+}
+void HalfData::get_floats(const size_t begin, const size_t end, float *out) const {
+	decode_half(data.data() + begin, out, end - begin);
+}
+void HalfData::get_doubles(const size_t begin, const size_t end, double *out) const {
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = half_to_float(data[i]);
+	}
+}
+
+std::shared_ptr<HalfData> pl::to_half(const Data &data) {
+	auto half = std::make_shared<HalfData>();
+	half->components = data.components;
+	half->layout = data.layout;
+	half->data.resize(data.size());
+	parallel_for(0, data.size(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+		float block[1024];
+		for (size_t i = begin; i < end; i += 1024) {
+			const size_t n = std::min(end - i, size_t(1024));
+			data.get_floats(i, i + n, block);
+			encode_half(block, half->data.data() + i, n);
+		}
+	});
+	return half;
+}
+
+QuantizedPositions::QuantizedPositions(const std::shared_ptr<MemoryResource> &resource)
+	: data(ResourceAllocator<uint16_t>(resource)), lower(0.f), scale(0.f)
+{}
+const std::type_info& QuantizedPositions::type() const {
+	return typeid(float);
+}
+void QuantizedPositions::write(std::ofstream &os) const {
+	write_decoded(*this, os);
+}
+void QuantizedPositions::alias(const uint16_t *array, const size_t elements,
+		const std::shared_ptr<void> &owner)
+{
+	data = std::vector<uint16_t, ResourceAllocator<uint16_t>>(data.get_allocator());
+	this->owner = owner;
+	external = array;
+	external_elements = elements;
+	invalidate_stats();
+}
+const uint16_t* QuantizedPositions::values() const {
+	return external ? external : data.data();
+}
+float QuantizedPositions::get_float(const size_t i) const {
+	const size_t c = layout == Layout::AOS ? i % 3 : i / (size() / 3);
+	return lower[c] + values()[i] * scale[c];
+}
+size_t QuantizedPositions::size() const {
+	return external ? external_elements : data.size();
+}
+size_t QuantizedPositions::bytes() const {
+	return external ? external_elements * sizeof(uint16_t) : data.capacity() * sizeof(uint16_t);
+}
+void QuantizedPositions::get_floats(const size_t begin, const size_t end, float *out) const {
+	const uint16_t *q = values();
+	if (layout == Layout::AOS) {
+		const float lo[3] = {lower.x, lower.y, lower.z};
+		const float s[3] = {scale.x, scale.y, scale.z};
+		size_t i = begin;
+		// Decode up to the first whole particle, then whole particles at a time
+		for (; i < end && i % 3 != 0; ++i) {
+			out[i - begin] = lo[i % 3] + q[i] * s[i % 3];
+		}
+		const size_t particles = (end - i) / 3;
+		dequantize_u16_f32(q + i, particles, 3, s, lo, out + (i - begin));
+		i += particles * 3;
+		for (; i < end; ++i) {
+			out[i - begin] = lo[i % 3] + q[i] * s[i % 3];
+		}
+	} else {
+		const size_t n = size() / 3;
+		for (size_t i = begin; i < end;) {
+			const size_t c = i / n;
+			const size_t stream_end = std::min(end, (c + 1) * n);
+			dequantize_u16_f32(q + i, stream_end - i, 1, &scale[c], &lower[c],
+					out + (i - begin));
+			i = stream_end;
+		}
+	}
+}
+void QuantizedPositions::get_doubles(const size_t begin, const size_t end, double *out) const {
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = get_float(i);
+	}
+}
+vec3f QuantizedPositions::max_error() const {
+	// Half a quantization step, plus the float rounding error of decoding
+	vec3f error;
+	for (size_t c = 0; c < 3; ++c) {
+		const float upper = lower[c] + std::numeric_limits<uint16_t>::max() * scale[c];
+		const float magnitude = std::max(std::abs(lower[c]), std::abs(upper));
+		error[c] = 0.5f * scale[c] + 4.f * magnitude * std::numeric_limits<float>::epsilon();
+	}
+	return error;
+}
+
+std::shared_ptr<QuantizedPositions> pl::quantize_positions(const Data &positions,
+		const vec3f &lower, const vec3f &upper)
+{
+	if (positions.components != 3) {
+		throw std::runtime_error("quantize_positions: positions must have 3 components");
+	}
+	const float max_q = std::numeric_limits<uint16_t>::max();
+	auto quantized = std::make_shared<QuantizedPositions>();
+	quantized->components = 3;
+	quantized->layout = positions.layout;
+	quantized->lower = lower;
+	quantized->scale = (upper - lower) / vec3f(max_q);
+	quantized->data.resize(positions.size());
+
+	vec3f inv_scale;
+	for (size_t c = 0; c < 3; ++c) {
+		inv_scale[c] = quantized->scale[c] > 0.f ? 1.f / quantized->scale[c] : 0.f;
+	}
+	const ComponentStrides in_strides(positions);
+	const ComponentStrides out_strides(*quantized);
+	uint16_t *out = quantized->data.data();
+	visit(positions, [&](const auto &view) {
+		parallel_for(0, positions.count(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+			for (size_t c = 0; c < 3; ++c) {
+				const auto *in = view.data() + c * in_strides.component_stride;
+				uint16_t *q = out + c * out_strides.component_stride;
+				const float lo = lower[c];
+				const float inv = inv_scale[c];
+				for (size_t i = begin; i < end; ++i) {
+					const float x = (static_cast<float>(in[i * in_strides.particle_stride]) - lo)
+						* inv + 0.5f;
+					// Casting a NaN is undefined, so they're quantized to 0
+					q[i * out_strides.particle_stride] = std::isnan(x) ? 0
+						: static_cast<uint16_t>(clamp(x, 0.f, max_q));
+				}
+			}
+		});
+	});
+	return quantized;
+}
+std::shared_ptr<QuantizedPositions> pl::quantize_positions(const Data &positions) {
+	auto bounds = range(positions);
+	vec3f lower, upper;
+	for (size_t c = 0; c < 3; ++c) {
+		lower[c] = static_cast<float>(bounds->components[c].min);
+		upper[c] = static_cast<float>(bounds->components[c].max);
+	}
+	return quantize_positions(positions, lower, upper);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include "types.h"
+
+namespace pl {
+
+// Convert between float and IEEE half precision floats stored as uint16_t.
+// Conversion to half rounds to nearest even. The bulk conversions use F16C if the
+// CPU has it and the SIMD level is at least AVX2, see kernels.h
+uint16_t float_to_half(const float f);
+float half_to_float(const uint16_t h);
+void encode_half(const float *in, uint16_t *out, const size_t n);
+void decode_half(const uint16_t *in, float *out, const size_t n);
+
+// Scalar attributes stored as IEEE half precision floats, which are
+// decoded to float on access
+struct HalfData : Data {
+	std::vector<uint16_t, ResourceAllocator<uint16_t>> data;
+
+	HalfData(const std::shared_ptr<MemoryResource> &resource = nullptr);
+	// The logical type of the data is float, write outputs the decoded floats
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	size_t bytes() const override;
+};
+
+// Convert the data to half precision
+std::shared_ptr<HalfData> to_half(const Data &data);
+
+// Positions quantized to 16 bits per component relative to a bounding box.
+// Each component is stored as lower + q * scale, with q in [0, 65535]. The
+// values are held in data, or alias an external buffer, see alias
+struct QuantizedPositions : Data {
+	std::vector<uint16_t, ResourceAllocator<uint16_t>> data;
+	vec3f lower;
+	vec3f scale;
+
+	QuantizedPositions(const std::shared_ptr<MemoryResource> &resource = nullptr);
+	// Use the elements of an external buffer, e.g. a mapped file, as the quantized
+	// values instead of data. As for ExternalDataT, the owner keeps the buffer alive
+	void alias(const uint16_t *array, const size_t elements, const std::shared_ptr<void> &owner);
+	// Get the quantized values, from data or the aliased buffer
+	const uint16_t* values() const;
+	// The logical type of the data is float, write outputs the decoded positions
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	size_t bytes() const override;
+	// Get the maximum error of the decoded positions along each axis,
+	// for positions inside the quantization bounds
+	vec3f max_error() const;
+
+private:
+	std::shared_ptr<void> owner;
+	const uint16_t *external = nullptr;
+	size_t external_elements = 0;
+};
+
+// Quantize the positions relative to the box [lower, upper], positions outside the box
+// are clamped to it and NaN components are quantized to the lower bound. The layout of
+// the positions is preserved
+std::shared_ptr<QuantizedPositions> quantize_positions(const Data &positions,
+		const vec3f &lower, const vec3f &upper);
+// Quantize the positions relative to their bounding box
+std::shared_ptr<QuantizedPositions> quantize_positions(const Data &positions);
+
+}
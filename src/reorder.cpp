@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include "layout.h"
+#include "parallel.h"
+#include "transform.h"
+#include "view.h"
+#include "reorder.h"
+
+using namespace pl;
+
+// Keys are computed on blocks of particles, with the quantization and bit twiddling
+// done one step at a time over the block in loops which can be vectorized
+const size_t KEY_BLOCK = 1024;
+const size_t KEY_GRAIN = 64 * KEY_BLOCK;
+const uint32_t KEY_BITS = 21;
+const uint32_t KEY_MAX = (1u << KEY_BITS) - 1;
+// The radix sort handles a byte of the key per pass
+const size_t RADIX_BITS = 8;
+const size_t RADIX_BUCKETS = 1 << RADIX_BITS;
+const size_t SORT_GRAIN = 1 << 16;
+
+// Spread the low 21 bits of x out to every third bit
+static inline uint64_t spread_bits(uint64_t x) {
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x << 8) & 0x100f00f00f00f00full;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+	x = (x | x << 2) & 0x1249249249249249ull;
+	return x;
+}
+
+// Map the coordinates of each particle to the transposed form of their Hilbert index,
+// with Skilling's algorithm ("Programming the Hilbert curve", 2004). The branches are
+// replaced by masks so each step is applied across the block
+static void hilbert_transpose(uint32_t *x, uint32_t *y, uint32_t *z, const size_t n) {
+	uint32_t *axes[3] = {x, y, z};
+	for (uint32_t q = 1u << (KEY_BITS - 1); q > 1; q >>= 1) {
+		const uint32_t p = q - 1;
+		for (size_t a = 0; a < 3; ++a) {
+			uint32_t *xa = axes[a];
+			for (size_t i = 0; i < n; ++i) {
+				// If the bit is set invert the low bits of x, otherwise exchange them with axis a
+				const uint32_t set = 0u - static_cast<uint32_t>((xa[i] & q) != 0);
+				const uint32_t t = (x[i] ^ xa[i]) & p & ~set;
+				x[i] ^= (p & set) ^ t;
+				xa[i] ^= a == 0 ? 0 : t;
+			}
+		}
+	}
+	// Gray encode
+	for (size_t i = 0; i < n; ++i) {
+		y[i] ^= x[i];
+		z[i] ^= y[i];
+		uint32_t t = 0;
+		for (uint32_t q = 1u << (KEY_BITS - 1); q > 1; q >>= 1) {
+			t ^= (z[i] & q) ? q - 1 : 0;
+		}
+		x[i] ^= t;
+		y[i] ^= t;
+		z[i] ^= t;
+	}
+}
+
+std::vector<uint64_t> pl::spatial_keys(const Data &positions, const SpaceFillingCurve curve) {
+	if (positions.components != 3) {
+		throw std::runtime_error("spatial_keys: positions must have 3 components");
+	}
+	const size_t n = positions.count();
+	std::vector<uint64_t> keys(n);
+	if (n == 0) {
+		return keys;
+	}
+	// Quantize within the cube around the bounds, so the curve isn't stretched along an axis
+	const box3f box = bounds(positions);
+	const vec3f size = box.size();
+	const float extent = std::max(size.x, std::max(size.y, size.z));
+	const float scale = extent > 0.f ? KEY_MAX / extent : 0.f;
+	const ComponentStrides strides(positions);
+
+	visit(positions, [&](const auto &view) {
+		parallel_for(0, n, KEY_GRAIN, [&](const size_t begin, const size_t end) {
+			std::vector<uint32_t> q(3 * KEY_BLOCK);
+			uint32_t *axes[3] = {q.data(), q.data() + KEY_BLOCK, q.data() + 2 * KEY_BLOCK};
+			for (size_t b = begin; b < end; b += KEY_BLOCK) {
+				const size_t count = std::min(b + KEY_BLOCK, end) - b;
+				for (size_t c = 0; c < 3; ++c) {
+					const auto *in = view.data() + b * strides.particle_stride
+						+ c * strides.component_stride;
+					const float lower = box.lower[c];
+					for (size_t i = 0; i < count; ++i) {
+						float t = (static_cast<float>(in[i * strides.particle_stride]) - lower) * scale;
+						// NaNs are sent to 0
+						t = t > 0.f ? t : 0.f;
+						axes[c][i] = static_cast<uint32_t>(std::min(t, static_cast<float>(KEY_MAX)));
+					}
+				}
+				uint64_t *out = keys.data() + b;
+				if (curve == SpaceFillingCurve::MORTON) {
+					for (size_t i = 0; i < count; ++i) {
+						out[i] = spread_bits(axes[0][i]) | spread_bits(axes[1][i]) << 1
+							| spread_bits(axes[2][i]) << 2;
+					}
+				} else {
+					hilbert_transpose(axes[0], axes[1], axes[2], count);
+					// The index takes the bits of each level from the first axis down
+					for (size_t i = 0; i < count; ++i) {
+						out[i] = spread_bits(axes[0][i]) << 2 | spread_bits(axes[1][i]) << 1
+							| spread_bits(axes[2][i]);
+					}
+				}
+			}
+		});
+	});
+	return keys;
+}
+
+std::vector<size_t> pl::sort_permutation(const std::vector<uint64_t> &keys) {
+	const size_t n = keys.size();
+	std::vector<uint64_t> key_buf[2] = {keys, std::vector<uint64_t>(n)};
+	std::vector<size_t> index_buf[2] = {std::vector<size_t>(n), std::vector<size_t>(n)};
+	parallel_for(0, n, SORT_GRAIN, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			index_buf[0][i] = i;
+		}
+	});
+
+	// Each chunk is histogrammed and scattered by one thread. Chunks write to their own
+	// region of each bucket, in order, so each pass is stable
+	const size_t chunks = std::max(std::min(num_threads(), n / SORT_GRAIN), size_t(1));
+	const size_t chunk_size = (n + chunks - 1) / chunks;
+	std::vector<size_t> counts(chunks * RADIX_BUCKETS);
+	size_t src = 0;
+	for (size_t shift = 0; shift < 64; shift += RADIX_BITS) {
+		const uint64_t *in_keys = key_buf[src].data();
+		std::fill(counts.begin(), counts.end(), 0);
+		parallel_for(0, chunks, 1, [&](const size_t begin, const size_t end) {
+			for (size_t c = begin; c < end; ++c) {
+				size_t *count = counts.data() + c * RADIX_BUCKETS;
+				const size_t e = std::min((c + 1) * chunk_size, n);
+				for (size_t i = c * chunk_size; i < e; ++i) {
+					++count[(in_keys[i] >> shift) & (RADIX_BUCKETS - 1)];
+				}
+			}
+		});
+		// Skip passes where every key has the same digit, e.g. the high bits
+		bool trivial = false;
+		for (size_t d = 0; d < RADIX_BUCKETS; ++d) {
+			size_t total = 0;
+			for (size_t c = 0; c < chunks; ++c) {
+				total += counts[c * RADIX_BUCKETS + d];
+			}
+			if (total != 0) {
+				trivial = total == n;
+				break;
+			}
+		}
+		if (trivial) {
+			continue;
+		}
+		// Turn the counts into the offset of each chunk's region of each bucket
+		size_t offset = 0;
+		for (size_t d = 0; d < RADIX_BUCKETS; ++d) {
+			for (size_t c = 0; c < chunks; ++c) {
+				const size_t count = counts[c * RADIX_BUCKETS + d];
+				counts[c * RADIX_BUCKETS + d] = offset;
+				offset += count;
+			}
+		}
+		const size_t *in_index = index_buf[src].data();
+		uint64_t *out_keys = key_buf[1 - src].data();
+		size_t *out_index = index_buf[1 - src].data();
+		parallel_for(0, chunks, 1, [&](const size_t begin, const size_t end) {
+			for (size_t c = begin; c < end; ++c) {
+				size_t *offsets = counts.data() + c * RADIX_BUCKETS;
+				const size_t e = std::min((c + 1) * chunk_size, n);
+				for (size_t i = c * chunk_size; i < e; ++i) {
+					const size_t j = offsets[(in_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+					out_keys[j] = in_keys[i];
+					out_index[j] = in_index[i];
+				}
+			}
+		});
+		src = 1 - src;
+	}
+	return std::move(index_buf[src]);
+}
+
+std::vector<size_t> pl::spatial_order(const Data &positions, const SpaceFillingCurve curve) {
+	return sort_permutation(spatial_keys(positions, curve));
+}
+
+void pl::reorder_spatially(ParticleModel &model, const SpaceFillingCurve curve) {
+	auto fnd = model.find("positions");
+	if (fnd == model.end()) {
+		throw std::runtime_error("reorder_spatially: the model has no positions");
+	}
+	auto order = std::make_shared<const std::vector<size_t>>(spatial_order(*fnd->second, curve));
+	ParticleModel reordered = materialize(view_rows(model, order));
+	// Reordering doesn't change the stats, so the cached ones can be kept
+	for (auto &a : reordered) {
+		auto &original = model[a.first];
+		if (a.second != original) {
+			std::atomic_store(&a.second->cached_stats, std::atomic_load(&original->cached_stats));
+		}
+	}
+	model = std::move(reordered);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+enum class SpaceFillingCurve {
+	MORTON,
+	HILBERT
+};
+
+// Compute a 63 bit key along the curve for each particle. The positions are quantized
+// to 21 bits per axis within the cube enclosing their bounds
+std::vector<uint64_t> spatial_keys(const Data &positions, const SpaceFillingCurve curve);
+
+// Sort the keys with a parallel LSD radix sort and return the permutation which
+// puts them in order, i.e. the index of the particle to place at each position.
+// The sort is stable
+std::vector<size_t> sort_permutation(const std::vector<uint64_t> &keys);
+
+// Get the order of the particles along the curve
+std::vector<size_t> spatial_order(const Data &positions, const SpaceFillingCurve curve);
+
+// Reorder every attribute of the model with a value per particle along the curve,
+// so particles close in space are close in memory. Attributes which don't have a
+// value per particle are left as-is. The arrays are replaced by gathered copies in
+// the same layout, see materialize, and keep their cached stats
+void reorder_spatially(ParticleModel &model, const SpaceFillingCurve curve = SpaceFillingCurve::MORTON);
+
+}
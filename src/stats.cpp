@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include "layout.h"
+#include "parallel.h"
+#include "stats.h"
+
+using namespace pl;
+
+// Particles are reduced in blocks, so each block's loops can be vectorized
+// and its variance computed in two passes about the block mean
+const size_t STATS_BLOCK = 4096;
+const size_t STATS_GRAIN = 16 * STATS_BLOCK;
+
+struct Accumulator {
+	double min = std::numeric_limits<double>::infinity();
+	double max = -std::numeric_limits<double>::infinity();
+	double mean = 0.0;
+	// Sum of squared differences from the mean
+	double m2 = 0.0;
+	size_t count = 0;
+
+	// Merge the other accumulator with Chan et al.'s parallel variance update
+	void merge(const Accumulator &b) {
+		if (b.count == 0) {
+			return;
+		}
+		min = std::min(min, b.min);
+		max = std::max(max, b.max);
+		const size_t n = count + b.count;
+		const double delta = b.mean - mean;
+		mean += delta * b.count / n;
+		m2 += b.m2 + delta * delta * (double(count) * b.count / n);
+		count = n;
+	}
+};
+
+// The bounds the block's min and max start from, infinity for floating point types
+template<typename T>
+static T max_value() {
+	return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+		: std::numeric_limits<T>::max();
+}
+template<typename T>
+static T min_value() {
+	return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+		: std::numeric_limits<T>::lowest();
+}
+
+// NaNs are skipped, x != x only holds for them, so the checks fold away for integer types
+template<typename T>
+static Accumulator reduce_block(const T *in, const size_t stride, const size_t n) {
+	T lo = max_value<T>();
+	T hi = min_value<T>();
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const T x = in[i * stride];
+		if (x != x) {
+			continue;
+		}
+		lo = std::min(lo, x);
+		hi = std::max(hi, x);
+		sum += static_cast<double>(x);
+		++count;
+	}
+	Accumulator a;
+	if (count == 0) {
+		return a;
+	}
+	a.count = count;
+	a.min = static_cast<double>(lo);
+	a.max = static_cast<double>(hi);
+	a.mean = sum / count;
+	for (size_t i = 0; i < n; ++i) {
+		const T x = in[i * stride];
+		if (x != x) {
+			continue;
+		}
+		const double d = static_cast<double>(x) - a.mean;
+		a.m2 += d * d;
+	}
+	return a;
+}
+
+static std::shared_ptr<const Stats> compute_stats(const Data &data) {
+	const size_t components = data.components;
+	const size_t n = data.size() / components;
+	const ComponentStrides strides(data);
+
+	// Partial results are merged in order of their range, so the result doesn't depend
+	// on which threads finish first
+	std::mutex mutex;
+	std::vector<std::pair<size_t, std::vector<Accumulator>>> partials;
+	visit(data, [&](const auto &view) {
+		parallel_for(0, n, STATS_GRAIN, [&](const size_t begin, const size_t end) {
+			std::vector<Accumulator> local(components);
+			for (size_t c = 0; c < components; ++c) {
+				const auto *in = view.data() + c * strides.component_stride;
+				for (size_t b = begin; b < end; b += STATS_BLOCK) {
+					const size_t block = std::min(STATS_BLOCK, end - b);
+					local[c].merge(reduce_block(in + b * strides.particle_stride,
+								strides.particle_stride, block));
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			partials.emplace_back(begin, std::move(local));
+		});
+	});
+	std::sort(partials.begin(), partials.end(),
+		[](const std::pair<size_t, std::vector<Accumulator>> &a,
+			const std::pair<size_t, std::vector<Accumulator>> &b) {
+			return a.first < b.first;
+		});
+
+	std::vector<Accumulator> total(components);
+	for (const auto &p : partials) {
+		for (size_t c = 0; c < components; ++c) {
+			total[c].merge(p.second[c]);
+		}
+	}
+	auto stats = std::make_shared<Stats>();
+	stats->size = data.size();
+	stats->has_moments = true;
+	stats->components.resize(components);
+	for (size_t c = 0; c < components; ++c) {
+		if (total[c].count == 0) {
+			continue;
+		}
+		stats->components[c].min = total[c].min;
+		stats->components[c].max = total[c].max;
+		stats->components[c].mean = total[c].mean;
+		stats->components[c].variance = total[c].m2 / total[c].count;
+	}
+	return stats;
+}
+
+std::shared_ptr<const Stats> pl::stats(const Data &data) {
+	auto cached = std::atomic_load(&data.cached_stats);
+	if (cached && cached->has_moments && cached->size == data.size()) {
+		return cached;
+	}
+	auto computed = compute_stats(data);
+	std::atomic_store(&data.cached_stats, computed);
+	return computed;
+}
+
+std::shared_ptr<const Stats> pl::range(const Data &data) {
+	auto cached = std::atomic_load(&data.cached_stats);
+	if (cached && cached->size == data.size()) {
+		return cached;
+	}
+	return stats(data);
+}
+
+void pl::seed_stats(const Data &data, const Stats &stats) {
+	auto seeded = std::make_shared<Stats>(stats);
+	seeded->size = data.size();
+	std::atomic_store(&data.cached_stats, std::shared_ptr<const Stats>(seeded));
+}
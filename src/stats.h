@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+struct ComponentStats {
+	double min = 0.0;
+	double max = 0.0;
+	double mean = 0.0;
+	// The population variance
+	double variance = 0.0;
+};
+
+// Per-component statistics of a Data
+struct Stats {
+	std::vector<ComponentStats> components;
+	// The number of elements in the data when the stats were computed
+	size_t size = 0;
+	// If the stats were seeded with just the range, e.g. from a file header,
+	// the mean and variance are not valid
+	bool has_moments = false;
+};
+
+// Get the statistics of each component of the data. They're computed with a parallel
+// reduction the first time they're requested and cached on the data. The cache is
+// dropped by Data::invalidate_stats, or if the size of the data changes.
+// NaNs are ignored, the min, max, mean and variance are those of the component's other
+// values. A component with no values other than NaNs has all its stats set to 0
+std::shared_ptr<const Stats> stats(const Data &data);
+
+// Get the min and max of each component of the data. This is the same as stats, but
+// will also return seeded stats which only know the range
+std::shared_ptr<const Stats> range(const Data &data);
+
+// Seed the cached stats of the data with known values, e.g. bounds given in a file header
+void seed_stats(const Data &data, const Stats &stats);
+
+}
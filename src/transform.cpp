@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include "kernels.h"
+#include "parallel.h"
+#include "stats.h"
+#include "transform.h"
+
+using namespace pl;
+
+// Particles are transformed in blocks, AOS positions with a general transform are
+// de-interleaved a block at a time into streams on the stack
+const size_t TRANSFORM_BLOCK = 1024;
+const size_t TRANSFORM_GRAIN = 64 * TRANSFORM_BLOCK;
+
+box3f::box3f()
+	: lower(std::numeric_limits<float>::infinity()),
+	upper(-std::numeric_limits<float>::infinity())
+{}
+box3f::box3f(const vec3f &lower, const vec3f &upper) : lower(lower), upper(upper) {}
+bool box3f::empty() const {
+	return lower.x > upper.x || lower.y > upper.y || lower.z > upper.z;
+}
+vec3f box3f::center() const {
+	return (lower + upper) * vec3f(0.5f);
+}
+vec3f box3f::size() const {
+	return upper - lower;
+}
+void box3f::extend(const vec3f &p) {
+	for (size_t c = 0; c < 3; ++c) {
+		lower[c] = std::min(lower[c], p[c]);
+		upper[c] = std::max(upper[c], p[c]);
+	}
+}
+void box3f::extend(const box3f &b) {
+	extend(b.lower);
+	extend(b.upper);
+}
+
+Affine3f::Affine3f() {
+	for (size_t r = 0; r < 3; ++r) {
+		for (size_t c = 0; c < 4; ++c) {
+			m[r][c] = r == c ? 1.f : 0.f;
+		}
+	}
+}
+Affine3f Affine3f::translate(const vec3f &offset) {
+	Affine3f a;
+	for (size_t r = 0; r < 3; ++r) {
+		a.m[r][3] = offset[r];
+	}
+	return a;
+}
+Affine3f Affine3f::scale(const vec3f &scale) {
+	Affine3f a;
+	for (size_t r = 0; r < 3; ++r) {
+		a.m[r][r] = scale[r];
+	}
+	return a;
+}
+Affine3f Affine3f::operator*(const Affine3f &b) const {
+	Affine3f a;
+	for (size_t r = 0; r < 3; ++r) {
+		for (size_t c = 0; c < 4; ++c) {
+			float x = c == 3 ? m[r][3] : 0.f;
+			for (size_t k = 0; k < 3; ++k) {
+				x += m[r][k] * b.m[k][c];
+			}
+			a.m[r][c] = x;
+		}
+	}
+	return a;
+}
+vec3f Affine3f::apply(const vec3f &p) const {
+	vec3f out;
+	for (size_t r = 0; r < 3; ++r) {
+		out[r] = m[r][0] * p.x + m[r][1] * p.y + m[r][2] * p.z + m[r][3];
+	}
+	return out;
+}
+bool Affine3f::is_scale_translate() const {
+	for (size_t r = 0; r < 3; ++r) {
+		for (size_t c = 0; c < 3; ++c) {
+			if (r != c && m[r][c] != 0.f) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool is_contiguous_positions(const Data &positions) {
+	return positions.type() == typeid(float) && positions.components == 3
+		&& positions.stride() == 1 && (positions.raw_data() || positions.size() == 0);
+}
+
+box3f pl::bounds(const Data &positions) {
+	if (positions.components != 3) {
+		throw std::runtime_error("bounds: positions must have 3 components");
+	}
+	auto cached = std::atomic_load(&positions.cached_stats);
+	// Seeded stats, e.g. from a file header, may only bound the positions loosely so
+	// just the ranges from a computed reduction are reused
+	if (!is_contiguous_positions(positions)
+			|| (cached && cached->has_moments && cached->size == positions.size())) {
+		auto r = stats(positions);
+		box3f b;
+		for (size_t c = 0; c < 3 && positions.size() > 0; ++c) {
+			b.lower[c] = static_cast<float>(r->components[c].min);
+			b.upper[c] = static_cast<float>(r->components[c].max);
+		}
+		return b;
+	}
+
+	const float *in = static_cast<const float*>(positions.raw_data());
+	const size_t n = positions.count();
+	std::mutex mutex;
+	box3f total;
+	parallel_for(0, n, TRANSFORM_GRAIN, [&](const size_t begin, const size_t end) {
+		box3f local;
+		if (positions.layout == Layout::AOS) {
+			bounds_f32(in + begin * 3, end - begin, 3, &local.lower.x, &local.upper.x);
+		} else {
+			for (size_t c = 0; c < 3; ++c) {
+				bounds_f32(in + c * n + begin, end - begin, 1, &local.lower[c], &local.upper[c]);
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		total.extend(local);
+	});
+	return total;
+}
+
+// Transform n positions from in to out, which may be the same array
+static void transform_positions(const float *in, float *out, const size_t n,
+		const Layout layout, const Affine3f &xfm)
+{
+	const bool scale_translate = xfm.is_scale_translate();
+	const float scale[3] = {xfm.m[0][0], xfm.m[1][1], xfm.m[2][2]};
+	const float offset[3] = {xfm.m[0][3], xfm.m[1][3], xfm.m[2][3]};
+	parallel_for(0, n, TRANSFORM_GRAIN, [&](const size_t begin, const size_t end) {
+		if (layout == Layout::AOS && scale_translate) {
+			scale_offset_f32(in + begin * 3, end - begin, 3, scale, offset, out + begin * 3);
+		} else if (scale_translate) {
+			for (size_t c = 0; c < 3; ++c) {
+				scale_offset_f32(in + c * n + begin, end - begin, 1, &scale[c], &offset[c],
+						out + c * n + begin);
+			}
+		} else if (layout == Layout::SOA) {
+			const float *streams_in[3] = {in + begin, in + n + begin, in + 2 * n + begin};
+			float *streams_out[3] = {out + begin, out + n + begin, out + 2 * n + begin};
+			affine_f32(streams_in, end - begin, &xfm.m[0][0], streams_out);
+		} else {
+			float block[3][TRANSFORM_BLOCK];
+			float *streams[3] = {block[0], block[1], block[2]};
+			const float *const_streams[3] = {block[0], block[1], block[2]};
+			for (size_t b = begin; b < end; b += TRANSFORM_BLOCK) {
+				const size_t e = std::min(b + TRANSFORM_BLOCK, end);
+				deinterleave(in + b * 3, e - b, 3, streams);
+				affine_f32(const_streams, e - b, &xfm.m[0][0], streams);
+				interleave(const_streams, e - b, 3, out + b * 3);
+			}
+		}
+	});
+}
+
+void pl::transform(Data &positions, const Affine3f &xfm) {
+	if (!is_contiguous_positions(positions)) {
+		throw std::runtime_error("transform: positions must be a contiguous array of 3 component floats");
+	}
+	float *p = static_cast<float*>(positions.raw_data());
+	transform_positions(p, p, positions.count(), positions.layout, xfm);
+	positions.invalidate_stats();
+}
+void pl::translate(Data &positions, const vec3f &offset) {
+	transform(positions, Affine3f::translate(offset));
+}
+void pl::scale(Data &positions, const vec3f &scale) {
+	transform(positions, Affine3f::scale(scale));
+}
+
+std::shared_ptr<Data> pl::transformed(const Data &positions, const Affine3f &xfm) {
+	if (positions.components != 3) {
+		throw std::runtime_error("transformed: positions must have 3 components");
+	}
+	auto out = std::make_shared<DataT<float>>();
+	out->components = 3;
+	out->layout = positions.layout;
+	out->data.resize(positions.size());
+	if (is_contiguous_positions(positions)) {
+		transform_positions(static_cast<const float*>(positions.raw_data()), out->data.data(),
+				positions.count(), positions.layout, xfm);
+	} else {
+		positions.get_floats(0, positions.size(), out->data.data());
+		transform_positions(out->data.data(), out->data.data(), out->count(),
+				out->layout, xfm);
+	}
+	return out;
+}
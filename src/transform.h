@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+
+namespace pl {
+
+// An axis-aligned box
+struct box3f {
+	vec3f lower, upper;
+
+	// An empty box, with lower at +inf and upper at -inf
+	box3f();
+	box3f(const vec3f &lower, const vec3f &upper);
+	bool empty() const;
+	vec3f center() const;
+	vec3f size() const;
+	void extend(const vec3f &p);
+	void extend(const box3f &b);
+};
+
+// An affine transform stored as a row-major 3x4 matrix, applied to a
+// point p as m * (p, 1)
+struct Affine3f {
+	float m[3][4];
+
+	// The identity transform
+	Affine3f();
+	static Affine3f translate(const vec3f &offset);
+	static Affine3f scale(const vec3f &scale);
+	// Compose the transforms, the result applies b and then this
+	Affine3f operator*(const Affine3f &b) const;
+	vec3f apply(const vec3f &p) const;
+	// Check if the transform only scales and translates each axis
+	bool is_scale_translate() const;
+};
+
+// Compute the tight bounds of an array of 3 component positions. Contiguous float arrays
+// are reduced in parallel with the SIMD kernels, other types go through stats. Ranges
+// seeded from a file header aren't trusted, as they may be larger than the data
+box3f bounds(const Data &positions);
+
+// Transform an array of 3 component float positions in place, in parallel with
+// the SIMD kernels. The array must be contiguous, otherwise this throws
+void transform(Data &positions, const Affine3f &xfm);
+void translate(Data &positions, const vec3f &offset);
+void scale(Data &positions, const vec3f &scale);
+
+// Transform positions of any type or view into a new float array in the same layout
+std::shared_ptr<Data> transformed(const Data &positions, const Affine3f &xfm);
+
+}
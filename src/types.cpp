@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <ostream>
 #include "types.h"
 
@@ -11,6 +12,12 @@ vec3f& vec3f::operator+=(const vec3f &a) {
 	z += a.z;
 	return *this;
 }
+float& vec3f::operator[](const size_t i) {
+	return i == 0 ? x : i == 1 ? y : z;
+}
+const float& vec3f::operator[](const size_t i) const {
+	return i == 0 ? x : i == 1 ? y : z;
+}
 
 vec3f operator+(const vec3f &a, const vec3f &b){
 	return vec3f(a.x + b.x, a.y + b.y, a.z + b.z);
@@ -61,6 +68,10 @@ std::string FileName::extension() const {
 	return "";
 }
 FileName FileName::join(const FileName &other) const {
+	// Joining onto the empty path of a bare file name gives a relative path, not one in /
+	if (file_name.empty()) {
+		return other;
+	}
 	return FileName(file_name + "/" + other.file_name);
 }
 std::string FileName::name() const {
@@ -89,6 +100,50 @@ std::ostream& operator<<(std::ostream &os, const FileName &f){
 	return os;
 }
 
+void Data::get_floats(const size_t begin, const size_t end, float *out) const {
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = get_float(i);
+	}
+}
+void Data::get_doubles(const size_t begin, const size_t end, double *out) const {
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = get_float(i);
+	}
+}
+void Data::get_values(const size_t begin, const size_t end, void *out) const {
+	if (raw_data() && stride() == 1) {
+		visit(*this, [&](const auto &view) {
+			using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+			std::copy(view.data() + begin, view.data() + end, static_cast<T*>(out));
+		});
+	} else if (type() == typeid(float)) {
+		get_floats(begin, end, static_cast<float*>(out));
+	} else if (type() == typeid(double)) {
+		get_doubles(begin, end, static_cast<double*>(out));
+	} else {
+		throw std::runtime_error(std::string("Data can't be decoded as ") + type().name());
+	}
+}
+bool Data::can_get_values() const {
+	return (raw_data() && stride() == 1) || type() == typeid(float) || type() == typeid(double);
+}
+void* Data::raw_data() {
+	return nullptr;
+}
+const void* Data::raw_data() const {
+	return nullptr;
+}
+size_t Data::stride() const {
+	return 1;
+}
+size_t Data::bytes() const {
+	return 0;
+}
+
+ParticleModel pl::make_model(const std::shared_ptr<MemoryResource> &resource) {
+	return ParticleModel(ParticleModel::allocator_type(resource));
+}
+
 bool pl::starts_with(const std::string &a, const std::string &prefix) {
 	if (a.size() < prefix.size()) {
 		return false;
@@ -96,3 +151,15 @@ bool pl::starts_with(const std::string &a, const std::string &prefix) {
 	return std::equal(prefix.begin(), prefix.end(), a.begin());
 }
 
+size_t pl::type_size(const std::type_info &type) {
+	if (type == typeid(float) || type == typeid(int32_t) || type == typeid(uint32_t)) {
+		return 4;
+	} else if (type == typeid(double) || type == typeid(int64_t) || type == typeid(uint64_t)) {
+		return 8;
+	} else if (type == typeid(int16_t) || type == typeid(uint16_t)) {
+		return 2;
+	} else if (type == typeid(int8_t) || type == typeid(uint8_t)) {
+		return 1;
+	}
+	return 0;
+}
@@ -1,12 +1,17 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 #include <string>
 #include <fstream>
 #include <memory>
 #include <iostream>
 #include <typeinfo>
+#include <iterator>
+#include <type_traits>
+#include <stdexcept>
+#include "memory_resource.h"
 
 namespace pl {
 
@@ -29,6 +34,8 @@ struct vec3f {
 	vec3f(float x, float y, float z);
 
 	vec3f& operator+=(const vec3f &a);
+	float& operator[](const size_t i);
+	const float& operator[](const size_t i) const;
 };
 
 struct FileName {
@@ -49,20 +56,175 @@ private:
 	void normalize_separators();
 };
 
+// Iterator over every stride'th element of an array
+template<typename T>
+struct StridedIterator {
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = typename std::remove_const<T>::type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = T*;
+	using reference = T&;
+
+	T *ptr;
+	size_t stride;
+
+	StridedIterator(T *ptr, const size_t stride) : ptr(ptr), stride(stride) {}
+	T& operator*() const {
+		return *ptr;
+	}
+	StridedIterator& operator++() {
+		ptr += stride;
+		return *this;
+	}
+	StridedIterator operator++(int) {
+		StridedIterator it = *this;
+		ptr += stride;
+		return it;
+	}
+	bool operator==(const StridedIterator &b) const {
+		return ptr == b.ptr;
+	}
+	bool operator!=(const StridedIterator &b) const {
+		return ptr != b.ptr;
+	}
+};
+
+// A typed, non-owning view of an array. The elements are stride elements apart
+// in memory, stride is 1 unless the view is of a single component of another array
+template<typename T>
+struct ArrayView {
+	using value_type = T;
+
+	T *ptr;
+	size_t count;
+	size_t stride;
+
+	ArrayView(T *ptr = nullptr, const size_t count = 0, const size_t stride = 1)
+		: ptr(ptr), count(count), stride(stride)
+	{}
+	T* data() const {
+		return ptr;
+	}
+	size_t size() const {
+		return count;
+	}
+	bool contiguous() const {
+		return stride == 1;
+	}
+	StridedIterator<T> begin() const {
+		return StridedIterator<T>(ptr, stride);
+	}
+	StridedIterator<T> end() const {
+		return StridedIterator<T>(ptr + count * stride, stride);
+	}
+	T& operator[](const size_t i) const {
+		return ptr[i * stride];
+	}
+};
+
+// Convert n elements of in to Out and write them to out
+template<typename In, typename Out>
+void convert_array(const In *in, const size_t n, Out *out) {
+	for (size_t i = 0; i < n; ++i) {
+		out[i] = static_cast<Out>(in[i]);
+	}
+}
+
+// Conversions to float from doubles and 64 bit ints go through the SIMD kernels in kernels.h
+void convert_array(const double *in, const size_t n, float *out);
+void convert_array(const int64_t *in, const size_t n, float *out);
+
+// How the components of multi-component arrays are laid out in memory.
+// AOS interleaves the components of each particle (xyzxyz...), SOA stores each
+// component as its own contiguous stream (xx...yy...zz...)
+enum class Layout {
+	AOS,
+	SOA
+};
+
+struct Stats;
+
 struct Data {
+	// Number of components per particle, e.g. 3 for positions
+	size_t components = 1;
+	Layout layout = Layout::AOS;
+	// Statistics cached by pl::stats, see stats.h
+	mutable std::shared_ptr<const Stats> cached_stats;
+
 	virtual const std::type_info& type() const = 0;
-	// Dump the data in binary format to the output stream as raw data
+	// Dump the data in binary format to the output stream as raw data of type()
 	virtual void write(std::ofstream &os) const = 0;
 	// Get the element at i as a float
 	virtual float get_float(const size_t i) const = 0;
 	// Get the number of elements in the array
 	virtual size_t size() const = 0;
+	// Convert the elements in [begin, end) to floats or doubles and write them to out.
+	// Prefer these over get_float when touching many elements
+	virtual void get_floats(const size_t begin, const size_t end, float *out) const;
+	virtual void get_doubles(const size_t begin, const size_t end, double *out) const;
+	// Copy the elements in [begin, end) as type() to out, decoding them if the data isn't
+	// stored in memory as type(). Throws unless can_get_values
+	virtual void get_values(const size_t begin, const size_t end, void *out) const;
+	// Check if get_values can be used, by default only contiguous arrays and float and
+	// double data can be copied as their type
+	virtual bool can_get_values() const;
+	// Get the underlying array if the data is stored in memory as type(),
+	// or nullptr if it can only be accessed through the get_* methods
+	virtual void* raw_data();
+	virtual const void* raw_data() const;
+	// Get the distance in elements between consecutive elements of raw_data,
+	// 1 unless the data is a strided view of another array
+	virtual size_t stride() const;
+	// Get the number of bytes of memory held by the array. Memory shared with other
+	// arrays, like the source of a view, isn't counted
+	virtual size_t bytes() const;
 	virtual ~Data(){}
+
+	// Drop the cached statistics, this must be called after modifying the data.
+	// Views also drop the statistics of the array they view
+	virtual void invalidate_stats() {
+		std::atomic_store(&cached_stats, std::shared_ptr<const Stats>());
+	}
+	// Get the number of particles in the array
+	size_t count() const {
+		return size() / components;
+	}
+	// Get the index in the array of component c of particle i, taking the layout into account
+	size_t index(const size_t i, const size_t c) const {
+		return layout == Layout::AOS ? i * components + c : c * count() + i;
+	}
+	// Check if the data is stored in memory as T, i.e. if view<T> is valid
+	template<typename T>
+	bool holds() const {
+		return type() == typeid(T) && (raw_data() || size() == 0);
+	}
+	// Get a typed view of the array, throws if the data is not stored in memory as T
+	template<typename T>
+	ArrayView<T> view() {
+		if (!holds<T>()) {
+			throw std::runtime_error(std::string("Data does not hold an array of ")
+					+ typeid(T).name());
+		}
+		return ArrayView<T>(static_cast<T*>(raw_data()), size(), stride());
+	}
+	template<typename T>
+	ArrayView<const T> view() const {
+		if (!holds<T>()) {
+			throw std::runtime_error(std::string("Data does not hold an array of ")
+					+ typeid(T).name());
+		}
+		return ArrayView<const T>(static_cast<const T*>(raw_data()), size(), stride());
+	}
 };
 
 template<typename T>
 struct DataT : Data {
-	std::vector<T> data;
+	std::vector<T, ResourceAllocator<T>> data;
+
+	// Create an empty array allocating from the resource, or the default resource if null
+	DataT(const std::shared_ptr<MemoryResource> &resource = nullptr)
+		: data(ResourceAllocator<T>(resource))
+	{}
 
 	const std::type_info& type() const override {
 		return typeid(T);
@@ -78,12 +240,110 @@ struct DataT : Data {
 	size_t size() const override {
 		return data.size();
 	}
+	void get_floats(const size_t begin, const size_t end, float *out) const override {
+		convert_array(data.data() + begin, end - begin, out);
+	}
+	void get_doubles(const size_t begin, const size_t end, double *out) const override {
+		convert_array(data.data() + begin, end - begin, out);
+	}
+	void* raw_data() override {
+		return data.data();
+	}
+	const void* raw_data() const override {
+		return data.data();
+	}
+	size_t bytes() const override {
+		return data.capacity() * sizeof(T);
+	}
 };
 
-using ParticleModel = std::unordered_map<std::string, std::shared_ptr<Data>>;
+using ParticleModel = std::unordered_map<std::string, std::shared_ptr<Data>,
+	  std::hash<std::string>, std::equal_to<std::string>,
+	  ResourceAllocator<std::pair<const std::string, std::shared_ptr<Data>>>>;
+
+// Create an empty array where both the DataT and its elements are allocated from the resource
+template<typename T>
+std::shared_ptr<DataT<T>> make_data(const std::shared_ptr<MemoryResource> &resource) {
+	return std::allocate_shared<DataT<T>>(ResourceAllocator<DataT<T>>(resource), resource);
+}
+
+// Create an empty model whose nodes are allocated from the resource
+ParticleModel make_model(const std::shared_ptr<MemoryResource> &resource);
 
 bool starts_with(const std::string &a, const std::string &prefix);
 
+// Get the size in bytes of the scalar type, or 0 if it isn't one of the types supported by DataT
+size_t type_size(const std::type_info &type);
+
+namespace detail {
+
+template<typename T, typename D, typename F>
+void visit_as(D &data, F &f, bool &visited) {
+	if (!visited && data.template holds<T>()) {
+		visited = true;
+		f(data.template view<T>());
+	}
+}
+
+template<typename T, typename D, typename F>
+void decode_as(D &data, F &f, bool &visited) {
+	if (!visited && data.type() == typeid(T) && data.can_get_values()) {
+		visited = true;
+		DataT<T> decoded;
+		decoded.data.resize(data.size());
+		data.get_values(0, data.size(), decoded.data.data());
+		// Viewed with the constness of the data, so f is called with the same views as visit_as
+		f(static_cast<D&>(decoded).template view<T>());
+	}
+}
+
+template<typename D, typename F>
+void visit(D &data, F &f) {
+	bool visited = false;
+	visit_as<float>(data, f, visited);
+	visit_as<double>(data, f, visited);
+	visit_as<int8_t>(data, f, visited);
+	visit_as<uint8_t>(data, f, visited);
+	visit_as<int16_t>(data, f, visited);
+	visit_as<uint16_t>(data, f, visited);
+	visit_as<int32_t>(data, f, visited);
+	visit_as<uint32_t>(data, f, visited);
+	visit_as<int64_t>(data, f, visited);
+	visit_as<uint64_t>(data, f, visited);
+	// Data which isn't a contiguous array of a scalar type is decoded to a temporary
+	// array of its type, or of floats if it can't be decoded as its type
+	decode_as<float>(data, f, visited);
+	decode_as<double>(data, f, visited);
+	decode_as<int8_t>(data, f, visited);
+	decode_as<uint8_t>(data, f, visited);
+	decode_as<int16_t>(data, f, visited);
+	decode_as<uint16_t>(data, f, visited);
+	decode_as<int32_t>(data, f, visited);
+	decode_as<uint32_t>(data, f, visited);
+	decode_as<int64_t>(data, f, visited);
+	decode_as<uint64_t>(data, f, visited);
+	if (!visited) {
+		DataT<float> decoded;
+		decoded.data.resize(data.size());
+		data.get_floats(0, data.size(), decoded.data.data());
+		f(static_cast<D&>(decoded).template view<float>());
+	}
+}
+
+}
+
+// Call f once with an ArrayView<T> of the data, dispatching over the scalar
+// types supported by DataT. The inner loops of f are compiled for each T, instead
+// of making a virtual get_float call per element
+template<typename F>
+void visit(Data &data, F &&f) {
+	detail::visit(data, f);
+}
+template<typename F>
+void visit(const Data &data, F &&f) {
+	detail::visit(data, f);
+}
+
 }
 
 pl::vec3f operator+(const pl::vec3f &a, const pl::vec3f &b);
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <type_traits>
+#include "parallel.h"
+#include "view.h"
+
+using namespace pl;
+
+// Number of elements gathered at a time when writing out a view
+const size_t WRITE_BLOCK = 64 * 1024;
+
+// Call f with a null pointer to the scalar type supported by DataT matching the type
+template<typename F>
+static void with_scalar_type(const std::type_info &type, const F &f) {
+	if (type == typeid(float)) {
+		f(static_cast<float*>(nullptr));
+	} else if (type == typeid(double)) {
+		f(static_cast<double*>(nullptr));
+	} else if (type == typeid(int8_t)) {
+		f(static_cast<int8_t*>(nullptr));
+	} else if (type == typeid(uint8_t)) {
+		f(static_cast<uint8_t*>(nullptr));
+	} else if (type == typeid(int16_t)) {
+		f(static_cast<int16_t*>(nullptr));
+	} else if (type == typeid(uint16_t)) {
+		f(static_cast<uint16_t*>(nullptr));
+	} else if (type == typeid(int32_t)) {
+		f(static_cast<int32_t*>(nullptr));
+	} else if (type == typeid(uint32_t)) {
+		f(static_cast<uint32_t*>(nullptr));
+	} else if (type == typeid(int64_t)) {
+		f(static_cast<int64_t*>(nullptr));
+	} else if (type == typeid(uint64_t)) {
+		f(static_cast<uint64_t*>(nullptr));
+	} else {
+		throw std::runtime_error(std::string("Data can't be decoded as ") + type.name());
+	}
+}
+
+ComponentView::ComponentView(const std::shared_ptr<Data> &source, const size_t first,
+		const size_t count)
+	: source(source), first(first), element_size(0)
+{
+	if (first + count > source->components || count == 0) {
+		throw std::runtime_error("ComponentView: components out of range of the source");
+	}
+	components = count;
+	layout = source->layout;
+	visit(*source, [&](const auto &view) {
+		using T = typename std::decay<decltype(view)>::type::value_type;
+		if (source->holds<typename std::remove_const<T>::type>()) {
+			element_size = sizeof(T);
+		}
+	});
+}
+size_t ComponentView::source_index(const size_t i) const {
+	if (layout == Layout::AOS) {
+		return source->index(i / components, first + i % components);
+	}
+	const size_t n = source->count();
+	return source->index(i % n, first + i / n);
+}
+bool ComponentView::strided_array() const {
+	// A single component, a range of SOA streams or the whole AOS array are
+	// strided arrays in the source
+	return element_size != 0 && (components == 1 || layout == Layout::SOA
+			|| components == source->components);
+}
+const std::type_info& ComponentView::type() const {
+	// Sources which can't be decoded as their type are viewed as their decoded floats
+	return can_get_values() ? source->type() : typeid(float);
+}
+void ComponentView::write(std::ofstream &os) const {
+	if (strided_array() && stride() == 1) {
+		std::cout << "Writing " << size() << " " << type().name()
+			<< ", file is " << element_size * size() << " bytes\n";
+		os.write(static_cast<const char*>(raw_data()), element_size * size());
+		return;
+	}
+	// Gather the elements of the view to write them out contiguously
+	visit(*this, [&](const auto &view) {
+		using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+		std::cout << "Writing " << view.size() << " " << typeid(T).name()
+			<< ", file is " << sizeof(T) * view.size() << " bytes\n";
+		std::vector<T> block;
+		block.reserve(std::min(view.size(), WRITE_BLOCK));
+		for (size_t i = 0; i < view.size(); i += WRITE_BLOCK) {
+			block.clear();
+			const size_t end = std::min(i + WRITE_BLOCK, view.size());
+			for (size_t j = i; j < end; ++j) {
+				block.push_back(view[j]);
+			}
+			os.write(reinterpret_cast<const char*>(block.data()), sizeof(T) * block.size());
+		}
+	});
+}
+float ComponentView::get_float(const size_t i) const {
+	return source->get_float(source_index(i));
+}
+size_t ComponentView::size() const {
+	return source->count() * components;
+}
+void ComponentView::get_floats(const size_t begin, const size_t end, float *out) const {
+	if (strided_array() && stride() == 1) {
+		source->get_floats(source_index(begin), source_index(begin) + end - begin, out);
+		return;
+	}
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = source->get_float(source_index(i));
+	}
+}
+void ComponentView::get_doubles(const size_t begin, const size_t end, double *out) const {
+	if (strided_array() && stride() == 1) {
+		source->get_doubles(source_index(begin), source_index(begin) + end - begin, out);
+		return;
+	}
+	for (size_t i = begin; i < end; ++i) {
+		source->get_doubles(source_index(i), source_index(i) + 1, out + i - begin);
+	}
+}
+void ComponentView::get_values(const size_t begin, const size_t end, void *out) const {
+	const Data &src = *source;
+	if (src.raw_data()) {
+		visit(src, [&](const auto &view) {
+			using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+			T *o = static_cast<T*>(out);
+			for (size_t i = begin; i < end; ++i) {
+				o[i - begin] = view[source_index(i)];
+			}
+		});
+		return;
+	}
+	with_scalar_type(type(), [&](auto *tag) {
+		using T = typename std::remove_pointer<decltype(tag)>::type;
+		T *o = static_cast<T*>(out);
+		for (size_t i = begin; i < end; ++i) {
+			const size_t j = source_index(i);
+			source->get_values(j, j + 1, o + i - begin);
+		}
+	});
+}
+bool ComponentView::can_get_values() const {
+	return static_cast<const Data&>(*source).raw_data() || source->can_get_values();
+}
+void* ComponentView::raw_data() {
+	if (!strided_array()) {
+		return nullptr;
+	}
+	return static_cast<char*>(source->raw_data())
+		+ source->index(0, first) * source->stride() * element_size;
+}
+const void* ComponentView::raw_data() const {
+	if (!strided_array()) {
+		return nullptr;
+	}
+	return static_cast<const char*>(static_cast<const Data&>(*source).raw_data())
+		+ source->index(0, first) * source->stride() * element_size;
+}
+size_t ComponentView::stride() const {
+	// Views which aren't strided arrays are accessed through their decoded elements,
+	// which get_floats and visit hand out contiguously
+	if (!strided_array()) {
+		return 1;
+	}
+	if (components == 1 && layout == Layout::AOS) {
+		return source->components * source->stride();
+	}
+	return source->stride();
+}
+void ComponentView::invalidate_stats() {
+	Data::invalidate_stats();
+	source->invalidate_stats();
+}
+
+RowView::RowView(const std::shared_ptr<Data> &source, const size_t first, const size_t count)
+	: source(source), first(first), rows(count)
+{
+	if (first + count > source->count()) {
+		throw std::runtime_error("RowView: rows out of range of the source");
+	}
+	components = source->components;
+	layout = source->layout;
+}
+RowView::RowView(const std::shared_ptr<Data> &source,
+		const std::shared_ptr<const std::vector<size_t>> &indices)
+	: source(source), first(0), rows(indices->size()), indices(indices)
+{
+	components = source->components;
+	layout = source->layout;
+}
+size_t RowView::source_index(const size_t i) const {
+	size_t p = 0;
+	size_t c = 0;
+	if (layout == Layout::AOS) {
+		p = i / components;
+		c = i % components;
+	} else {
+		p = i % rows;
+		c = i / rows;
+	}
+	return source->index(indices ? (*indices)[p] : first + p, c);
+}
+bool RowView::contiguous_range() const {
+	return !indices && (layout == Layout::AOS || components == 1)
+		&& static_cast<const Data&>(*source).raw_data();
+}
+template<typename V, typename Out>
+void RowView::gather(const V &src, const size_t begin, const size_t end, Out *out) const {
+	for (size_t i = begin; i < end; ++i) {
+		out[i - begin] = static_cast<Out>(src[source_index(i)]);
+	}
+}
+template<typename Out>
+void RowView::gather(const size_t begin, const size_t end, Out *out) const {
+	// Gather straight from the source array if it's in memory, otherwise each
+	// element is decoded through the source's get_float
+	if (static_cast<const Data&>(*source).raw_data()) {
+		visit(static_cast<const Data&>(*source), [&](const auto &src) {
+			gather(src, begin, end, out);
+		});
+	} else {
+		for (size_t i = begin; i < end; ++i) {
+			out[i - begin] = static_cast<Out>(source->get_float(source_index(i)));
+		}
+	}
+}
+const std::type_info& RowView::type() const {
+	// Sources which can't be decoded as their type are viewed as their decoded floats
+	return can_get_values() ? source->type() : typeid(float);
+}
+void RowView::write(std::ofstream &os) const {
+	if (contiguous_range() && stride() == 1) {
+		visit(*this, [&](const auto &view) {
+			using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+			std::cout << "Writing " << view.size() << " " << typeid(T).name()
+				<< ", file is " << sizeof(T) * view.size() << " bytes\n";
+			os.write(reinterpret_cast<const char*>(view.data()), sizeof(T) * view.size());
+		});
+		return;
+	}
+	// Gather blocks of the view and write them out in its type
+	if (can_get_values()) {
+		with_scalar_type(type(), [&](auto *tag) {
+			using T = typename std::remove_pointer<decltype(tag)>::type;
+			std::cout << "Writing " << size() << " " << typeid(T).name()
+				<< ", file is " << sizeof(T) * size() << " bytes\n";
+			std::vector<T> block(std::min(size(), WRITE_BLOCK));
+			for (size_t i = 0; i < size(); i += WRITE_BLOCK) {
+				const size_t end = std::min(i + WRITE_BLOCK, size());
+				get_values(i, end, block.data());
+				os.write(reinterpret_cast<const char*>(block.data()), sizeof(T) * (end - i));
+			}
+		});
+	} else {
+		// Sources which can't be decoded as their type are written as their decoded floats
+		std::cout << "Writing " << size() << " " << typeid(float).name()
+			<< ", file is " << sizeof(float) * size() << " bytes\n";
+		std::vector<float> block(std::min(size(), WRITE_BLOCK));
+		for (size_t i = 0; i < size(); i += WRITE_BLOCK) {
+			const size_t end = std::min(i + WRITE_BLOCK, size());
+			gather(i, end, block.data());
+			os.write(reinterpret_cast<const char*>(block.data()), sizeof(float) * (end - i));
+		}
+	}
+}
+float RowView::get_float(const size_t i) const {
+	return source->get_float(source_index(i));
+}
+size_t RowView::size() const {
+	return rows * components;
+}
+void RowView::get_floats(const size_t begin, const size_t end, float *out) const {
+	if (contiguous_range()) {
+		source->get_floats(source_index(begin), source_index(begin) + end - begin, out);
+	} else {
+		gather(begin, end, out);
+	}
+}
+void RowView::get_doubles(const size_t begin, const size_t end, double *out) const {
+	if (contiguous_range()) {
+		source->get_doubles(source_index(begin), source_index(begin) + end - begin, out);
+	} else {
+		gather(begin, end, out);
+	}
+}
+void RowView::get_values(const size_t begin, const size_t end, void *out) const {
+	if (static_cast<const Data&>(*source).raw_data()) {
+		visit(static_cast<const Data&>(*source), [&](const auto &src) {
+			using T = typename std::remove_const<typename std::decay<decltype(src)>::type::value_type>::type;
+			gather(src, begin, end, static_cast<T*>(out));
+		});
+		return;
+	}
+	// A range of the rows is also a range of the source, otherwise each element is
+	// decoded on its own
+	if (!indices && (layout == Layout::AOS || components == 1)) {
+		source->get_values(source_index(begin), source_index(begin) + end - begin, out);
+		return;
+	}
+	with_scalar_type(type(), [&](auto *tag) {
+		using T = typename std::remove_pointer<decltype(tag)>::type;
+		T *o = static_cast<T*>(out);
+		for (size_t i = begin; i < end; ++i) {
+			const size_t j = source_index(i);
+			source->get_values(j, j + 1, o + i - begin);
+		}
+	});
+}
+bool RowView::can_get_values() const {
+	return static_cast<const Data&>(*source).raw_data() || source->can_get_values();
+}
+void* RowView::raw_data() {
+	if (!contiguous_range()) {
+		return nullptr;
+	}
+	void *ptr = nullptr;
+	visit(*source, [&](const auto &view) {
+		ptr = view.data() + first * components * source->stride();
+	});
+	return ptr;
+}
+const void* RowView::raw_data() const {
+	if (!contiguous_range()) {
+		return nullptr;
+	}
+	const void *ptr = nullptr;
+	visit(static_cast<const Data&>(*source), [&](const auto &view) {
+		ptr = view.data() + first * components * source->stride();
+	});
+	return ptr;
+}
+size_t RowView::stride() const {
+	return contiguous_range() ? source->stride() : 1;
+}
+void RowView::invalidate_stats() {
+	Data::invalidate_stats();
+	source->invalidate_stats();
+}
+std::shared_ptr<Data> RowView::gather() const {
+	std::shared_ptr<Data> result;
+	if (static_cast<const Data&>(*source).raw_data()) {
+		visit(static_cast<const Data&>(*source), [&](const auto &src) {
+			using T = typename std::remove_const<typename std::decay<decltype(src)>::type::value_type>::type;
+			auto copy = std::make_shared<DataT<T>>();
+			copy->data.resize(size());
+			T *out = copy->data.data();
+			parallel_for(0, size(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+				gather(src, begin, end, out + begin);
+			});
+			result = copy;
+		});
+	} else if (source->can_get_values()) {
+		// Sources which aren't in memory are gathered as their decoded values
+		with_scalar_type(type(), [&](auto *tag) {
+			using T = typename std::remove_pointer<decltype(tag)>::type;
+			auto copy = std::make_shared<DataT<T>>();
+			copy->data.resize(size());
+			T *out = copy->data.data();
+			parallel_for(0, size(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+				get_values(begin, end, out + begin);
+			});
+			result = copy;
+		});
+	} else {
+		// Or as their decoded floats if they can't be decoded as their type
+		auto copy = std::make_shared<DataT<float>>();
+		copy->data.resize(size());
+		float *out = copy->data.data();
+		parallel_for(0, size(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+			gather(begin, end, out + begin);
+		});
+		result = copy;
+	}
+	result->components = components;
+	result->layout = layout;
+	return result;
+}
+
+std::shared_ptr<ComponentView> pl::component_view(const std::shared_ptr<Data> &data,
+		const size_t first, const size_t count)
+{
+	return std::make_shared<ComponentView>(data, first, count);
+}
+
+std::shared_ptr<Data> pl::materialize(const Data &data) {
+	// Row views gather in their source's type, instead of decoding to floats
+	auto *rows = dynamic_cast<const RowView*>(&data);
+	if (rows && !data.raw_data()) {
+		return rows->gather();
+	}
+	std::shared_ptr<Data> result;
+	visit(data, [&](const auto &view) {
+		using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+		auto copy = std::make_shared<DataT<T>>();
+		copy->data.resize(view.size());
+		T *out = copy->data.data();
+		parallel_for(0, view.size(), WRITE_BLOCK, [&](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				out[i] = view[i];
+			}
+		});
+		result = copy;
+	});
+	result->components = data.components;
+	result->layout = data.layout;
+	return result;
+}
+
+size_t pl::particle_count(const ParticleModel &model) {
+	auto fnd = model.find("positions");
+	if (fnd != model.end()) {
+		return fnd->second->count();
+	}
+	size_t count = 0;
+	for (const auto &a : model) {
+		count = std::max(count, a.second->count());
+	}
+	return count;
+}
+
+ParticleModel pl::view_rows(const ParticleModel &model, const size_t begin, const size_t end) {
+	const size_t count = particle_count(model);
+	ParticleModel view(model.get_allocator());
+	for (const auto &a : model) {
+		if (a.second->count() == count) {
+			view[a.first] = std::make_shared<RowView>(a.second, begin, end - begin);
+		} else {
+			view[a.first] = a.second;
+		}
+	}
+	return view;
+}
+ParticleModel pl::view_rows(const ParticleModel &model,
+		const std::shared_ptr<const std::vector<size_t>> &indices)
+{
+	const size_t count = particle_count(model);
+	ParticleModel view(model.get_allocator());
+	for (const auto &a : model) {
+		if (a.second->count() == count) {
+			view[a.first] = std::make_shared<RowView>(a.second, indices);
+		} else {
+			view[a.first] = a.second;
+		}
+	}
+	return view;
+}
+
+ParticleModel pl::materialize(const ParticleModel &model) {
+	ParticleModel result(model.get_allocator());
+	for (const auto &a : model) {
+		if (dynamic_cast<const RowView*>(a.second.get())
+				|| dynamic_cast<const ComponentView*>(a.second.get()))
+		{
+			result[a.first] = materialize(*a.second);
+		} else {
+			result[a.first] = a.second;
+		}
+	}
+	return result;
+}
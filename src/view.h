@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+namespace pl {
+
+// A view of a range of the components of another array, e.g. the x component of
+// the positions or the RGB channels of RGBA colors. The data is not copied, the
+// view reads through to the source array and keeps it alive. The view is AOS
+// if the source is, in which case a single component view is a strided array.
+// Modifying the data through a view invalidates the stats of the view and the
+// source, but not those of other views of the source.
+class ComponentView : public Data {
+	std::shared_ptr<Data> source;
+	size_t first;
+	// Size of an element of the source in bytes, if its raw data can be viewed
+	size_t element_size;
+
+	// Get the index in the source of element i of the view
+	size_t source_index(const size_t i) const;
+	// Check if the view can be expressed as a single strided array in the source
+	bool strided_array() const;
+
+public:
+	// View components [first, first + count) of the source
+	ComponentView(const std::shared_ptr<Data> &source, const size_t first, const size_t count);
+
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	void get_values(const size_t begin, const size_t end, void *out) const override;
+	bool can_get_values() const override;
+	void* raw_data() override;
+	const void* raw_data() const override;
+	size_t stride() const override;
+	void invalidate_stats() override;
+};
+
+// A view of a subset of the particles of another array, either a contiguous range of
+// rows or a list of row indices which can be shared by the views of each attribute.
+// All the components of the selected particles are viewed, and the view has the same
+// type, components and layout as the source. Sources which can't be decoded as their
+// type, see Data::can_get_values, are viewed as their decoded floats. A range of an AOS or single component
+// array can be accessed directly through raw_data, other views are gathered on access.
+// As with ComponentView, modifying the data through the view invalidates the source's stats
+class RowView : public Data {
+	std::shared_ptr<Data> source;
+	size_t first;
+	size_t rows;
+	std::shared_ptr<const std::vector<size_t>> indices;
+
+	// Get the index in the source of element i of the view
+	size_t source_index(const size_t i) const;
+	// Check if the view is a contiguous range of the source
+	bool contiguous_range() const;
+	template<typename V, typename Out>
+	void gather(const V &src, const size_t begin, const size_t end, Out *out) const;
+	template<typename Out>
+	void gather(const size_t begin, const size_t end, Out *out) const;
+
+public:
+	// View the particles [first, first + count) of the source
+	RowView(const std::shared_ptr<Data> &source, const size_t first, const size_t count);
+	// View the particles of the source at each index
+	RowView(const std::shared_ptr<Data> &source,
+			const std::shared_ptr<const std::vector<size_t>> &indices);
+
+	const std::type_info& type() const override;
+	void write(std::ofstream &os) const override;
+	float get_float(const size_t i) const override;
+	size_t size() const override;
+	void get_floats(const size_t begin, const size_t end, float *out) const override;
+	void get_doubles(const size_t begin, const size_t end, double *out) const override;
+	void get_values(const size_t begin, const size_t end, void *out) const override;
+	bool can_get_values() const override;
+	void* raw_data() override;
+	const void* raw_data() const override;
+	size_t stride() const override;
+	void invalidate_stats() override;
+	// Gather the viewed particles in parallel into a contiguous DataT of the source's type,
+	// or of floats if the source can't be decoded as its type
+	std::shared_ptr<Data> gather() const;
+};
+
+// View components [first, first + count) of the data
+std::shared_ptr<ComponentView> component_view(const std::shared_ptr<Data> &data,
+		const size_t first, const size_t count = 1);
+
+// Copy the data to a new contiguous DataT of the same type, components and layout.
+// Data which isn't stored as a scalar type is copied as its decoded values, or as
+// floats if it can't be decoded as its type
+std::shared_ptr<Data> materialize(const Data &data);
+
+// Get the number of particles in the model, taken from the positions if there are
+// any, or the largest attribute otherwise
+size_t particle_count(const ParticleModel &model);
+
+// View the particles [begin, end) of each attribute of the model. Attributes which
+// don't have a value per particle, e.g. a single radius for all the particles,
+// are shared with the model as-is
+ParticleModel view_rows(const ParticleModel &model, const size_t begin, const size_t end);
+// View the particles at each index, the index list is shared by the views
+ParticleModel view_rows(const ParticleModel &model,
+		const std::shared_ptr<const std::vector<size_t>> &indices);
+
+// Gather the views in the model into contiguous arrays, other attributes are shared as-is
+ParticleModel materialize(const ParticleModel &model);
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A minimal harness for the tests. Each test is a function which throws on failure,
+// run_tests runs all of them and returns the exit code for main
+
+#define PL_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) \
+					+ ": check failed: " #cond); \
+		} \
+	} while (0)
+
+// Check that running the statement throws a std::exception
+#define PL_CHECK_THROWS(stmt) \
+	do { \
+		bool threw = false; \
+		try { \
+			stmt; \
+		} catch (const std::exception &) { \
+			threw = true; \
+		} \
+		if (!threw) { \
+			throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) \
+					+ ": expected an exception from: " #stmt); \
+		} \
+	} while (0)
+
+namespace pl_test {
+
+using Test = std::pair<const char*, void (*)()>;
+
+inline int run_tests(const std::vector<Test> &tests) {
+	size_t failed = 0;
+	for (const auto &t : tests) {
+		try {
+			t.second();
+			std::cout << "[ OK ] " << t.first << "\n";
+		} catch (const std::exception &e) {
+			std::cout << "[FAIL] " << t.first << ": " << e.what() << "\n";
+			++failed;
+		}
+	}
+	std::cout << tests.size() - failed << "/" << tests.size() << " tests passed\n";
+	return failed == 0 ? 0 : 1;
+}
+
+}
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include "test.h"
+#include "json.hpp"
+#include "bricking.h"
+#include "compress.h"
+#include "layout.h"
+#include "narrow.h"
+#include "quantize.h"
+
+using namespace pl;
+using json = nlohmann::json;
+
+const size_t NUM_PARTICLES = 20001;
+
+static ParticleModel make_model(std::vector<double> &points) {
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> u(-3.f, 7.f);
+	auto positions = std::make_shared<DataT<double>>();
+	positions->components = 3;
+	auto ids = std::make_shared<DataT<int32_t>>();
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		for (size_t c = 0; c < 3; ++c) {
+			positions->data.push_back(u(rng));
+		}
+		ids->data.push_back(static_cast<int32_t>(i));
+	}
+	points.assign(positions->data.begin(), positions->data.end());
+	ParticleModel model;
+	model["positions"] = to_layout(positions, Layout::SOA);
+	model["id"] = ids;
+	auto radius = std::make_shared<DataT<float>>();
+	radius->data.push_back(0.3f);
+	model["radius"] = radius;
+	return model;
+}
+
+// Each particle is owned by exactly one brick, inside its bounds, and is a ghost in
+// exactly the other bricks whose ghost bounds contain it
+static void test_brick_ownership() {
+	std::vector<double> points;
+	ParticleModel model = make_model(points);
+	for (const float width : {0.f, 0.4f}) {
+		BrickOptions options;
+		options.dims[0] = 3;
+		options.dims[1] = 2;
+		options.dims[2] = 4;
+		options.ghost_width = width;
+		std::vector<Brick> bricks = brick_particles(model, options);
+		PL_CHECK(bricks.size() == 24);
+		std::vector<size_t> owners(NUM_PARTICLES, 0);
+		for (const Brick &brick : bricks) {
+			PL_CHECK(brick.model.at("radius") == model["radius"]);
+			const Data &ids = *brick.model.at("id");
+			const Data &pos = *brick.model.at("positions");
+			PL_CHECK(ids.count() == brick.owned + brick.ghosts);
+			PL_CHECK(pos.count() == ids.count());
+			PL_CHECK(width > 0.f || brick.ghosts == 0);
+
+			std::set<size_t> in_brick;
+			for (size_t i = 0; i < ids.count(); ++i) {
+				const size_t k = static_cast<size_t>(ids.get_float(i));
+				// Owned particles and ghosts are each in the order of the model
+				PL_CHECK(i == 0 || i == brick.owned || k > static_cast<size_t>(ids.get_float(i - 1)));
+				in_brick.insert(k);
+				for (size_t c = 0; c < 3; ++c) {
+					const float x = pos.get_float(pos.index(i, c));
+					PL_CHECK(x == static_cast<float>(points[k * 3 + c]));
+					if (i < brick.owned) {
+						PL_CHECK(x >= brick.bounds.lower[c] - 1e-5f && x <= brick.bounds.upper[c] + 1e-5f);
+					}
+				}
+				if (i < brick.owned) {
+					++owners[k];
+				}
+			}
+			for (size_t k = 0; k < NUM_PARTICLES; ++k) {
+				bool inside = true;
+				for (size_t c = 0; c < 3; ++c) {
+					const float x = static_cast<float>(points[k * 3 + c]);
+					inside = inside && x >= brick.ghost_bounds.lower[c] && x <= brick.ghost_bounds.upper[c];
+				}
+				PL_CHECK(inside == (in_brick.count(k) == 1));
+			}
+		}
+		for (const size_t o : owners) {
+			PL_CHECK(o == 1);
+		}
+	}
+}
+
+// The exported files hold the type recorded in the JSON, including attributes
+// which aren't stored as a scalar type
+static void test_export_types() {
+	std::vector<double> points;
+	ParticleModel model = make_model(points);
+	model["positions"] = quantize_positions(*model["positions"]);
+	auto ids = std::make_shared<DataT<int64_t>>();
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		ids->data.push_back((int64_t(1) << 40) + static_cast<int64_t>(i % 100));
+	}
+	model["id"] = narrow_integers(ids);
+	model["compressed"] = compress(*ids);
+	auto values = std::make_shared<DataT<float>>();
+	values->data.assign(NUM_PARTICLES, 0.5f);
+	model["half"] = to_half(*values);
+
+	BrickOptions options;
+	options.dims[0] = 2;
+	std::vector<Brick> bricks = brick_particles(model, options);
+	export_bricks(FileName("test_bricking.json"), bricks);
+
+	json index;
+	{
+		std::ifstream in("test_bricking.json");
+		in >> index;
+	}
+	std::remove("test_bricking.json");
+	const std::map<std::string, std::pair<std::string, size_t>> expected = {
+		{"positions", {"float", 4}},
+		{"id", {"int64", 8}},
+		{"compressed", {"int64", 8}},
+		{"half", {"float", 4}},
+		{"radius", {"float", 4}}
+	};
+	PL_CHECK(index["bricks"].size() == 2);
+	for (const auto &brick : index["bricks"]) {
+		PL_CHECK(brick["attributes"].size() == expected.size());
+		for (const auto &a : brick["attributes"]) {
+			const auto &e = expected.at(a["name"].get<std::string>());
+			PL_CHECK(a["type"].get<std::string>() == e.first);
+			const std::string file = a["file"].get<std::string>();
+			std::ifstream in(file, std::ios::binary | std::ios::ate);
+			const size_t elements = a["count"].get<size_t>() * a["components"].get<size_t>();
+			PL_CHECK(static_cast<size_t>(in.tellg()) == elements * e.second);
+			if (a["name"] == "id" && elements > 0) {
+				int64_t first = 0;
+				in.seekg(0);
+				in.read(reinterpret_cast<char*>(&first), sizeof(first));
+				PL_CHECK(first >= (int64_t(1) << 40));
+			}
+			in.close();
+			std::remove(file.c_str());
+		}
+	}
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"brick_ownership", test_brick_ownership},
+		{"export_types", test_export_types}
+	});
+}
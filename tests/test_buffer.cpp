@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <fstream>
+#include "test.h"
+#include "buffer.h"
+#include "mapped_file.h"
+
+using namespace pl;
+
+// Write n floats i + 0.5 to the file after the header bytes
+static void write_floats(const char *file, const size_t header, const size_t n) {
+	std::ofstream out(file, std::ios::binary);
+	for (size_t i = 0; i < header; ++i) {
+		out.put(static_cast<char>(i));
+	}
+	for (size_t i = 0; i < n; ++i) {
+		const float x = static_cast<float>(i) + 0.5f;
+		out.write(reinterpret_cast<const char*>(&x), sizeof(float));
+	}
+}
+
+// Aligned arrays alias the mapping, misaligned ones are copied out
+static void test_map_array() {
+	write_floats("test_buffer.bin", 6, 1000);
+	{
+		auto file = std::make_shared<MappedFile>(FileName("test_buffer.bin"));
+		PL_CHECK(file->size() == 6 + 4000);
+		auto aliased = map_array<float>(file, 8, 999);
+		PL_CHECK(dynamic_cast<MappedDataT<float>*>(aliased.get()));
+		PL_CHECK(aliased->raw_data() == file->data() + 8);
+		auto copied = map_array<float>(file, 6, 1000);
+		PL_CHECK(dynamic_cast<DataT<float>*>(copied.get()));
+		for (size_t i = 0; i < 1000; ++i) {
+			PL_CHECK(copied->get_float(i) == static_cast<float>(i) + 0.5f);
+		}
+		PL_CHECK_THROWS(map_array<float>(file, 8, 1000));
+		PL_CHECK_THROWS(map_array<float>(file, 5000, 1));
+
+		// The mapping is copy-on-write, and outlives the file object
+		static_cast<float*>(aliased->raw_data())[0] = -1.f;
+		std::weak_ptr<MappedFile> weak = file;
+		file.reset();
+		PL_CHECK(!weak.expired());
+		PL_CHECK(aliased->get_float(0) == -1.f);
+		aliased.reset();
+		PL_CHECK(weak.expired());
+	}
+	std::ifstream in("test_buffer.bin", std::ios::binary);
+	in.seekg(6);
+	float first = 0.f;
+	in.read(reinterpret_cast<char*>(&first), sizeof(float));
+	PL_CHECK(first == 0.5f);
+	in.close();
+	std::remove("test_buffer.bin");
+}
+
+// Releasing a buffer takes it without copying, and it stays alive with its owner
+static void test_release_buffer() {
+	auto data = std::make_shared<DataT<int32_t>>();
+	for (int32_t i = 0; i < 100; ++i) {
+		data->data.push_back(i);
+	}
+	const int32_t *elements = data->data.data();
+	PL_CHECK(can_release_buffer<int32_t>(*data));
+	PL_CHECK(!can_release_buffer<float>(*data));
+	PL_CHECK_THROWS(release_buffer<float>(*data));
+	ReleasedBuffer<int32_t> buffer = release_buffer<int32_t>(*data);
+	PL_CHECK(buffer.data == elements && buffer.size == 100);
+	PL_CHECK(data->size() == 0);
+	data.reset();
+	PL_CHECK(buffer.data[99] == 99);
+
+	// Adopting and releasing again passes the same buffer and owner along
+	auto adopted = adopt_buffer(std::move(buffer));
+	PL_CHECK(adopted->raw_data() == elements);
+	PL_CHECK(adopted->get_float(42) == 42.f);
+	ReleasedBuffer<int32_t> again = release_buffer<int32_t>(*adopted);
+	PL_CHECK(again.data == elements && adopted->size() == 0);
+
+	bool deleted = false;
+	{
+		auto external = adopt_buffer<float>(new float[4](), 4, [&](float *p) {
+			deleted = true;
+			delete[] p;
+		});
+		ReleasedBuffer<float> released = release_buffer<float>(*external);
+		external.reset();
+		PL_CHECK(!deleted);
+	}
+	PL_CHECK(deleted);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"map_array", test_map_array},
+		{"release_buffer", test_release_buffer}
+	});
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include "test.h"
+#include "compress.h"
+#include "quantize.h"
+
+using namespace pl;
+
+const size_t CHUNK = CompressedData::CHUNK_SIZE;
+
+// Check every way of reading the compressed data gives back the original values
+template<typename T>
+static void check_round_trip(const DataT<T> &data) {
+	auto compressed = compress(data);
+	PL_CHECK(compressed->type() == typeid(T));
+	PL_CHECK(compressed->size() == data.size());
+	PL_CHECK(compressed->components == data.components);
+	PL_CHECK(compressed->num_chunks() == (data.size() + CHUNK - 1) / CHUNK);
+
+	auto decompressed = decompress(*compressed);
+	PL_CHECK(decompressed->type() == typeid(T));
+	PL_CHECK(decompressed->size() == data.size());
+	PL_CHECK(data.size() == 0
+			|| std::memcmp(decompressed->raw_data(), data.data.data(), data.size() * sizeof(T)) == 0);
+
+	// Ranges which start and end inside chunks, and span chunk boundaries
+	const size_t n = data.size();
+	const size_t ranges[][2] = {{0, n}, {n / 3, n / 3 + CHUNK + 17}, {CHUNK - 5, CHUNK + 5}, {n - 1, n}};
+	for (const auto &r : ranges) {
+		const size_t begin = std::min(r[0], n), end = std::min(r[1], n);
+		std::vector<T> values(end - begin);
+		std::vector<float> floats(end - begin);
+		std::vector<double> doubles(end - begin);
+		PL_CHECK(compressed->can_get_values());
+		compressed->get_values(begin, end, values.data());
+		compressed->get_floats(begin, end, floats.data());
+		compressed->get_doubles(begin, end, doubles.data());
+		for (size_t i = begin; i < end; ++i) {
+			PL_CHECK(values[i - begin] == data.data[i]);
+			PL_CHECK(floats[i - begin] == static_cast<float>(data.data[i]));
+			PL_CHECK(doubles[i - begin] == static_cast<double>(data.data[i]));
+		}
+	}
+
+	// Each thread caches the last chunk it accessed, so read from several at once
+	// and count the mismatches, since the checks can't throw on the threads
+	std::vector<size_t> mismatches(4, 0);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t]() {
+			for (size_t i = t; i < n; i += 997) {
+				mismatches[t] += compressed->get_float(i) != static_cast<float>(data.data[i]);
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+	for (const size_t m : mismatches) {
+		PL_CHECK(m == 0);
+	}
+}
+
+static void test_round_trip() {
+	std::mt19937_64 rng(7);
+	for (const size_t n : {size_t(0), size_t(1), CHUNK, 3 * CHUNK + 101}) {
+		DataT<int32_t> ints;
+		DataT<int64_t> ids;
+		DataT<uint8_t> bytes;
+		DataT<float> floats;
+		DataT<double> doubles;
+		floats.components = 3;
+		for (size_t i = 0; i < n; ++i) {
+			ints.data.push_back(static_cast<int32_t>(rng()));
+			ids.data.push_back((int64_t(1) << 40) + static_cast<int64_t>(i * 3));
+			bytes.data.push_back(static_cast<uint8_t>(i % 5));
+			doubles.data.push_back(std::sin(i * 0.001) * 1e6);
+			for (size_t c = 0; c < 3; ++c) {
+				floats.data.push_back(static_cast<float>(i) * 0.25f + static_cast<float>(rng() % 100));
+			}
+		}
+		check_round_trip(ints);
+		check_round_trip(ids);
+		check_round_trip(bytes);
+		check_round_trip(floats);
+		check_round_trip(doubles);
+	}
+}
+
+// Smooth data compresses, and data stored as another type is compressed as its values
+static void test_compression() {
+	DataT<int64_t> ids;
+	for (size_t i = 0; i < 10 * CHUNK; ++i) {
+		ids.data.push_back(static_cast<int64_t>(i));
+	}
+	auto compressed = compress(ids);
+	PL_CHECK(compressed->compressed_bytes() < ids.bytes() / 4);
+
+	DataT<float> positions;
+	positions.components = 3;
+	for (size_t i = 0; i < 3 * CHUNK; ++i) {
+		positions.data.push_back(static_cast<float>(i % 1000));
+	}
+	auto quantized = quantize_positions(positions);
+	auto from_quantized = compress(*quantized);
+	PL_CHECK(from_quantized->type() == typeid(float));
+	for (size_t i = 0; i < quantized->size(); i += 101) {
+		PL_CHECK(from_quantized->get_float(i) == quantized->get_float(i));
+	}
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"round_trip", test_round_trip},
+		{"compression", test_compression}
+	});
+}
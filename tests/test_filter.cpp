@@ -0,0 +1,103 @@
+#include <limits>
+#include <random>
+#include "test.h"
+#include "compress.h"
+#include "filter.h"
+#include "layout.h"
+
+using namespace pl;
+
+const size_t NUM_PARTICLES = 200003;
+
+static ParticleModel make_model(std::vector<double> &concentration, std::vector<int32_t> &types) {
+	std::mt19937 rng(15);
+	std::uniform_real_distribution<double> u(0.0, 1.0);
+	auto c = std::make_shared<DataT<double>>();
+	auto t = std::make_shared<DataT<int32_t>>();
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		c->data.push_back(u(rng));
+		t->data.push_back(static_cast<int32_t>(i % 9));
+		positions->data.push_back(static_cast<float>(i));
+		positions->data.push_back(static_cast<float>(i % 100));
+		positions->data.push_back(-static_cast<float>(i));
+	}
+	c->data[7] = std::numeric_limits<double>::quiet_NaN();
+	concentration.assign(c->data.begin(), c->data.end());
+	types.assign(t->data.begin(), t->data.end());
+	ParticleModel model;
+	model["concentration"] = c;
+	// Compressed data is filtered and compacted through its decoded values
+	model["atom_type"] = compress(*t);
+	model["positions"] = to_layout(positions, Layout::SOA);
+	auto radius = std::make_shared<DataT<float>>();
+	radius->data.push_back(0.1f);
+	model["radius"] = radius;
+	return model;
+}
+
+// The mask matches the conditions evaluated one particle at a time
+static void test_mask() {
+	std::vector<double> concentration;
+	std::vector<int32_t> types;
+	ParticleModel model = make_model(concentration, types);
+	const Predicate p = Predicate::greater("concentration", 0.3)
+		&& Predicate::in("atom_type", {1, 6}) && Predicate::less("positions", 50.0, 1);
+	const std::vector<uint8_t> mask = filter_mask(model, p);
+	PL_CHECK(mask.size() == NUM_PARTICLES);
+	size_t expected_count = 0;
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		const bool pass = concentration[i] > 0.3 && (types[i] == 1 || types[i] == 6)
+			&& static_cast<double>(i % 100) < 50.0;
+		PL_CHECK(mask[i] == (pass ? 1 : 0));
+		expected_count += pass;
+	}
+	PL_CHECK(mask_count(mask) == expected_count);
+
+	const std::vector<uint8_t> all = filter_mask(model, Predicate());
+	PL_CHECK(mask_count(all) == NUM_PARTICLES);
+	const std::vector<uint8_t> in_range = filter_mask(model, Predicate::range("concentration", 0.0, 1.0));
+	PL_CHECK(mask_count(in_range) == NUM_PARTICLES - 1);
+	PL_CHECK(in_range[7] == 0);
+	PL_CHECK_THROWS(filter_mask(model, Predicate::greater("missing", 0.0)));
+}
+
+// Compacting keeps the passing particles in order, with their type and layout
+static void test_compact() {
+	std::vector<double> concentration;
+	std::vector<int32_t> types;
+	ParticleModel model = make_model(concentration, types);
+	const Predicate p = Predicate::range("concentration", 0.25, 0.5) && Predicate::greater("positions", 1000.0, 0);
+	const ParticleModel filtered = filter(model, p);
+	PL_CHECK(filtered.at("radius") == model["radius"]);
+	const Data &c = *filtered.at("concentration");
+	const Data &t = *filtered.at("atom_type");
+	const Data &pos = *filtered.at("positions");
+	PL_CHECK(c.type() == typeid(double));
+	PL_CHECK(t.type() == typeid(int32_t));
+	PL_CHECK(pos.layout == Layout::SOA);
+	PL_CHECK(pos.count() == c.count() && t.count() == c.count());
+	size_t j = 0;
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		if (!(concentration[i] >= 0.25 && concentration[i] <= 0.5 && i > 1000)) {
+			continue;
+		}
+		PL_CHECK(j < c.count());
+		std::vector<double> value(1);
+		c.get_doubles(j, j + 1, value.data());
+		PL_CHECK(value[0] == concentration[i]);
+		PL_CHECK(t.get_float(j) == static_cast<float>(types[i]));
+		PL_CHECK(pos.get_float(pos.index(j, 0)) == static_cast<float>(i));
+		PL_CHECK(pos.get_float(pos.index(j, 2)) == -static_cast<float>(i));
+		++j;
+	}
+	PL_CHECK(j == c.count());
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"mask", test_mask},
+		{"compact", test_compact}
+	});
+}
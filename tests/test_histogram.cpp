@@ -0,0 +1,120 @@
+#include <cmath>
+#include <limits>
+#include "test.h"
+#include "histogram.h"
+#include "layout.h"
+
+using namespace pl;
+
+// Integer values in [-20, 130) with unit bins, so the expected bin of each value is exact
+static void test_linear() {
+	auto values = std::make_shared<DataT<int32_t>>();
+	const size_t n = 300000;
+	for (size_t i = 0; i < n; ++i) {
+		values->data.push_back(static_cast<int32_t>(i % 150) - 20);
+	}
+	HistogramOptions options;
+	options.bins = 100;
+	options.min = 0.0;
+	options.max = 100.0;
+	const Histogram h = histogram(*values, 0, options);
+	PL_CHECK(h.bins.size() == 100);
+	PL_CHECK(h.edge(0) == 0.0 && h.edge(100) == 100.0);
+	PL_CHECK(h.underflow == 20 * (n / 150));
+	PL_CHECK(h.overflow == 29 * (n / 150));
+	for (size_t b = 0; b < 99; ++b) {
+		PL_CHECK(h.bins[b] == n / 150);
+	}
+	// A value equal to max goes in the last bin
+	PL_CHECK(h.bins[99] == 2 * (n / 150));
+	PL_CHECK(h.total() + h.underflow + h.overflow == n);
+
+	// The range is taken from the values, the last value is in the last bin
+	const Histogram automatic = histogram(*values, 0);
+	PL_CHECK(automatic.min == -20.0 && automatic.max == 129.0);
+	PL_CHECK(automatic.total() == n);
+	PL_CHECK(automatic.underflow == 0.0 && automatic.overflow == 0.0);
+	PL_CHECK(automatic.bins.front() > 0.0 && automatic.bins.back() > 0.0);
+}
+
+// Each particle adds its weight, NaNs are skipped
+static void test_weights() {
+	auto values = std::make_shared<DataT<float>>();
+	auto weights = std::make_shared<DataT<double>>();
+	for (size_t i = 0; i < 10000; ++i) {
+		values->data.push_back(static_cast<float>(i % 4));
+		weights->data.push_back(0.5 * (i % 4));
+	}
+	values->data[1] = std::numeric_limits<float>::quiet_NaN();
+	HistogramOptions options;
+	options.bins = 4;
+	options.weights = weights;
+	const Histogram h = histogram(*values, 0, options);
+	PL_CHECK(h.min == 0.0 && h.max == 3.0);
+	PL_CHECK(h.bins[0] == 0.0);
+	PL_CHECK(h.bins[1] == 0.5 * 2499);
+	PL_CHECK(h.bins[2] == 1.0 * 2500);
+	PL_CHECK(h.bins[3] == 1.5 * 2500);
+
+	options.weights = std::make_shared<DataT<double>>();
+	PL_CHECK_THROWS(histogram(*values, 0, options));
+	PL_CHECK_THROWS(histogram(*values, 1));
+	HistogramOptions no_bins;
+	no_bins.bins = 0;
+	PL_CHECK_THROWS(histogram(*values, 0, no_bins));
+}
+
+// Log bins of powers of ten, with the non-positive values below the range
+static void test_log() {
+	auto values = std::make_shared<DataT<double>>();
+	for (int k = 0; k <= 5; ++k) {
+		values->data.push_back(std::pow(10.0, k));
+	}
+	values->data.push_back(0.0);
+	values->data.push_back(-3.0);
+	HistogramOptions options;
+	options.bins = 5;
+	options.scale = BinScale::LOG;
+	const Histogram h = histogram(*values, 0, options);
+	PL_CHECK(std::abs(h.min - 1.0) < 1e-12 && std::abs(h.max - 1e5) < 1e-7);
+	PL_CHECK(std::abs(h.edge(2) - 100.0) < 1e-9);
+	PL_CHECK(h.underflow == 2.0);
+	PL_CHECK(h.bins[0] == 1.0 && h.bins[3] == 1.0 && h.bins[4] == 2.0);
+	options.min = 0.0;
+	options.max = 10.0;
+	PL_CHECK_THROWS(histogram(*values, 0, options));
+}
+
+// Magnitudes of the particle vectors, which are the same in either layout
+static void test_magnitude() {
+	auto vectors = std::make_shared<DataT<float>>();
+	vectors->components = 3;
+	for (size_t i = 0; i < 100000; ++i) {
+		const float s = static_cast<float>(i % 3 + 1);
+		vectors->data.push_back(3.f * s);
+		vectors->data.push_back(0.f);
+		vectors->data.push_back(-4.f * s);
+	}
+	HistogramOptions options;
+	options.bins = 3;
+	options.min = 2.5;
+	options.max = 17.5;
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		const Histogram h = histogram(*to_layout(vectors, layout), MAGNITUDE, options);
+		PL_CHECK(h.bins[0] == 33334.0);
+		PL_CHECK(h.bins[1] == 33333.0);
+		PL_CHECK(h.bins[2] == 33333.0);
+	}
+	const std::vector<Histogram> per_component = histograms(*vectors);
+	PL_CHECK(per_component.size() == 3);
+	PL_CHECK(per_component[2].min == -12.0 && per_component[2].max == -4.0);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"linear", test_linear},
+		{"weights", test_weights},
+		{"log", test_log},
+		{"magnitude", test_magnitude}
+	});
+}
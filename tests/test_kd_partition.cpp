@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <random>
+#include "test.h"
+#include "kd_partition.h"
+#include "layout.h"
+#include "parallel.h"
+
+using namespace pl;
+
+// Enough particles for the top splits to take the parallel selection, which needs
+// at least two ranges of 1 << 16 particles
+const size_t NUM_PARTICLES = 300007;
+// Thread counts to run with, 0 is the hardware concurrency. Forcing more threads
+// runs the parallel selection even on a single core machine
+const size_t THREAD_COUNTS[] = {0, 1, 4};
+
+// Clustered particles with a uniform background and many duplicates, which must
+// still be split evenly
+static ParticleModel make_model() {
+	std::mt19937 rng(11);
+	std::normal_distribution<float> g(0.f, 1.f);
+	std::uniform_real_distribution<float> u(0.f, 100.f);
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	auto ids = std::make_shared<DataT<int32_t>>();
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		vec3f p(u(rng), u(rng) * 0.5f, u(rng) * 0.2f);
+		if (i % 4 != 0) {
+			const float cluster = static_cast<float>(i % 7);
+			p = vec3f(cluster * 13.f + g(rng), cluster * 5.f + g(rng) * 0.3f, g(rng));
+		}
+		if (i % 100 == 0) {
+			p = vec3f(50.f);
+		}
+		positions->data.push_back(p.x);
+		positions->data.push_back(p.y);
+		positions->data.push_back(p.z);
+		ids->data.push_back(static_cast<int32_t>(i));
+	}
+	ParticleModel model;
+	model["positions"] = positions;
+	model["id"] = ids;
+	auto radius = std::make_shared<DataT<float>>();
+	radius->data.push_back(1.f);
+	model["radius"] = radius;
+	return model;
+}
+
+// Every particle is in exactly one piece, the piece counts differ by at most one
+// and each piece's bounds are the tight bounds of its particles
+static void check_partition(const ParticleModel &model, const size_t count) {
+	const std::vector<KdPiece> pieces = kd_partition(model, count);
+	PL_CHECK(pieces.size() == count);
+	std::vector<size_t> seen(NUM_PARTICLES, 0);
+	size_t smallest = NUM_PARTICLES, largest = 0;
+	for (const KdPiece &piece : pieces) {
+		PL_CHECK(piece.model.at("radius") == model.at("radius"));
+		const Data &ids = *piece.model.at("id");
+		const Data &pos = *piece.model.at("positions");
+		PL_CHECK(pos.count() == ids.count());
+		smallest = std::min(smallest, ids.count());
+		largest = std::max(largest, ids.count());
+		box3f b;
+		for (size_t i = 0; i < ids.count(); ++i) {
+			++seen[static_cast<size_t>(ids.get_float(i))];
+			b.extend(vec3f(pos.get_float(pos.index(i, 0)), pos.get_float(pos.index(i, 1)),
+						pos.get_float(pos.index(i, 2))));
+		}
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(b.lower[c] == piece.bounds.lower[c]);
+			PL_CHECK(b.upper[c] == piece.bounds.upper[c]);
+		}
+	}
+	PL_CHECK(largest - smallest <= 1);
+	for (const size_t s : seen) {
+		PL_CHECK(s == 1);
+	}
+}
+
+static void test_partition() {
+	ParticleModel model = make_model();
+	for (const size_t threads : THREAD_COUNTS) {
+		set_num_threads(threads);
+		for (const size_t count : {1, 2, 3, 7, 16, 100}) {
+			check_partition(model, count);
+		}
+	}
+	set_num_threads(0);
+}
+
+// The order is deterministic, and the first split of two pieces divides the
+// particles along the widest axis, x
+static void test_order() {
+	ParticleModel model = make_model();
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		auto positions = to_layout(model["positions"], layout);
+		std::vector<size_t> offsets;
+		const std::vector<size_t> order = kd_order(*positions, 2, offsets);
+		std::vector<size_t> again_offsets;
+		PL_CHECK(kd_order(*positions, 2, again_offsets) == order);
+		PL_CHECK(offsets == again_offsets);
+		PL_CHECK(offsets.size() == 3 && offsets[0] == 0 && offsets[2] == NUM_PARTICLES);
+		float left_max = -1e30f, right_min = 1e30f;
+		for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+			const float x = positions->get_float(positions->index(order[i], 0));
+			if (i < offsets[1]) {
+				left_max = std::max(left_max, x);
+			} else {
+				right_min = std::min(right_min, x);
+			}
+		}
+		PL_CHECK(left_max <= right_min);
+	}
+}
+
+// Many particles sit exactly on the median, they end up on both sides of the split
+// without breaking the balance, whether the selection runs serially or in parallel
+static void test_median_duplicates() {
+	std::mt19937 rng(23);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+		positions->data.push_back(i % 5 < 2 ? 50.f : u(rng) * 100.f);
+		positions->data.push_back(u(rng));
+		positions->data.push_back(u(rng));
+	}
+	for (const size_t threads : THREAD_COUNTS) {
+		set_num_threads(threads);
+		std::vector<size_t> offsets;
+		const std::vector<size_t> order = kd_order(*positions, 2, offsets);
+		PL_CHECK(offsets.size() == 3 && offsets[1] == NUM_PARTICLES / 2);
+		std::vector<size_t> seen(NUM_PARTICLES, 0);
+		float left_max = -1e30f, right_min = 1e30f;
+		for (size_t i = 0; i < NUM_PARTICLES; ++i) {
+			++seen[order[i]];
+			const float x = positions->data[order[i] * 3];
+			if (i < offsets[1]) {
+				left_max = std::max(left_max, x);
+			} else {
+				right_min = std::min(right_min, x);
+			}
+		}
+		PL_CHECK(left_max == 50.f && right_min == 50.f);
+		for (const size_t s : seen) {
+			PL_CHECK(s == 1);
+		}
+	}
+	set_num_threads(0);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"partition", test_partition},
+		{"order", test_order},
+		{"median_duplicates", test_median_duplicates}
+	});
+}
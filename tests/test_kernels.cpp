@@ -0,0 +1,155 @@
+#include <cmath>
+#include <random>
+#include "test.h"
+#include "kernels.h"
+
+using namespace pl;
+
+const SimdLevel LEVELS[] = {SimdLevel::SCALAR, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512};
+
+// Sizes around the vector widths, so each path's remainder handling is exercised
+const size_t SIZES[] = {0, 1, 3, 7, 8, 15, 16, 17, 33, 64, 1001};
+
+// Run the test at each SIMD level the CPU supports
+template<typename F>
+static void at_each_level(const F &test) {
+	const SimdLevel original = simd_level();
+	for (const SimdLevel level : LEVELS) {
+		set_simd_level(level);
+		test();
+	}
+	set_simd_level(original);
+}
+
+// The conversions match static_cast, and don't write past the end of the output
+static void test_convert() {
+	std::mt19937_64 rng(1);
+	at_each_level([&]() {
+		for (const size_t n : SIZES) {
+			std::vector<double> d(n);
+			std::vector<int64_t> l(n);
+			for (size_t i = 0; i < n; ++i) {
+				d[i] = std::ldexp(static_cast<double>(static_cast<int64_t>(rng())), -30);
+				l[i] = static_cast<int64_t>(rng()) >> (rng() % 64);
+			}
+			std::vector<float> f(n + 1, -7.f), g(n + 1, -7.f);
+			convert_f64_f32(d.data(), n, f.data());
+			convert_i64_f32(l.data(), n, g.data());
+			for (size_t i = 0; i < n; ++i) {
+				PL_CHECK(f[i] == static_cast<float>(d[i]));
+				PL_CHECK(g[i] == static_cast<float>(l[i]));
+			}
+			PL_CHECK(f[n] == -7.f && g[n] == -7.f);
+		}
+	});
+}
+
+static void test_normalize() {
+	std::vector<uint16_t> in(65536 + 5);
+	for (size_t i = 0; i < in.size(); ++i) {
+		in[i] = static_cast<uint16_t>(i);
+	}
+	at_each_level([&]() {
+		std::vector<uint8_t> out(in.size());
+		normalize_u16_u8(in.data(), in.size(), out.data());
+		for (size_t i = 0; i < in.size(); ++i) {
+			PL_CHECK(out[i] == static_cast<uint8_t>(std::floor(255.0 * in[i] / 65535.0)));
+		}
+	});
+}
+
+// Deinterleaving splits out the components, and interleaving puts them back
+static void test_interleave() {
+	std::mt19937 rng(2);
+	at_each_level([&]() {
+		for (const size_t n : SIZES) {
+			for (size_t components = 1; components <= 6; ++components) {
+				std::vector<float> aos(n * components), back(n * components);
+				for (float &x : aos) {
+					x = static_cast<float>(rng());
+				}
+				std::vector<std::vector<float>> soa(components, std::vector<float>(n));
+				std::vector<float*> out;
+				std::vector<const float*> in;
+				for (auto &s : soa) {
+					out.push_back(s.data());
+					in.push_back(s.data());
+				}
+				deinterleave(aos.data(), n, components, out.data());
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t c = 0; c < components; ++c) {
+						PL_CHECK(soa[c][i] == aos[i * components + c]);
+					}
+				}
+				interleave(in.data(), n, components, back.data());
+				PL_CHECK(back == aos);
+			}
+		}
+	});
+}
+
+// Swapping reverses the bytes of each element, for every element size
+static void test_byte_swap() {
+	std::mt19937 rng(4);
+	at_each_level([&]() {
+		for (const size_t n : SIZES) {
+			for (const size_t size : {1, 2, 4, 8, 3}) {
+				std::vector<uint8_t> bytes(n * size + 1);
+				for (uint8_t &b : bytes) {
+					b = static_cast<uint8_t>(rng());
+				}
+				std::vector<uint8_t> swapped = bytes;
+				byte_swap(swapped.data(), n, size);
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t b = 0; b < size; ++b) {
+						PL_CHECK(swapped[i * size + b] == bytes[i * size + size - 1 - b]);
+					}
+				}
+				PL_CHECK(swapped.back() == bytes.back());
+				byte_swap(swapped.data(), n, size);
+				PL_CHECK(swapped == bytes);
+			}
+		}
+	});
+}
+
+// Dequantizing matches the scalar in * scale + offset for each component count
+static void test_dequantize() {
+	std::mt19937 rng(6);
+	const float scale[4] = {0.5f, 1.f / 255.f, 3.25f, -2.f};
+	const float offset[4] = {-1.f, 0.f, 100.f, 7.5f};
+	at_each_level([&]() {
+		for (const size_t n : SIZES) {
+			for (size_t components = 1; components <= 4; ++components) {
+				std::vector<uint8_t> u8(n * components);
+				std::vector<uint16_t> u16(n * components);
+				for (size_t i = 0; i < u8.size(); ++i) {
+					u8[i] = static_cast<uint8_t>(rng());
+					u16[i] = static_cast<uint16_t>(rng());
+				}
+				std::vector<float> a(n * components + 1, -7.f), b(n * components + 1, -7.f);
+				dequantize_u8_f32(u8.data(), n, components, scale, offset, a.data());
+				dequantize_u16_f32(u16.data(), n, components, scale, offset, b.data());
+				for (size_t i = 0; i < n * components; ++i) {
+					const size_t c = i % components;
+					const float x = u8[i] * scale[c] + offset[c];
+					const float y = u16[i] * scale[c] + offset[c];
+					// The scalar path may be contracted into a fused multiply-add
+					PL_CHECK(std::abs(a[i] - x) <= 1e-6f * (1.f + std::abs(x)));
+					PL_CHECK(std::abs(b[i] - y) <= 1e-6f * (1.f + std::abs(y)));
+				}
+				PL_CHECK(a.back() == -7.f && b.back() == -7.f);
+			}
+		}
+	});
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"convert", test_convert},
+		{"normalize", test_normalize},
+		{"interleave", test_interleave},
+		{"byte_swap", test_byte_swap},
+		{"dequantize", test_dequantize}
+	});
+}
@@ -0,0 +1,76 @@
+#include <random>
+#include "test.h"
+#include "layout.h"
+
+using namespace pl;
+
+// Transposing to SOA puts each component in its own stream, and transposing back
+// gives the original array
+template<typename T>
+static void check_round_trip(const size_t n, const size_t components) {
+	std::mt19937_64 rng(12);
+	auto aos = std::make_shared<DataT<T>>();
+	aos->components = components;
+	for (size_t i = 0; i < n * components; ++i) {
+		aos->data.push_back(static_cast<T>(rng()));
+	}
+	PL_CHECK(to_layout(aos, Layout::AOS) == aos);
+	auto soa = to_layout(aos, Layout::SOA);
+	PL_CHECK(soa != aos);
+	PL_CHECK(soa->layout == Layout::SOA);
+	PL_CHECK(soa->type() == typeid(T));
+	PL_CHECK(soa->components == components);
+	PL_CHECK(soa->size() == n * components);
+	const T *streams = static_cast<const T*>(static_cast<const Data&>(*soa).raw_data());
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t c = 0; c < components; ++c) {
+			PL_CHECK(streams[c * n + i] == aos->data[i * components + c]);
+			PL_CHECK(soa->get_float(soa->index(i, c)) == aos->get_float(aos->index(i, c)));
+		}
+	}
+	PL_CHECK(to_layout(soa, Layout::SOA) == soa);
+	auto back = to_layout(soa, Layout::AOS);
+	PL_CHECK(back->layout == Layout::AOS);
+	PL_CHECK(std::dynamic_pointer_cast<DataT<T>>(back)->data == aos->data);
+}
+
+static void test_round_trip() {
+	// Sizes above the transpose grain are split across threads
+	for (const size_t n : {0, 1, 1023, 1025, 200001}) {
+		check_round_trip<float>(n, 3);
+		check_round_trip<int32_t>(n, 4);
+		check_round_trip<double>(n, 2);
+		check_round_trip<int64_t>(n, 3);
+		check_round_trip<uint8_t>(n, 5);
+	}
+}
+
+// set_layout transposes the multi-component arrays and leaves the others as-is
+static void test_set_layout() {
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	auto ids = std::make_shared<DataT<int32_t>>();
+	for (size_t i = 0; i < 100; ++i) {
+		positions->data.push_back(static_cast<float>(i));
+		positions->data.push_back(static_cast<float>(i) + 0.5f);
+		positions->data.push_back(-static_cast<float>(i));
+		ids->data.push_back(static_cast<int32_t>(i));
+	}
+	ParticleModel model;
+	model["positions"] = positions;
+	model["id"] = ids;
+	set_layout(model, Layout::SOA);
+	PL_CHECK(model["positions"]->layout == Layout::SOA);
+	PL_CHECK(model["id"] == ids);
+	PL_CHECK(model["positions"]->get_float(100 + 7) == 7.5f);
+	set_layout(model, Layout::AOS);
+	PL_CHECK(model["positions"]->layout == Layout::AOS);
+	PL_CHECK(std::dynamic_pointer_cast<DataT<float>>(model["positions"])->data == positions->data);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"round_trip", test_round_trip},
+		{"set_layout", test_set_layout}
+	});
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include "test.h"
+#include "import_gromacs.h"
+#include "memory_report.h"
+
+using namespace pl;
+
+static bool aligned(const void *ptr, const size_t alignment) {
+	return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+static void test_large_buffer_resource() {
+	for (const bool huge_pages : {false, true}) {
+		LargeBufferResource resource(huge_pages);
+		for (const size_t bytes : {size_t(1), size_t(1000), LargeBufferResource::LARGE_ALLOCATION,
+				3 * LargeBufferResource::LARGE_ALLOCATION + 5})
+		{
+			for (const size_t alignment : {size_t(8), CACHE_LINE_SIZE, size_t(4096)}) {
+				void *ptr = resource.allocate(bytes, alignment);
+				PL_CHECK(ptr);
+				PL_CHECK(aligned(ptr, std::max(alignment, CACHE_LINE_SIZE)));
+				std::memset(ptr, 0xab, bytes);
+				resource.deallocate(ptr, bytes, alignment);
+			}
+		}
+	}
+}
+
+static void test_arena() {
+	Arena arena(4096);
+	std::vector<char*> allocations;
+	for (size_t i = 0; i < 100; ++i) {
+		const size_t alignment = size_t(1) << (i % 7);
+		char *ptr = static_cast<char*>(arena.allocate(i + 1, alignment));
+		PL_CHECK(aligned(ptr, alignment));
+		std::memset(ptr, static_cast<int>(i), i + 1);
+		allocations.push_back(ptr);
+	}
+	// Allocations larger than a block get a block of their own
+	void *large = arena.allocate(100000, 64);
+	PL_CHECK(aligned(large, 64));
+	std::memset(large, 0, 100000);
+	PL_CHECK(arena.reserved_bytes() >= 100000 + 5050);
+	// The allocations don't overlap
+	for (size_t i = 0; i < allocations.size(); ++i) {
+		for (size_t j = 0; j <= i; ++j) {
+			PL_CHECK(allocations[i][j] == static_cast<char>(i));
+		}
+	}
+
+	auto resource = std::make_shared<Arena>();
+	auto data = make_data<double>(resource);
+	data->data.resize(1000);
+	PL_CHECK(aligned(data->data.data(), alignof(double)));
+}
+
+// The tracker follows allocations through the default resource, per phase
+static void test_allocation_tracker() {
+	auto tracker = enable_allocation_tracking();
+	PL_CHECK(allocation_tracker() == tracker);
+	const size_t start = tracker->current_bytes();
+	{
+		AllocationPhase outer("outer");
+		auto data = std::make_shared<DataT<float>>();
+		data->data.resize(1000);
+		PL_CHECK(tracker->current_bytes() >= start + 4000);
+		{
+			AllocationPhase inner("inner");
+			std::vector<uint8_t, ResourceAllocator<uint8_t>> scratch(100000);
+		}
+	}
+	PL_CHECK(tracker->current_bytes() == start);
+	PL_CHECK(tracker->peak_bytes() >= start + 104000);
+	const std::vector<AllocationTracker::Phase> phases = tracker->phase_report();
+	PL_CHECK(phases.size() == 2);
+	PL_CHECK(phases[0].name == "outer" && phases[1].name == "inner");
+	PL_CHECK(!phases[0].running && !phases[1].running);
+	PL_CHECK(phases[0].allocated_bytes >= phases[1].allocated_bytes + 4000);
+	PL_CHECK(phases[1].allocated_bytes >= 100000);
+	PL_CHECK(phases[0].peak_bytes >= start + 104000);
+	PL_CHECK(phases[1].end_bytes == phases[1].start_bytes);
+	disable_allocation_tracking();
+	PL_CHECK(!allocation_tracker());
+}
+
+static void test_model_footprint() {
+	ParticleModel model;
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	positions->data.resize(300);
+	positions->data.shrink_to_fit();
+	auto ids = std::make_shared<DataT<int64_t>>();
+	ids->data.resize(100);
+	ids->data.shrink_to_fit();
+	model["positions"] = positions;
+	model["id"] = ids;
+	const std::vector<AttributeFootprint> footprint = model_footprint(model);
+	PL_CHECK(footprint.size() == 2);
+	PL_CHECK(footprint[0].name == "id" && footprint[0].type == "int64");
+	PL_CHECK(footprint[0].count == 100 && footprint[0].bytes == 800);
+	PL_CHECK(footprint[1].name == "positions" && footprint[1].type == "float");
+	PL_CHECK(footprint[1].count == 100 && footprint[1].components == 3);
+	PL_CHECK(model_bytes(model) == 800 + 1200);
+}
+
+static void write_trajectory(const char *file, const size_t frames, const bool truncate) {
+	std::ofstream out(file);
+	for (size_t f = 0; f < frames; ++f) {
+		out << "Generated by test, t= " << f << ".0\n3\n";
+		for (size_t i = 0; i < 3; ++i) {
+			if (truncate && f + 1 == frames && i == 2) {
+				break;
+			}
+			out << i + 1 << "DZATO DZ" << i + 1 << " " << f << " " << i << " 0.5 1 2 3\n";
+		}
+	}
+}
+
+static void test_import_gromacs() {
+	write_trajectory("test_memory_resource.gro", 2, false);
+	std::vector<ParticleModel> timesteps;
+	import_gromacs("test_memory_resource.gro", timesteps);
+	PL_CHECK(timesteps.size() == 2);
+	for (size_t f = 0; f < 2; ++f) {
+		const Data &positions = *timesteps[f]["positions"];
+		const Data &velocities = *timesteps[f]["velocities"];
+		PL_CHECK(positions.size() == 9);
+		for (size_t i = 0; i < 3; ++i) {
+			PL_CHECK(positions.get_float(positions.index(i, 0)) == static_cast<float>(f));
+			PL_CHECK(positions.get_float(positions.index(i, 1)) == static_cast<float>(i));
+			PL_CHECK(velocities.get_float(velocities.index(i, 2)) == 3.f);
+		}
+	}
+
+	// A frame which ends early can't be read
+	write_trajectory("test_memory_resource.gro", 2, true);
+	timesteps.clear();
+	PL_CHECK_THROWS(import_gromacs("test_memory_resource.gro", timesteps));
+	std::remove("test_memory_resource.gro");
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"large_buffer_resource", test_large_buffer_resource},
+		{"arena", test_arena},
+		{"allocation_tracker", test_allocation_tracker},
+		{"model_footprint", test_model_footprint},
+		{"import_gromacs", test_import_gromacs}
+	});
+}
@@ -0,0 +1,74 @@
+#include <thread>
+#include "test.h"
+#include "model_builder.h"
+
+using namespace pl;
+
+// Fill the chunks from several threads in reverse order, the particles still come
+// out in the order the chunks were added
+static void fill_chunks(ParticleModelBuilder &builder, const size_t chunks, const size_t per_chunk) {
+	const size_t positions = builder.add_attribute<float>("positions", 3);
+	const size_t ids = builder.add_attribute<int64_t>("id");
+	builder.add_attribute<double>("empty");
+	const size_t first = builder.add_chunks(chunks);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t]() {
+			for (size_t c = chunks; c-- > 0;) {
+				if (c % 4 != t) {
+					continue;
+				}
+				ParticleChunk &chunk = builder.chunk(first + c);
+				for (size_t i = 0; i < per_chunk; ++i) {
+					const int64_t id = static_cast<int64_t>(c * per_chunk + i);
+					const float p[3] = {static_cast<float>(id), 0.f, 1.f};
+					chunk.append(positions, p, 3);
+					chunk.append(ids, &id, 1);
+				}
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+static void test_finalize_order() {
+	for (const bool chunked : {false, true}) {
+		ParticleModelBuilder builder;
+		fill_chunks(builder, 37, 1000);
+		ParticleModel model;
+		builder.finalize(model, chunked);
+		PL_CHECK(model.find("empty") == model.end());
+		const Data &positions = *model["positions"];
+		const Data &ids = *model["id"];
+		PL_CHECK(positions.components == 3);
+		PL_CHECK(positions.count() == 37000);
+		PL_CHECK(ids.type() == typeid(int64_t));
+		PL_CHECK(chunked == (dynamic_cast<const ChunkedData*>(&ids) != nullptr));
+		std::vector<int64_t> values(ids.size());
+		PL_CHECK(ids.can_get_values());
+		ids.get_values(0, ids.size(), values.data());
+		for (size_t i = 0; i < values.size(); ++i) {
+			PL_CHECK(values[i] == static_cast<int64_t>(i));
+			PL_CHECK(positions.get_float(positions.index(i, 0)) == static_cast<float>(i));
+		}
+	}
+}
+
+static void test_attribute_types() {
+	ParticleModelBuilder builder;
+	const size_t a = builder.add_attribute<float>("a");
+	PL_CHECK(builder.add_attribute<float>("a") == a);
+	PL_CHECK(builder.attribute("a") == a);
+	PL_CHECK_THROWS(builder.attribute("b"));
+	ParticleChunk &chunk = builder.chunk(builder.add_chunks());
+	PL_CHECK_THROWS(chunk.array<double>(a));
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"finalize_order", test_finalize_order},
+		{"attribute_types", test_attribute_types}
+	});
+}
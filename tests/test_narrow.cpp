@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <fstream>
+#include "test.h"
+#include "filter.h"
+#include "import_xyz.h"
+#include "narrow.h"
+#include "stats.h"
+#include "view.h"
+
+using namespace pl;
+
+// IDs too large to be represented exactly as floats, with few distinct values
+static std::shared_ptr<DataT<int64_t>> make_ids(const size_t n) {
+	auto ids = std::make_shared<DataT<int64_t>>();
+	for (size_t i = 0; i < n; ++i) {
+		ids->data.push_back((int64_t(1) << 40) + 12345 + int64_t(i % 300) * 1000003);
+	}
+	return ids;
+}
+
+static void test_narrow_range() {
+	auto values = std::make_shared<DataT<int32_t>>();
+	for (int32_t i = 0; i < 1000; ++i) {
+		values->data.push_back(i % 200);
+	}
+	auto narrowed = narrow_integers(values);
+	PL_CHECK(narrowed->holds<uint8_t>());
+	PL_CHECK(narrowed->size() == values->size());
+	for (size_t i = 0; i < values->size(); ++i) {
+		PL_CHECK(static_cast<const Data&>(*narrowed).view<uint8_t>()[i] == values->data[i]);
+	}
+
+	auto negative = std::make_shared<DataT<int16_t>>();
+	negative->data = {-1, 5, -1};
+	auto dict = narrow_integers(negative);
+	PL_CHECK(dynamic_cast<DictionaryData*>(dict.get()));
+	PL_CHECK(dict->type() == typeid(int16_t));
+}
+
+// Dictionaries decode in the type of their values, not as floats
+static void test_dictionary_values() {
+	auto ids = make_ids(10000);
+	auto narrowed = narrow_integers(ids);
+	auto *dict = dynamic_cast<DictionaryData*>(narrowed.get());
+	PL_CHECK(dict);
+	PL_CHECK(dict->codes->holds<uint16_t>());
+	PL_CHECK(narrowed->type() == typeid(int64_t));
+	PL_CHECK(narrowed->bytes() < ids->bytes());
+
+	bool visited_int64 = false;
+	visit(*narrowed, [&](const auto &view) {
+		using T = typename std::remove_const<typename std::decay<decltype(view)>::type::value_type>::type;
+		visited_int64 = std::is_same<T, int64_t>::value;
+		for (size_t i = 0; i < view.size(); ++i) {
+			PL_CHECK(static_cast<int64_t>(view[i]) == ids->data[i]);
+		}
+	});
+	PL_CHECK(visited_int64);
+
+	auto copy = materialize(*narrowed);
+	PL_CHECK(copy->holds<int64_t>());
+	PL_CHECK(static_cast<const Data&>(*copy).view<int64_t>()[9999] == ids->data[9999]);
+
+	auto indices = std::make_shared<std::vector<size_t>>(std::vector<size_t>{7, 301, 9999});
+	auto rows = materialize(RowView(narrowed, indices));
+	PL_CHECK(rows->holds<int64_t>());
+	for (size_t i = 0; i < indices->size(); ++i) {
+		PL_CHECK(static_cast<const Data&>(*rows).view<int64_t>()[i] == ids->data[(*indices)[i]]);
+	}
+	auto range = materialize(RowView(narrowed, 100, 50));
+	PL_CHECK(range->holds<int64_t>());
+	PL_CHECK(static_cast<const Data&>(*range).view<int64_t>()[0] == ids->data[100]);
+
+	auto s = stats(*narrowed);
+	PL_CHECK(s->components[0].min == static_cast<double>(ids->data[0]));
+}
+
+static void test_compact_dictionary() {
+	ParticleModel model;
+	model["ids"] = narrow_integers(make_ids(1000));
+	std::vector<uint8_t> mask(1000, 0);
+	mask[3] = mask[500] = mask[999] = 1;
+	ParticleModel kept = compact(model, mask);
+	const Data &ids = *kept["ids"];
+	PL_CHECK(ids.holds<int64_t>());
+	PL_CHECK(ids.size() == 3);
+	auto expected = make_ids(1000);
+	PL_CHECK(ids.view<int64_t>()[0] == expected->data[3]);
+	PL_CHECK(ids.view<int64_t>()[1] == expected->data[500]);
+	PL_CHECK(ids.view<int64_t>()[2] == expected->data[999]);
+}
+
+// Narrowing is opt-in, importers keep the types they read
+static void test_import_keeps_types() {
+	{
+		std::ofstream xyz("test_narrow.xyz");
+		xyz << "3\natoms\nC 0 0 0\nH 1 0 0\nC 0 1 0\n";
+	}
+	ParticleModel model;
+	import_xyz("test_narrow.xyz", model);
+	PL_CHECK(model["atom_type"]->holds<int>());
+	PL_CHECK(model["atom_type"]->size() == 3);
+	std::remove("test_narrow.xyz");
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"narrow_range", test_narrow_range},
+		{"dictionary_values", test_dictionary_values},
+		{"compact_dictionary", test_compact_dictionary},
+		{"import_keeps_types", test_import_keeps_types}
+	});
+}
@@ -0,0 +1,188 @@
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "test.h"
+#include "json.hpp"
+#include "layout.h"
+#include "octree.h"
+#include "pkd_builder.h"
+
+using namespace pl;
+using json = nlohmann::json;
+
+const size_t NUM_FILES = 2;
+const size_t PER_FILE = 30000;
+
+// A particle's position, velocity and id, as written to the node files
+using Record = std::array<float, 6>;
+
+// Write the inputs as PKD files, returning the record of each particle by id
+static std::map<int, Record> write_inputs(std::vector<FileName> &inputs) {
+	std::mt19937 rng(7);
+	std::normal_distribution<float> g(0.f, 1.f);
+	std::uniform_real_distribution<float> u(-10.f, 30.f);
+	std::map<int, Record> records;
+	for (size_t f = 0; f < NUM_FILES; ++f) {
+		auto positions = std::make_shared<DataT<float>>();
+		positions->components = 3;
+		auto ids = std::make_shared<DataT<float>>();
+		auto vel = std::make_shared<DataT<double>>();
+		vel->components = 2;
+		for (size_t i = 0; i < PER_FILE; ++i) {
+			vec3f p(u(rng), u(rng), u(rng));
+			if (i % 3 != 0) {
+				p = vec3f(g(rng) * 0.3f + 2.f, g(rng) * 0.2f - 1.f, g(rng) * 0.5f + 5.f);
+			}
+			// Duplicates which can't be split apart
+			if (i % 1000 == 0) {
+				p = vec3f(1.f);
+			}
+			const int id = static_cast<int>(f * PER_FILE + i);
+			positions->data.push_back(p.x);
+			positions->data.push_back(p.y);
+			positions->data.push_back(p.z);
+			ids->data.push_back(static_cast<float>(id));
+			vel->data.push_back(id * 2.0);
+			vel->data.push_back(-id);
+			records[id] = {p.x, p.y, p.z, id * 2.f, static_cast<float>(-id), static_cast<float>(id)};
+		}
+		ParticleModel model;
+		model["positions"] = positions;
+		model["id"] = ids;
+		model["vel"] = to_layout(vel, Layout::SOA);
+		auto radius = std::make_shared<DataT<float>>();
+		radius->data.push_back(0.25f);
+		model["radius"] = radius;
+		inputs.push_back(FileName("test_octree_in" + std::to_string(f) + ".pkd"));
+		export_pkd(inputs.back(), model);
+	}
+	return records;
+}
+
+// Leaves hold every particle exactly once, inner nodes hold samples of the leaves
+// below them, each node's particles are inside its bounds and the temporary
+// chunk files are removed
+static void test_build() {
+	std::vector<FileName> inputs;
+	const std::map<int, Record> expected = write_inputs(inputs);
+	OctreeOptions options;
+	options.node_capacity = 2000;
+	options.memory_budget = 1 << 20;
+	options.count_grid = 16;
+	const std::vector<OctreeNode> nodes = build_octree(inputs, FileName("test_octree.json"), options);
+	for (const FileName &f : inputs) {
+		std::remove(f.c_str());
+		std::remove((f.file_name + "bin").c_str());
+	}
+
+	json index;
+	{
+		std::ifstream in("test_octree.json");
+		in >> index;
+	}
+	std::remove("test_octree.json");
+	PL_CHECK(index["particles"].get<size_t>() == NUM_FILES * PER_FILE);
+	PL_CHECK(index["radius"].get<float>() == 0.25f);
+	PL_CHECK(index["attributes"].size() == 4);
+	PL_CHECK(index["nodes"].size() == nodes.size());
+
+	std::map<std::string, std::vector<Record>> contents;
+	std::set<int> in_leaves;
+	for (const auto &node : index["nodes"]) {
+		const size_t count = node["count"].get<size_t>();
+		const std::string file = node["file"].get<std::string>();
+		std::vector<float> values(count * 6);
+		{
+			std::ifstream in(file, std::ios::binary | std::ios::ate);
+			PL_CHECK(static_cast<size_t>(in.tellg()) == values.size() * sizeof(float));
+			in.seekg(0);
+			in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+		}
+		std::remove(file.c_str());
+		std::vector<Record> &records = contents[node["name"].get<std::string>()];
+		for (size_t i = 0; i < count; ++i) {
+			// Positions as vec3f, then the id and velocity components a component at a time
+			const Record r = {values[i * 3], values[i * 3 + 1], values[i * 3 + 2],
+				values[count * 4 + i], values[count * 5 + i], values[count * 3 + i]};
+			PL_CHECK(expected.at(static_cast<int>(r[5])) == r);
+			for (size_t c = 0; c < 3; ++c) {
+				PL_CHECK(r[c] >= node["lower"][c].get<float>() - 1e-4f);
+				PL_CHECK(r[c] <= node["upper"][c].get<float>() + 1e-4f);
+			}
+			if (node["leaf"].get<bool>()) {
+				PL_CHECK(in_leaves.insert(static_cast<int>(r[5])).second);
+			}
+			records.push_back(r);
+		}
+		PL_CHECK(count <= options.node_capacity);
+	}
+	PL_CHECK(in_leaves.size() == NUM_FILES * PER_FILE);
+
+	for (const auto &node : index["nodes"]) {
+		if (node["leaf"].get<bool>()) {
+			continue;
+		}
+		const std::string name = node["name"].get<std::string>();
+		std::set<int> below;
+		for (const auto &other : index["nodes"]) {
+			const std::string other_name = other["name"].get<std::string>();
+			if (other["leaf"].get<bool>() && other_name.compare(0, name.size(), name) == 0) {
+				for (const Record &r : contents[other_name]) {
+					below.insert(static_cast<int>(r[5]));
+				}
+			}
+		}
+		PL_CHECK(!contents[name].empty());
+		for (const Record &r : contents[name]) {
+			PL_CHECK(below.count(static_cast<int>(r[5])) == 1);
+		}
+	}
+
+	for (size_t k = 0; k < options.count_grid; ++k) {
+		std::ifstream chunk("test_octree_chunk" + std::to_string(k) + ".tmp");
+		PL_CHECK(!chunk);
+	}
+}
+
+// A directory in place of a chunk file makes the build fail while distributing the
+// particles, the chunk files already written are removed
+static void test_failed_build() {
+	std::vector<FileName> inputs;
+	write_inputs(inputs);
+	OctreeOptions options;
+	options.node_capacity = 2000;
+	options.memory_budget = 1 << 20;
+	options.count_grid = 16;
+#ifdef _WIN32
+	_mkdir("test_octree_fail_chunk1.tmp");
+#else
+	mkdir("test_octree_fail_chunk1.tmp", 0755);
+#endif
+	PL_CHECK_THROWS(build_octree(inputs, FileName("test_octree_fail.json"), options));
+#ifdef _WIN32
+	_rmdir("test_octree_fail_chunk1.tmp");
+#else
+	std::remove("test_octree_fail_chunk1.tmp");
+#endif
+	for (const FileName &f : inputs) {
+		std::remove(f.c_str());
+		std::remove((f.file_name + "bin").c_str());
+	}
+	std::ifstream chunk("test_octree_fail_chunk0.tmp");
+	PL_CHECK(!chunk);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"build", test_build},
+		{"failed_build", test_failed_build}
+	});
+}
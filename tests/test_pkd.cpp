@@ -0,0 +1,198 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include "test.h"
+#include "import_pkd.h"
+#include "pkd_builder.h"
+#include "quantize.h"
+#include "stats.h"
+#include "transform.h"
+
+using namespace pl;
+
+// Write a PKD file holding the geometry, and its .pkdbin file
+static void write_pkd(const std::string &geometry, const std::vector<char> &bin) {
+	{
+		std::ofstream xml("test_pkd.pkd");
+		xml << "<?xml version=\"1.0\"?>\n<OSPRay>\n<PKDGeometry>\n" << geometry
+			<< "</PKDGeometry>\n</OSPRay>\n";
+	}
+	std::ofstream out("test_pkd.pkdbin", std::ios::binary);
+	out.write(bin.data(), bin.size());
+}
+
+static void remove_pkd() {
+	std::remove("test_pkd.pkd");
+	std::remove("test_pkd.pkdbin");
+}
+
+// Each node of the tree splits its subtree along some axis, with the left subtree
+// below the node and the right subtree above it
+static void test_pkd_order() {
+	std::mt19937 rng(17);
+	std::normal_distribution<float> g(0.f, 1.f);
+	for (const size_t n : {0, 1, 2, 7, 1000, 40001}) {
+		auto positions = std::make_shared<DataT<float>>();
+		positions->components = 3;
+		for (size_t i = 0; i < n; ++i) {
+			// Duplicates of a few values along z
+			positions->data.push_back(g(rng) * 10.f);
+			positions->data.push_back(g(rng));
+			positions->data.push_back(static_cast<float>(i % 4));
+		}
+		const std::vector<size_t> order = pkd_order(*positions);
+		PL_CHECK(order.size() == n);
+		std::vector<size_t> seen(n, 0);
+		std::vector<box3f> subtree(n);
+		for (size_t k = n; k-- > 0;) {
+			++seen[order[k]];
+			const float *p = positions->data.data() + order[k] * 3;
+			subtree[k].extend(vec3f(p[0], p[1], p[2]));
+			for (const size_t child : {2 * k + 1, 2 * k + 2}) {
+				if (child < n) {
+					subtree[k].extend(subtree[child]);
+				}
+			}
+			bool split = false;
+			for (size_t a = 0; a < 3 && !split; ++a) {
+				split = (2 * k + 1 >= n || subtree[2 * k + 1].upper[a] <= p[a])
+					&& (2 * k + 2 >= n || subtree[2 * k + 2].lower[a] >= p[a]);
+			}
+			PL_CHECK(split);
+		}
+		for (const size_t s : seen) {
+			PL_CHECK(s == 1);
+		}
+
+		// A loose range seeded on the positions doesn't change the splits
+		Stats seed;
+		seed.components.resize(3);
+		seed.components[0].max = 1e6;
+		seed.components[1].min = -1e6;
+		seed_stats(*positions, seed);
+		PL_CHECK(pkd_order(*positions) == order);
+	}
+}
+
+// Exported particles are reordered, the ids tell us which particle each one was
+static void test_export_round_trip() {
+	const size_t n = 5003;
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> u(-1.f, 1.f);
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	auto ids = std::make_shared<DataT<float>>();
+	auto color = std::make_shared<DataT<float>>();
+	color->components = 2;
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t c = 0; c < 3; ++c) {
+			positions->data.push_back(u(rng));
+		}
+		ids->data.push_back(static_cast<float>(i));
+		color->data.push_back(static_cast<float>(i) * 2.f);
+		color->data.push_back(-static_cast<float>(i));
+	}
+	ParticleModel model;
+	model["positions"] = positions;
+	model["id"] = ids;
+	model["color"] = color;
+	auto radius = std::make_shared<DataT<float>>();
+	radius->data.push_back(0.01f);
+	model["radius"] = radius;
+	export_pkd(FileName("test_pkd.pkd"), model);
+
+	ParticleModel imported;
+	import_pkd(FileName("test_pkd.pkd"), imported);
+	remove_pkd();
+	PL_CHECK(imported["radius"]->get_float(0) == 0.01f);
+	const Data &p = *imported["positions"];
+	const Data &id = *imported["id"];
+	PL_CHECK(p.count() == n && id.count() == n);
+	std::vector<size_t> seen(n, 0);
+	for (size_t i = 0; i < n; ++i) {
+		const size_t k = static_cast<size_t>(id.get_float(i));
+		++seen[k];
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(p.get_float(i * 3 + c) == positions->data[k * 3 + c]);
+		}
+		PL_CHECK(imported["color.0"]->get_float(i) == color->data[k * 2]);
+		PL_CHECK(imported["color.1"]->get_float(i) == color->data[k * 2 + 1]);
+	}
+	for (const size_t s : seen) {
+		PL_CHECK(s == 1);
+	}
+}
+
+// 8 and 16 bit quantized positions decode to the same values whether or not
+// they're kept quantized
+template<typename T>
+static void check_quantized(const std::string &format) {
+	const size_t n = 1000;
+	const vec3f lower(-2.f, 0.f, 10.f), upper(2.f, 1.f, 12.f);
+	std::vector<T> q;
+	for (size_t i = 0; i < n * 3; ++i) {
+		q.push_back(static_cast<T>(i * 7919 % (size_t(std::numeric_limits<T>::max()) + 1)));
+	}
+	// An unrelated float attribute first, so the positions don't start the file
+	std::vector<char> bin(n * sizeof(float), 0);
+	const char *bytes = reinterpret_cast<const char*>(q.data());
+	bin.insert(bin.end(), bytes, bytes + q.size() * sizeof(T));
+	write_pkd("<attribute name=\"mass\" ofs=\"0\" count=\"1000\" format=\"float\"/>\n"
+			"<position ofs=\"" + std::to_string(n * sizeof(float)) + "\" count=\"1000\" format=\""
+			+ format + "\" lower=\"-2 0 10\" upper=\"2 1 12\"/>\n", bin);
+
+	for (const bool keep : {false, true}) {
+		ParticleModel model;
+		import_pkd(FileName("test_pkd.pkd"), model, keep);
+		const Data &p = *model["positions"];
+		PL_CHECK(p.type() == typeid(float));
+		PL_CHECK(p.count() == n);
+		PL_CHECK(model["mass"]->count() == n);
+		auto *quantized = dynamic_cast<const QuantizedPositions*>(&p);
+		PL_CHECK(keep == (quantized != nullptr));
+		if (quantized && sizeof(T) == 2) {
+			// The values alias the mapped file instead of being copied
+			PL_CHECK(quantized->data.empty());
+		}
+		std::vector<float> decoded(p.size());
+		p.get_floats(0, decoded.size(), decoded.data());
+		for (size_t i = 0; i < n * 3; ++i) {
+			const size_t c = i % 3;
+			const float expected = lower[c] + q[i] * (upper[c] - lower[c])
+				/ std::numeric_limits<T>::max();
+			PL_CHECK(std::abs(decoded[i] - expected) <= 1e-5f * 12.f);
+			PL_CHECK(p.get_float(i) == decoded[i]);
+		}
+	}
+	remove_pkd();
+}
+
+static void test_quantized_positions() {
+	check_quantized<uint8_t>("vec3uc");
+	check_quantized<uint16_t>("vec3us");
+}
+
+static void test_malformed() {
+	const std::vector<char> bin(64, 0);
+	write_pkd("<position ofs=\"0\" count=\"4\"/>\n", bin);
+	ParticleModel model;
+	PL_CHECK_THROWS(import_pkd(FileName("test_pkd.pkd"), model));
+	write_pkd("<attribute ofs=\"0\" count=\"4\" format=\"float\"/>\n", bin);
+	PL_CHECK_THROWS(import_pkd(FileName("test_pkd.pkd"), model));
+	write_pkd("<position ofs=\"0\" count=\"4\" format=\"vec3us\" lower=\"0 0 0\"/>\n", bin);
+	PL_CHECK_THROWS(import_pkd(FileName("test_pkd.pkd"), model, true));
+	write_pkd("<position ofs=\"0\" count=\"100\" format=\"vec3f\"/>\n", bin);
+	PL_CHECK_THROWS(import_pkd(FileName("test_pkd.pkd"), model));
+	remove_pkd();
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"pkd_order", test_pkd_order},
+		{"export_round_trip", test_export_round_trip},
+		{"quantized_positions", test_quantized_positions},
+		{"malformed", test_malformed}
+	});
+}
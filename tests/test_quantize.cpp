@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include "test.h"
+#include "kernels.h"
+#include "layout.h"
+#include "quantize.h"
+
+using namespace pl;
+
+const SimdLevel LEVELS[] = {SimdLevel::SCALAR, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512};
+
+static uint32_t float_bits(const float f) {
+	uint32_t u;
+	std::memcpy(&u, &f, sizeof(float));
+	return u;
+}
+
+// The bulk conversions match the scalar ones at every SIMD level
+static void test_half_kernels() {
+	std::vector<uint16_t> halves(65536);
+	for (size_t i = 0; i < halves.size(); ++i) {
+		halves[i] = static_cast<uint16_t>(i);
+	}
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<uint32_t> bits;
+	std::vector<float> floats = {0.f, -0.f, 1.f, 65504.f, 65519.f, 65520.f, 1e-8f, -6e-8f,
+		std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+		std::numeric_limits<float>::quiet_NaN()};
+	// Arbitrary bit patterns, and values around the range of halves
+	for (size_t i = 0; i < 100003; ++i) {
+		const uint32_t u = bits(rng);
+		float f;
+		std::memcpy(&f, &u, sizeof(float));
+		if (i % 2) {
+			f = std::ldexp(static_cast<float>(u % 4096) - 2048.f, static_cast<int>(u % 50) - 35);
+		}
+		floats.push_back(f);
+	}
+
+	const SimdLevel original = simd_level();
+	for (const SimdLevel level : LEVELS) {
+		set_simd_level(level);
+		std::vector<float> decoded(halves.size());
+		decode_half(halves.data(), decoded.data(), halves.size());
+		for (size_t i = 0; i < halves.size(); ++i) {
+			const float expected = half_to_float(halves[i]);
+			PL_CHECK(std::isnan(expected) ? std::isnan(decoded[i])
+					: float_bits(expected) == float_bits(decoded[i]));
+		}
+		std::vector<uint16_t> encoded(floats.size());
+		encode_half(floats.data(), encoded.data(), floats.size());
+		for (size_t i = 0; i < floats.size(); ++i) {
+			const uint16_t expected = float_to_half(floats[i]);
+			if (std::isnan(floats[i])) {
+				PL_CHECK(std::isnan(half_to_float(encoded[i])));
+			} else {
+				PL_CHECK(encoded[i] == expected);
+			}
+		}
+	}
+	set_simd_level(original);
+}
+
+// Every half decodes to a float which encodes back to the same half
+static void test_half_round_trip() {
+	for (uint32_t h = 0; h < 65536; ++h) {
+		const float f = half_to_float(static_cast<uint16_t>(h));
+		if (!std::isnan(f)) {
+			PL_CHECK(float_to_half(f) == h);
+		}
+	}
+	DataT<float> values;
+	for (size_t i = 0; i < 1000; ++i) {
+		values.data.push_back(static_cast<float>(i) * 0.37f - 100.f);
+	}
+	auto half = to_half(values);
+	PL_CHECK(half->type() == typeid(float));
+	PL_CHECK(half->bytes() < values.bytes());
+	std::vector<float> decoded(values.size());
+	half->get_floats(0, decoded.size(), decoded.data());
+	for (size_t i = 0; i < decoded.size(); ++i) {
+		// Halves have 11 bits of precision
+		PL_CHECK(std::abs(decoded[i] - values.data[i]) <= std::abs(values.data[i]) / 2048.f);
+	}
+}
+
+static void test_quantize_positions() {
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> u(-10.f, 30.f);
+	for (size_t i = 0; i < 30000; ++i) {
+		positions->data.push_back(u(rng));
+	}
+	positions->data[4] = std::numeric_limits<float>::quiet_NaN();
+	positions->data[9] = 1000.f;
+
+	const vec3f lower(-10.f), upper(30.f);
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		auto in = to_layout(positions, layout);
+		auto quantized = quantize_positions(*in, lower, upper);
+		PL_CHECK(quantized->layout == layout);
+		PL_CHECK(quantized->count() == positions->count());
+		const vec3f error = quantized->max_error();
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(error[c] <= 40.f / 65535.f);
+		}
+		for (size_t i = 0; i < positions->count(); ++i) {
+			for (size_t c = 0; c < 3; ++c) {
+				const float x = positions->data[i * 3 + c];
+				const float q = quantized->get_float(quantized->index(i, c));
+				if (std::isnan(x)) {
+					PL_CHECK(q == lower[c]);
+				} else {
+					PL_CHECK(std::abs(q - clamp(x, lower[c], upper[c])) <= error[c] * 1.001f);
+				}
+			}
+		}
+	}
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"half_kernels", test_half_kernels},
+		{"half_round_trip", test_half_round_trip},
+		{"quantize_positions", test_quantize_positions}
+	});
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include "test.h"
+#include "layout.h"
+#include "reorder.h"
+#include "stats.h"
+
+using namespace pl;
+
+// The sort orders the keys, and keeps equal keys in their original order
+static void test_sort_stability() {
+	std::mt19937_64 rng(8);
+	for (const size_t n : {0, 1, 2, 1000, 300001}) {
+		std::vector<uint64_t> keys(n);
+		for (size_t i = 0; i < n; ++i) {
+			// Few distinct keys, with digits set in low and high bytes
+			keys[i] = (rng() % 16) << (8 * (rng() % 8)) | (i % 3) << 60;
+		}
+		const std::vector<size_t> order = sort_permutation(keys);
+		PL_CHECK(order.size() == n);
+		std::vector<size_t> seen(n, 0);
+		for (size_t i = 0; i < n; ++i) {
+			++seen[order[i]];
+			if (i > 0) {
+				const uint64_t a = keys[order[i - 1]], b = keys[order[i]];
+				PL_CHECK(a < b || (a == b && order[i - 1] < order[i]));
+			}
+		}
+		for (const size_t s : seen) {
+			PL_CHECK(s == 1);
+		}
+	}
+}
+
+// The particles of an 8^3 grid, one per cell of the top three levels of the curve
+static std::shared_ptr<DataT<float>> make_grid() {
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	std::mt19937 rng(10);
+	std::vector<size_t> cells(512);
+	for (size_t i = 0; i < cells.size(); ++i) {
+		cells[i] = i;
+	}
+	std::shuffle(cells.begin(), cells.end(), rng);
+	for (const size_t i : cells) {
+		positions->data.push_back(static_cast<float>(i % 8));
+		positions->data.push_back(static_cast<float>(i / 8 % 8));
+		positions->data.push_back(static_cast<float>(i / 64));
+	}
+	return positions;
+}
+
+// Morton keys increase along each axis
+static void test_morton_keys() {
+	auto positions = make_grid();
+	const std::vector<uint64_t> keys = spatial_keys(*positions, SpaceFillingCurve::MORTON);
+	std::vector<uint64_t> by_cell(512);
+	for (size_t i = 0; i < keys.size(); ++i) {
+		const size_t x = static_cast<size_t>(positions->data[i * 3]);
+		const size_t y = static_cast<size_t>(positions->data[i * 3 + 1]);
+		const size_t z = static_cast<size_t>(positions->data[i * 3 + 2]);
+		by_cell[x + 8 * y + 64 * z] = keys[i];
+	}
+	for (size_t i = 0; i < 512; ++i) {
+		PL_CHECK(i % 8 == 7 || by_cell[i] < by_cell[i + 1]);
+		PL_CHECK(i / 8 % 8 == 7 || by_cell[i] < by_cell[i + 8]);
+		PL_CHECK(i / 64 == 7 || by_cell[i] < by_cell[i + 64]);
+	}
+}
+
+// Consecutive cells along the Hilbert curve are neighbors, in any layout
+static void test_hilbert_order() {
+	auto positions = make_grid();
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		auto p = to_layout(positions, layout);
+		const std::vector<size_t> order = spatial_order(*p, SpaceFillingCurve::HILBERT);
+		PL_CHECK(order.size() == 512);
+		for (size_t i = 1; i < order.size(); ++i) {
+			int distance = 0;
+			for (size_t c = 0; c < 3; ++c) {
+				distance += std::abs(static_cast<int>(positions->data[order[i] * 3 + c])
+						- static_cast<int>(positions->data[order[i - 1] * 3 + c]));
+			}
+			PL_CHECK(distance == 1);
+		}
+	}
+}
+
+// Every per-particle attribute is permuted the same way, others are left as-is
+static void test_reorder_model() {
+	auto positions = make_grid();
+	auto ids = std::make_shared<DataT<int32_t>>();
+	for (int32_t i = 0; i < 512; ++i) {
+		ids->data.push_back(i);
+	}
+	auto radius = std::make_shared<DataT<float>>();
+	radius->data.push_back(0.5f);
+	ParticleModel model;
+	model["positions"] = to_layout(positions, Layout::SOA);
+	model["id"] = ids;
+	model["radius"] = radius;
+	const double max_x = stats(*model["positions"])->components[0].max;
+	reorder_spatially(model, SpaceFillingCurve::HILBERT);
+
+	PL_CHECK(model["radius"] == radius);
+	const Data &p = *model["positions"];
+	const Data &id = *model["id"];
+	PL_CHECK(p.layout == Layout::SOA);
+	PL_CHECK(id.type() == typeid(int32_t));
+	PL_CHECK(stats(p)->components[0].max == max_x);
+	const std::vector<size_t> order = spatial_order(*positions, SpaceFillingCurve::HILBERT);
+	for (size_t i = 0; i < 512; ++i) {
+		const size_t k = static_cast<size_t>(id.get_float(i));
+		PL_CHECK(k == order[i]);
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(p.get_float(p.index(i, c)) == positions->data[k * 3 + c]);
+		}
+	}
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"sort_stability", test_sort_stability},
+		{"morton_keys", test_morton_keys},
+		{"hilbert_order", test_hilbert_order},
+		{"reorder_model", test_reorder_model}
+	});
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include "test.h"
+#include "layout.h"
+#include "stats.h"
+#include "transform.h"
+
+using namespace pl;
+
+static bool nearly_equal(const double a, const double b) {
+	return std::abs(a - b) <= 1e-9 * (1.0 + std::abs(b));
+}
+
+// The parallel reduction matches a serial two pass computation, in either layout
+static void test_moments() {
+	std::mt19937 rng(14);
+	std::normal_distribution<double> g(1e4, 3.0);
+	auto values = std::make_shared<DataT<double>>();
+	values->components = 3;
+	const size_t n = 300007;
+	for (size_t i = 0; i < n * 3; ++i) {
+		values->data.push_back(g(rng) * (i % 3 + 1));
+	}
+	std::vector<ComponentStats> expected(3);
+	for (size_t c = 0; c < 3; ++c) {
+		double sum = 0.0;
+		expected[c].min = values->data[c];
+		expected[c].max = values->data[c];
+		for (size_t i = 0; i < n; ++i) {
+			const double x = values->data[i * 3 + c];
+			expected[c].min = std::min(expected[c].min, x);
+			expected[c].max = std::max(expected[c].max, x);
+			sum += x;
+		}
+		expected[c].mean = sum / n;
+		double m2 = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			const double d = values->data[i * 3 + c] - expected[c].mean;
+			m2 += d * d;
+		}
+		expected[c].variance = m2 / n;
+	}
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		auto data = to_layout(values, layout);
+		auto s = stats(*data);
+		PL_CHECK(s->has_moments);
+		PL_CHECK(s->size == data->size());
+		PL_CHECK(s->components.size() == 3);
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(s->components[c].min == expected[c].min);
+			PL_CHECK(s->components[c].max == expected[c].max);
+			PL_CHECK(nearly_equal(s->components[c].mean, expected[c].mean));
+			PL_CHECK(std::abs(s->components[c].variance - expected[c].variance)
+					<= 1e-6 * expected[c].variance);
+		}
+	}
+}
+
+// The stats are cached until they're invalidated or the size changes
+static void test_cache() {
+	DataT<int32_t> data;
+	for (int32_t i = 0; i < 1000; ++i) {
+		data.data.push_back(i);
+	}
+	auto s = stats(data);
+	PL_CHECK(stats(data) == s);
+	PL_CHECK(range(data) == s);
+	PL_CHECK(s->components[0].max == 999.0);
+	PL_CHECK(nearly_equal(s->components[0].mean, 499.5));
+
+	data.data[0] = -5;
+	data.invalidate_stats();
+	PL_CHECK(stats(data)->components[0].min == -5.0);
+	data.data.push_back(5000);
+	PL_CHECK(stats(data)->components[0].max == 5000.0);
+}
+
+// Seeded ranges are returned by range, stats computes the moments
+static void test_seed() {
+	DataT<float> data;
+	for (size_t i = 0; i < 100; ++i) {
+		data.data.push_back(static_cast<float>(i));
+	}
+	Stats seed;
+	seed.components.resize(1);
+	seed.components[0].min = -1.0;
+	seed.components[0].max = 200.0;
+	seed_stats(data, seed);
+	PL_CHECK(range(data)->components[0].max == 200.0);
+	PL_CHECK(!range(data)->has_moments);
+	auto s = stats(data);
+	PL_CHECK(s->has_moments);
+	PL_CHECK(s->components[0].max == 99.0);
+	PL_CHECK(range(data) == s);
+}
+
+// NaNs are left out of the stats, even when they start a block
+static void test_nan() {
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	DataT<float> data;
+	data.data = {nan, -5.f, 100.f, 3.f};
+	auto s = stats(data);
+	PL_CHECK(s->components[0].min == -5.0);
+	PL_CHECK(s->components[0].max == 100.0);
+	PL_CHECK(nearly_equal(s->components[0].mean, 98.0 / 3.0));
+	const double mean = 98.0 / 3.0;
+	const double variance = ((-5.0 - mean) * (-5.0 - mean) + (100.0 - mean) * (100.0 - mean)
+		+ (3.0 - mean) * (3.0 - mean)) / 3.0;
+	PL_CHECK(nearly_equal(s->components[0].variance, variance));
+
+	DataT<float> only_nans;
+	only_nans.data = {nan, nan};
+	s = stats(only_nans);
+	PL_CHECK(s->components[0].min == 0.0 && s->components[0].max == 0.0);
+
+	auto positions = std::make_shared<DataT<double>>();
+	positions->components = 3;
+	positions->data = {std::numeric_limits<double>::quiet_NaN(), 1.0, 2.0,
+		4.0, -1.0, 0.0, -3.0, 5.0, 2.5};
+	const box3f b = bounds(*positions);
+	PL_CHECK(b.lower.x == -3.f && b.upper.x == 4.f);
+	PL_CHECK(b.lower.y == -1.f && b.upper.y == 5.f);
+	PL_CHECK(b.lower.z == 0.f && b.upper.z == 2.5f);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"moments", test_moments},
+		{"cache", test_cache},
+		{"seed", test_seed},
+		{"nan", test_nan}
+	});
+}
@@ -0,0 +1,158 @@
+#include <cmath>
+#include <limits>
+#include <random>
+#include "test.h"
+#include "kernels.h"
+#include "layout.h"
+#include "stats.h"
+#include "transform.h"
+#include "view.h"
+
+using namespace pl;
+
+const SimdLevel LEVELS[] = {SimdLevel::SCALAR, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512};
+
+static std::shared_ptr<DataT<float>> make_positions(const size_t n) {
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> u(-50.f, 50.f);
+	for (size_t i = 0; i < n * 3; ++i) {
+		positions->data.push_back(u(rng) * (i % 3 + 1));
+	}
+	return positions;
+}
+
+static box3f brute_force_bounds(const Data &positions) {
+	box3f b;
+	for (size_t i = 0; i < positions.count(); ++i) {
+		vec3f p;
+		bool nan = false;
+		for (size_t c = 0; c < 3; ++c) {
+			p[c] = positions.get_float(positions.index(i, c));
+			nan = nan || std::isnan(p[c]);
+		}
+		if (!nan) {
+			b.extend(p);
+		}
+	}
+	return b;
+}
+
+static bool same_box(const box3f &a, const box3f &b) {
+	for (size_t c = 0; c < 3; ++c) {
+		if (a.lower[c] != b.lower[c] || a.upper[c] != b.upper[c]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_bounds() {
+	auto positions = make_positions(100003);
+	positions->data[300] = std::numeric_limits<float>::quiet_NaN();
+	const box3f expected = brute_force_bounds(*positions);
+	const SimdLevel original = simd_level();
+	for (const SimdLevel level : LEVELS) {
+		set_simd_level(level);
+		for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+			auto p = to_layout(positions, layout);
+			PL_CHECK(same_box(bounds(*p), expected));
+		}
+	}
+	set_simd_level(original);
+
+	// A loose seeded range, e.g. from a file header, doesn't replace the tight bounds
+	// for either the contiguous or the generic path
+	auto doubles = std::make_shared<DataT<double>>();
+	doubles->components = 3;
+	doubles->data.assign(positions->data.begin(), positions->data.end());
+	for (const std::shared_ptr<Data> &p : std::vector<std::shared_ptr<Data>>{positions, doubles}) {
+		Stats seed;
+		seed.components.resize(3);
+		for (size_t c = 0; c < 3; ++c) {
+			seed.components[c].min = -1000.0;
+			seed.components[c].max = 1000.0;
+		}
+		seed_stats(*p, seed);
+		PL_CHECK(same_box(bounds(*p), expected));
+	}
+}
+
+// The kernels compute the same products and sums as Affine3f::apply, so the results match
+// closely, although the compiler may contract the scalar path into fused multiply-adds
+static void test_transform_kernels() {
+	auto positions = make_positions(10007);
+	Affine3f rotate;
+	rotate.m[0][0] = 0.f;
+	rotate.m[0][1] = -1.f;
+	rotate.m[1][0] = 1.f;
+	rotate.m[1][1] = 0.f;
+	rotate.m[2][3] = 4.f;
+	const Affine3f transforms[] = {
+		Affine3f::translate(vec3f(1.f, -2.f, 3.5f)),
+		Affine3f::scale(vec3f(2.f, 0.5f, -1.f)) * Affine3f::translate(vec3f(0.25f)),
+		rotate * Affine3f::scale(vec3f(1.5f))
+	};
+	const SimdLevel original = simd_level();
+	for (const SimdLevel level : LEVELS) {
+		set_simd_level(level);
+		for (const Affine3f &xfm : transforms) {
+			for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+				auto p = to_layout(std::make_shared<DataT<float>>(*positions), layout);
+				transform(*p, xfm);
+				for (size_t i = 0; i < positions->count(); ++i) {
+					const vec3f expected = xfm.apply(vec3f(positions->data[i * 3],
+								positions->data[i * 3 + 1], positions->data[i * 3 + 2]));
+					for (size_t c = 0; c < 3; ++c) {
+						const float x = p->get_float(p->index(i, c));
+						PL_CHECK(std::abs(x - expected[c]) <= 1e-5f * (1.f + std::abs(expected[c])));
+					}
+				}
+			}
+		}
+	}
+	set_simd_level(original);
+}
+
+static void test_transformed_view() {
+	auto positions = make_positions(1000);
+	auto indices = std::make_shared<std::vector<size_t>>(std::vector<size_t>{3, 999, 0});
+	auto moved = transformed(RowView(positions, indices), Affine3f::translate(vec3f(10.f)));
+	PL_CHECK(moved->count() == 3);
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t c = 0; c < 3; ++c) {
+			PL_CHECK(moved->get_float(i * 3 + c) == positions->data[(*indices)[i] * 3 + c] + 10.f);
+		}
+	}
+	RowView picked(positions, indices);
+	PL_CHECK_THROWS(transform(picked, Affine3f()));
+}
+
+// Transforming through a view drops the cached stats of the array it views
+static void test_transform_view_stats() {
+	auto positions = make_positions(1000);
+	const box3f before = bounds(*positions);
+	stats(*positions);
+	RowView rows(positions, 10, 100);
+	PL_CHECK(rows.raw_data());
+	translate(rows, vec3f(1000.f));
+	const box3f after = bounds(*positions);
+	PL_CHECK(after.upper.x >= 1000.f + before.lower.x);
+	PL_CHECK(stats(*positions)->components[1].max >= 1000.f);
+	PL_CHECK(same_box(after, brute_force_bounds(*positions)));
+
+	auto all = component_view(positions, 0, 3);
+	stats(*positions);
+	scale(*all, vec3f(0.5f));
+	PL_CHECK(same_box(bounds(*positions), brute_force_bounds(*positions)));
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"bounds", test_bounds},
+		{"transform_kernels", test_transform_kernels},
+		{"transformed_view", test_transformed_view},
+		{"transform_view_stats", test_transform_view_stats}
+	});
+}
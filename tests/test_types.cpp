@@ -0,0 +1,80 @@
+#include <type_traits>
+#include "test.h"
+#include "compress.h"
+#include "narrow.h"
+
+using namespace pl;
+
+// An int array which can only be read through get_float
+struct FloatOnlyData : Data {
+	const std::type_info& type() const override {
+		return typeid(int32_t);
+	}
+	void write(std::ofstream &) const override {}
+	float get_float(const size_t i) const override {
+		return static_cast<float>(i);
+	}
+	size_t size() const override {
+		return 10;
+	}
+};
+
+// Count the elements visit passes and check their type
+template<typename T>
+static void check_visit(const Data &data, const size_t size) {
+	size_t visited = 0;
+	visit(data, [&](const auto &view) {
+		using V = typename std::decay<decltype(view[0])>::type;
+		PL_CHECK((std::is_same<V, T>::value));
+		visited += view.size();
+	});
+	PL_CHECK(visited == size);
+}
+
+// visit dispatches on the stored type, decodes arrays which can decode their values
+// and falls back to floats for the others
+static void test_visit() {
+	auto ids = std::make_shared<DataT<int64_t>>();
+	auto bytes = std::make_shared<DataT<uint8_t>>();
+	for (size_t i = 0; i < 1000; ++i) {
+		ids->data.push_back((int64_t(1) << 40) + static_cast<int64_t>(i % 3));
+		bytes->data.push_back(static_cast<uint8_t>(i));
+	}
+	check_visit<int64_t>(*ids, 1000);
+	check_visit<uint8_t>(*bytes, 1000);
+	check_visit<int64_t>(*narrow_integers(ids), 1000);
+	check_visit<uint8_t>(*compress(*bytes), 1000);
+	check_visit<float>(FloatOnlyData(), 10);
+	PL_CHECK(ids->holds<int64_t>() && !ids->holds<double>());
+	PL_CHECK(!FloatOnlyData().holds<int32_t>());
+}
+
+// Bulk reads match get_float, including through the fallback
+static void test_bulk_getters() {
+	auto ids = std::make_shared<DataT<int64_t>>();
+	auto bytes = std::make_shared<DataT<uint8_t>>();
+	for (size_t i = 0; i < 1000; ++i) {
+		ids->data.push_back((int64_t(1) << 40) + static_cast<int64_t>(i % 3));
+		bytes->data.push_back(static_cast<uint8_t>(i));
+	}
+	std::vector<float> floats(500);
+	std::vector<double> doubles(500);
+	bytes->get_floats(300, 800, floats.data());
+	ids->get_doubles(300, 800, doubles.data());
+	for (size_t i = 0; i < 500; ++i) {
+		PL_CHECK(floats[i] == bytes->get_float(300 + i));
+		PL_CHECK(doubles[i] == static_cast<double>(ids->data[300 + i]));
+	}
+	FloatOnlyData fallback;
+	fallback.get_doubles(2, 7, doubles.data());
+	for (size_t i = 0; i < 5; ++i) {
+		PL_CHECK(doubles[i] == static_cast<double>(2 + i));
+	}
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"visit", test_visit},
+		{"bulk_getters", test_bulk_getters}
+	});
+}
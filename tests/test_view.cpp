@@ -0,0 +1,179 @@
+#include <cmath>
+#include <cstdio>
+#include "test.h"
+#include "compress.h"
+#include "narrow.h"
+#include "quantize.h"
+#include "stats.h"
+#include "view.h"
+#include "layout.h"
+
+using namespace pl;
+
+static std::shared_ptr<DataT<float>> make_positions(const size_t n) {
+	auto positions = std::make_shared<DataT<float>>();
+	positions->components = 3;
+	for (size_t i = 0; i < n; ++i) {
+		positions->data.push_back(static_cast<float>(i % 7));
+		positions->data.push_back(static_cast<float>(i));
+		positions->data.push_back(-static_cast<float>(i));
+	}
+	return positions;
+}
+
+static void test_component_view_aos() {
+	auto positions = make_positions(100);
+	auto y = component_view(positions, 1);
+	PL_CHECK(y->count() == 100);
+	PL_CHECK(y->stride() == 3);
+	PL_CHECK(y->holds<float>());
+	const ArrayView<const float> view = static_cast<const Data&>(*y).view<float>();
+	for (size_t i = 0; i < view.size(); ++i) {
+		PL_CHECK(view[i] == static_cast<float>(i));
+	}
+	auto s = stats(*y);
+	PL_CHECK(s->components.size() == 1);
+	PL_CHECK(s->components[0].min == 0.0);
+	PL_CHECK(s->components[0].max == 99.0);
+}
+
+static void test_component_view_soa() {
+	auto positions = to_layout(make_positions(100), Layout::SOA);
+	auto yz = component_view(positions, 1, 2);
+	PL_CHECK(yz->stride() == 1);
+	PL_CHECK(yz->count() == 100);
+	auto s = stats(*yz);
+	PL_CHECK(s->components[0].max == 99.0);
+	PL_CHECK(s->components[1].min == -99.0);
+}
+
+// Views of arrays which aren't stored as a scalar type are visited through their
+// contiguous decoded floats, so the strides must describe that buffer
+static void test_component_view_non_raw() {
+	const size_t n = 100000;
+	auto positions = make_positions(n);
+	for (const Layout layout : {Layout::AOS, Layout::SOA}) {
+		auto quantized = quantize_positions(*to_layout(positions, layout));
+		PL_CHECK(!static_cast<const Data&>(*quantized).raw_data());
+		const vec3f error = quantized->max_error();
+
+		auto y = component_view(quantized, 1);
+		PL_CHECK(y->stride() == 1);
+		PL_CHECK(!static_cast<const Data&>(*y).raw_data());
+		auto s = stats(*y);
+		PL_CHECK(std::abs(s->components[0].min) <= error.y);
+		PL_CHECK(std::abs(s->components[0].max - (n - 1)) <= error.y);
+		PL_CHECK(std::abs(s->components[0].mean - (n - 1) / 2.0) <= error.y);
+
+		auto yz = component_view(quantized, 1, 2);
+		const ComponentStrides strides(*yz);
+		std::vector<float> z(n);
+		visit(*yz, [&](const auto &view) {
+			PL_CHECK(view.size() == 2 * n);
+			for (size_t i = 0; i < n; ++i) {
+				z[i] = static_cast<float>(view.data()[i * strides.particle_stride
+						+ strides.component_stride]);
+			}
+		});
+		for (size_t i = 0; i < n; ++i) {
+			PL_CHECK(std::abs(z[i] + static_cast<float>(i)) <= error.z);
+		}
+	}
+}
+
+static void test_row_view() {
+	auto positions = make_positions(10);
+	RowView rows(positions, 2, 5);
+	PL_CHECK(rows.count() == 5);
+	PL_CHECK(rows.stride() == 1);
+	PL_CHECK(rows.get_float(rows.index(0, 1)) == 2.f);
+
+	auto indices = std::make_shared<std::vector<size_t>>(std::vector<size_t>{9, 0, 4});
+	auto picked = materialize(RowView(positions, indices));
+	PL_CHECK(picked->holds<float>());
+	PL_CHECK(picked->count() == 3);
+	for (size_t i = 0; i < indices->size(); ++i) {
+		PL_CHECK(picked->get_float(picked->index(i, 1)) == static_cast<float>((*indices)[i]));
+	}
+}
+
+// An int array which can only be read through get_float
+struct FloatOnlyData : Data {
+	const std::type_info& type() const override {
+		return typeid(int32_t);
+	}
+	void write(std::ofstream &) const override {}
+	float get_float(const size_t i) const override {
+		return static_cast<float>(i);
+	}
+	size_t size() const override {
+		return 10;
+	}
+};
+
+// Write the data to a file and read it back as T, checking the file holds size() elements of T
+template<typename T>
+static std::vector<T> write_and_read(const Data &data) {
+	PL_CHECK(data.type() == typeid(T));
+	{
+		std::ofstream out("test_view.raw", std::ios::binary);
+		data.write(out);
+	}
+	std::ifstream in("test_view.raw", std::ios::binary | std::ios::ate);
+	PL_CHECK(static_cast<size_t>(in.tellg()) == data.size() * sizeof(T));
+	in.seekg(0);
+	std::vector<T> values(data.size());
+	in.read(reinterpret_cast<char*>(values.data()), sizeof(T) * values.size());
+	in.close();
+	std::remove("test_view.raw");
+	return values;
+}
+
+// Views of data without raw data write out the type they report
+static void test_row_view_write_type() {
+	auto indices = std::make_shared<std::vector<size_t>>(std::vector<size_t>{5, 1, 8});
+
+	auto ids = std::make_shared<DataT<int64_t>>();
+	for (size_t i = 0; i < 10; ++i) {
+		ids->data.push_back((int64_t(1) << 40) + 7 * static_cast<int64_t>(i % 3));
+	}
+	auto dictionary = narrow_integers(ids);
+	PL_CHECK(dynamic_cast<DictionaryData*>(dictionary.get()));
+	std::vector<int64_t> id_values = write_and_read<int64_t>(RowView(dictionary, indices));
+	for (size_t i = 0; i < indices->size(); ++i) {
+		PL_CHECK(id_values[i] == ids->data[(*indices)[i]]);
+	}
+
+	auto values = std::make_shared<DataT<int32_t>>();
+	for (int32_t i = 0; i < 10; ++i) {
+		values->data.push_back(i * 1000);
+	}
+	auto compressed = compress(*values);
+	std::vector<int32_t> int_values = write_and_read<int32_t>(RowView(compressed, indices));
+	for (size_t i = 0; i < indices->size(); ++i) {
+		PL_CHECK(int_values[i] == values->data[(*indices)[i]]);
+	}
+	int_values = write_and_read<int32_t>(RowView(compressed, 2, 3));
+	PL_CHECK(int_values[0] == 2000 && int_values[2] == 4000);
+
+	auto positions = make_positions(10);
+	auto quantized = quantize_positions(*positions);
+	std::vector<float> float_values = write_and_read<float>(RowView(quantized, indices));
+	PL_CHECK(float_values.size() == 9);
+	PL_CHECK(std::abs(float_values[1] - 5.f) <= quantized->max_error().y);
+
+	float_values = write_and_read<float>(RowView(std::make_shared<FloatOnlyData>(), indices));
+	PL_CHECK(float_values[0] == 5.f);
+	float_values = write_and_read<float>(*component_view(std::make_shared<FloatOnlyData>(), 0));
+	PL_CHECK(float_values[9] == 9.f);
+}
+
+int main() {
+	return pl_test::run_tests({
+		{"component_view_aos", test_component_view_aos},
+		{"component_view_soa", test_component_view_soa},
+		{"component_view_non_raw", test_component_view_non_raw},
+		{"row_view", test_row_view},
+		{"row_view_write_type", test_row_view_write_type}
+	});
+}